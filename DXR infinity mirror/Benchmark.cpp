@@ -0,0 +1,253 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cmath>
+
+static std::string narrow(const std::wstring& value)
+{
+	std::string result;
+	for (wchar_t c : value)
+	{
+		result.push_back(c < 128 ? (char)c : '?');
+	}
+	return result;
+}
+
+static bool parseUInt(const std::wstring& text, uint32_t* pValue)
+{
+	if (text.empty() || text.find_first_not_of(L"0123456789") != std::wstring::npos || text.size() > 9)
+	{
+		return false;
+	}
+	*pValue = (uint32_t)std::stoul(text);
+	return true;
+}
+
+static std::vector<std::wstring> split(const std::wstring& text, wchar_t separator)
+{
+	std::vector<std::wstring> parts;
+	std::wstringstream stream(text);
+	std::wstring part;
+	while (std::getline(stream, part, separator))
+	{
+		parts.push_back(part);
+	}
+	return parts;
+}
+
+bool ParseBenchmarkArguments(const std::wstring& commandLine, BenchmarkConfig* pConfig)
+{
+	std::wstringstream stream(commandLine);
+	std::vector<std::wstring> tokens;
+	std::wstring token;
+	while (stream >> token)
+	{
+		tokens.push_back(token);
+	}
+
+	for (size_t i = 0; i < tokens.size(); i++)
+	{
+		const std::wstring& option = tokens[i];
+		if (option != L"-depths" && option != L"-resolutions" && option != L"-primary" && option != L"-frames" && option != L"-warmup" && option != L"-model" && option != L"-output")
+		{
+			continue; //flags of the application itself, such as -benchmark
+		}
+
+		if (i + 1 >= tokens.size())
+		{
+			std::cerr << "Error: Benchmark option " << narrow(option) << " is missing its value\n";
+			return false;
+		}
+		const std::wstring& value = tokens[++i];
+
+		if (option == L"-depths")
+		{
+			pConfig->Depths.clear();
+			for (const std::wstring& part : split(value, L','))
+			{
+				uint32_t depth;
+				if (!parseUInt(part, &depth) || depth == 0)
+				{
+					std::cerr << "Error: Invalid benchmark depth " << narrow(part) << "\n";
+					return false;
+				}
+				pConfig->Depths.push_back(depth);
+			}
+		}
+		else if (option == L"-resolutions")
+		{
+			pConfig->Resolutions.clear();
+			for (const std::wstring& part : split(value, L','))
+			{
+				std::vector<std::wstring> size = split(part, L'x');
+				uint32_t width, height;
+				if (size.size() != 2 || !parseUInt(size[0], &width) || !parseUInt(size[1], &height) || width == 0 || height == 0)
+				{
+					std::cerr << "Error: Invalid benchmark resolution " << narrow(part) << ", expected WIDTHxHEIGHT\n";
+					return false;
+				}
+				pConfig->Resolutions.push_back(std::make_pair(width, height));
+			}
+		}
+		else if (option == L"-primary")
+		{
+			pConfig->HybridPrimary.clear();
+			for (const std::wstring& part : split(value, L','))
+			{
+				if (part != L"traced" && part != L"hybrid")
+				{
+					std::cerr << "Error: Invalid benchmark primary visibility " << narrow(part) << ", expected traced or hybrid\n";
+					return false;
+				}
+				pConfig->HybridPrimary.push_back(part == L"hybrid");
+			}
+		}
+		else if (option == L"-frames" || option == L"-warmup")
+		{
+			uint32_t frames;
+			if (!parseUInt(value, &frames) || (option == L"-frames" && frames == 0))
+			{
+				std::cerr << "Error: Invalid benchmark frame count " << narrow(value) << "\n";
+				return false;
+			}
+			(option == L"-frames" ? pConfig->Frames : pConfig->WarmupFrames) = frames;
+		}
+		else if (option == L"-model")
+		{
+			pConfig->Model = narrow(value);
+		}
+		else
+		{
+			pConfig->OutputPath = narrow(value);
+		}
+	}
+
+	return true;
+}
+
+FrameTimeSummary SummarizeFrameTimes(std::vector<double> frameTimes)
+{
+	FrameTimeSummary summary;
+	if (frameTimes.empty())
+	{
+		return summary;
+	}
+
+	std::sort(frameTimes.begin(), frameTimes.end());
+	const size_t count = frameTimes.size();
+
+	double sum = 0.0;
+	for (double frameTime : frameTimes)
+	{
+		sum += frameTime;
+	}
+
+	auto percentile = [&](double p)
+	{
+		size_t rank = (size_t)std::ceil(p / 100.0 * count);
+		return frameTimes[std::min(std::max(rank, (size_t)1), count) - 1];
+	};
+
+	summary.Frames = (uint32_t)count;
+	summary.MeanMilliseconds = sum / count;
+	summary.MedianMilliseconds = (count % 2 == 1) ? frameTimes[count / 2] : (frameTimes[count / 2 - 1] + frameTimes[count / 2]) * 0.5;
+	summary.P95Milliseconds = percentile(95.0);
+	summary.P99Milliseconds = percentile(99.0);
+	summary.MinMilliseconds = frameTimes.front();
+	summary.MaxMilliseconds = frameTimes.back();
+	return summary;
+}
+
+static std::string jsonString(const std::string& value)
+{
+	std::string result = "\"";
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\')
+		{
+			result.push_back('\\');
+		}
+		result.push_back(c);
+	}
+	return result + "\"";
+}
+
+int WriteBenchmarkResults(const std::vector<BenchmarkResult>& results, const std::string& outputPath)
+{
+	const std::string csvPath = outputPath + ".csv";
+	bool writeHeader = !std::ifstream(csvPath).good();
+
+	std::ofstream csv(csvPath, std::ios::app);
+	if (!csv)
+	{
+		std::cerr << "Error: Failed opening " << csvPath << "\n";
+		return 1;
+	}
+
+	if (writeHeader)
+	{
+		csv << "model,width,height,depth,frames,mean_ms,median_ms,p95_ms,p99_ms,min_ms,max_ms,primary\n";
+	}
+	for (const BenchmarkResult& result : results)
+	{
+		const FrameTimeSummary& s = result.Summary;
+		csv << result.Model << "," << result.Width << "," << result.Height << "," << result.Depth << "," << s.Frames << ","
+			<< s.MeanMilliseconds << "," << s.MedianMilliseconds << "," << s.P95Milliseconds << "," << s.P99Milliseconds << ","
+			<< s.MinMilliseconds << "," << s.MaxMilliseconds << "," << (result.HybridPrimary ? "hybrid" : "traced") << "\n";
+	}
+
+	const std::string jsonPath = outputPath + ".json";
+	std::ofstream json(jsonPath, std::ios::trunc);
+	if (!json)
+	{
+		std::cerr << "Error: Failed opening " << jsonPath << "\n";
+		return 1;
+	}
+
+	json << "[\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult& result = results[i];
+		const FrameTimeSummary& s = result.Summary;
+		json << "  { \"model\": " << jsonString(result.Model) << ", \"width\": " << result.Width << ", \"height\": " << result.Height
+			<< ", \"depth\": " << result.Depth << ", \"primary\": \"" << (result.HybridPrimary ? "hybrid" : "traced") << "\", \"frames\": " << s.Frames
+			<< ", \"mean_ms\": " << s.MeanMilliseconds << ", \"median_ms\": " << s.MedianMilliseconds
+			<< ", \"p95_ms\": " << s.P95Milliseconds << ", \"p99_ms\": " << s.P99Milliseconds
+			<< ", \"min_ms\": " << s.MinMilliseconds << ", \"max_ms\": " << s.MaxMilliseconds << " }"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	json << "]\n";
+
+	std::cout << "Benchmark results written to " << csvPath << " and " << jsonPath << "\n";
+	return (csv && json) ? 0 : 1;
+}
+
+void ReportHybridSavings(const std::vector<BenchmarkResult>& results, std::ostream& stream)
+{
+	for (const BenchmarkResult& traced : results)
+	{
+		if (traced.HybridPrimary)
+		{
+			continue;
+		}
+
+		for (const BenchmarkResult& hybrid : results)
+		{
+			if (!hybrid.HybridPrimary || hybrid.Width != traced.Width || hybrid.Height != traced.Height || hybrid.Depth != traced.Depth)
+			{
+				continue;
+			}
+
+			double saved = traced.Summary.MeanMilliseconds - hybrid.Summary.MeanMilliseconds;
+			stream << "Hybrid primary visibility " << traced.Width << "x" << traced.Height << " depth " << traced.Depth << ": "
+				<< saved << " ms per frame saved over traced camera rays";
+			if (traced.Summary.MeanMilliseconds > 0.0)
+			{
+				stream << " (" << saved / traced.Summary.MeanMilliseconds * 100.0 << "%)";
+			}
+			stream << "\n";
+		}
+	}
+}
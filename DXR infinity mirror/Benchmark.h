@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//A sweep of dispatch resolutions, ray depths and primary visibility modes, each point rendered for the same frames of the animation.
+//Only uses the standard library, the renderer drives it and hands back the frame times
+struct BenchmarkConfig
+{
+	std::vector<uint32_t> Depths;
+	std::vector<bool> HybridPrimary; //false traces the camera rays, true rasterises their hits
+	std::vector<std::pair<uint32_t, uint32_t>> Resolutions; //width, height
+	uint32_t WarmupFrames = 0; //rendered but not timed at the start of every point
+	uint32_t Frames = 0;
+	std::string Model;
+	std::string OutputPath; //results go to <OutputPath>.csv and <OutputPath>.json
+};
+
+//Picks the options out of the command line, such as
+//-depths 1,8,31 -resolutions 1920x1080,960x540 -primary traced,hybrid -frames 1000 -warmup 100 -model mirrorTest.fbx -output Benchmark
+//Options that are not given keep the value already in the config. Returns false and reports on malformed options
+bool ParseBenchmarkArguments(const std::wstring& commandLine, BenchmarkConfig* pConfig);
+
+struct FrameTimeSummary
+{
+	uint32_t Frames = 0;
+	double MeanMilliseconds = 0.0;
+	double MedianMilliseconds = 0.0;
+	double P95Milliseconds = 0.0;
+	double P99Milliseconds = 0.0;
+	double MinMilliseconds = 0.0;
+	double MaxMilliseconds = 0.0;
+};
+
+//Percentiles use the nearest rank of the sorted frame times
+FrameTimeSummary SummarizeFrameTimes(std::vector<double> frameTimes);
+
+struct BenchmarkResult
+{
+	std::string Model;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t Depth;
+	bool HybridPrimary = false;
+	FrameTimeSummary Summary;
+};
+
+//The CSV is appended to, so launches with different models collect in one table.
+//The JSON holds the results of this launch only. Returns 0 on success
+int WriteBenchmarkResults(const std::vector<BenchmarkResult>& results, const std::string& outputPath);
+
+//Prints the mean frame time the rasterised first hits save at every point that was rendered both ways
+void ReportHybridSavings(const std::vector<BenchmarkResult>& results, std::ostream& stream);
@@ -0,0 +1,218 @@
+#include "BlasBuilder.h"
+
+BlasBuilder::BlasBuilder()
+{
+
+}
+
+BlasBuilder::~BlasBuilder()
+{
+	releaseScratch();
+}
+
+void BlasBuilder::init(ID3D12Device5* device, GpuAllocator* bufferAllocator, uint64_t scratchBudget, bool allowCompaction)
+{
+	device_ = device;
+	bufferAllocator_ = bufferAllocator;
+	scratchBudget_ = scratchBudget;
+	allowCompaction_ = allowCompaction;
+}
+
+D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS BlasBuilder::buildFlags() const
+{
+	return allowCompaction_ ? D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION : D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
+}
+
+int BlasBuilder::addBuild(const D3D12_RAYTRACING_GEOMETRY_DESC* geometryDescs, uint32_t numDescs, ID3D12Resource1** ppResult)
+{
+	BuildRequest request;
+	request.GeometryDescs.assign(geometryDescs, geometryDescs + numDescs);
+	request.ppResult = ppResult;
+
+	// Get the size requirements for the scratch and AS buffers
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	inputs.Flags = buildFlags();
+	inputs.NumDescs = numDescs;
+	inputs.pGeometryDescs = request.GeometryDescs.data();
+	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+
+	request.Info = {};
+	device_->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &request.Info);
+
+	// The result needs to support UAV, and since it is written by the build right away it starts in the acceleration structure state
+	*ppResult = bufferAllocator_->createBuffer(request.Info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory_Blas);
+	if (*ppResult == nullptr)
+	{
+		std::cerr << "Error: Failed creating BLAS result buffer of " << request.Info.ResultDataMaxSizeInBytes << " bytes\n";
+		return 1;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	requests_.push_back(std::move(request));
+	return 0;
+}
+
+int BlasBuilder::record(ID3D12GraphicsCommandList4* commandList)
+{
+	if (requests_.empty()) return 0;
+
+	//Size the pool to fit every build side by side, unless that goes over the budget
+	uint64_t totalScratch = 0;
+	uint64_t largestScratch = 0;
+	for (const BuildRequest& request : requests_)
+	{
+		uint64_t scratchSize = align_to(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, request.Info.ScratchDataSizeInBytes);
+		totalScratch += scratchSize;
+		largestScratch = (std::max)(largestScratch, scratchSize);
+	}
+	uint64_t poolSize = (std::max)((std::min)(totalScratch, scratchBudget_), largestScratch);
+
+	bufferAllocator_->releaseBuffer(&scratch_);
+	scratch_ = bufferAllocator_->createBuffer(poolSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory_Scratch);
+	if (scratch_ == nullptr)
+	{
+		std::cerr << "Error: Failed creating BLAS scratch pool of " << poolSize << " bytes\n";
+		return 1;
+	}
+	scratch_->SetName(L"BLAS scratch pool");
+
+	if (allowCompaction_)
+	{
+		//One 64 bit compacted size per build
+		uint64_t sizesBytes = sizeof(UINT64) * requests_.size();
+		bufferAllocator_->releaseBuffer(&compactedSizes_);
+		bufferAllocator_->releaseBuffer(&compactedSizesReadback_);
+		compactedSizes_ = bufferAllocator_->createBuffer(sizesBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory_Blas);
+		compactedSizesReadback_ = bufferAllocator_->createBuffer(sizesBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_HEAP_TYPE_READBACK, MemoryCategory_Readback);
+		if (compactedSizes_ == nullptr || compactedSizesReadback_ == nullptr)
+		{
+			std::cerr << "Error: Failed creating BLAS compacted size buffers\n";
+			return 1;
+		}
+	}
+
+	// A UAV barrier covering every build of the batch. It also protects the scratch before the next batch reuses it
+	D3D12_RESOURCE_BARRIER uavBarrier = {};
+	uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	uavBarrier.UAV.pResource = nullptr;
+
+	uint64_t scratchOffset = 0;
+	uint32_t numBatches = 1;
+	for (size_t i = 0; i < requests_.size(); i++)
+	{
+		BuildRequest& request = requests_[i];
+
+		uint64_t scratchSize = align_to(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, request.Info.ScratchDataSizeInBytes);
+		if (scratchOffset + scratchSize > poolSize)
+		{
+			commandList->ResourceBarrier(1, &uavBarrier);
+			scratchOffset = 0;
+			numBatches++;
+		}
+
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
+		asDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+		asDesc.Inputs.Flags = buildFlags();
+		asDesc.Inputs.NumDescs = (UINT)request.GeometryDescs.size();
+		asDesc.Inputs.pGeometryDescs = request.GeometryDescs.data();
+		asDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+		asDesc.DestAccelerationStructureData = (*request.ppResult)->GetGPUVirtualAddress();
+		asDesc.ScratchAccelerationStructureData = scratch_->GetGPUVirtualAddress() + scratchOffset;
+
+		if (allowCompaction_)
+		{
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postbuildDesc = {};
+			postbuildDesc.InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE;
+			postbuildDesc.DestBuffer = compactedSizes_->GetGPUVirtualAddress() + sizeof(UINT64) * i;
+			commandList->BuildRaytracingAccelerationStructure(&asDesc, 1, &postbuildDesc);
+		}
+		else
+		{
+			commandList->BuildRaytracingAccelerationStructure(&asDesc, 0, nullptr);
+		}
+		scratchOffset += scratchSize;
+	}
+	commandList->ResourceBarrier(1, &uavBarrier);
+
+	if (allowCompaction_)
+	{
+		D3D12_RESOURCE_BARRIER toCopySource = {};
+		toCopySource.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		toCopySource.Transition.pResource = compactedSizes_;
+		toCopySource.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+		toCopySource.Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		toCopySource.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+		commandList->ResourceBarrier(1, &toCopySource);
+
+		commandList->CopyResource(compactedSizesReadback_, compactedSizes_);
+	}
+
+	std::cout << "Recorded " << requests_.size() << " BLAS builds in " << numBatches << " batches sharing " << poolSize / 1024 << " KB of scratch\n";
+
+	if (allowCompaction_)
+	{
+		built_ = std::move(requests_);
+	}
+	requests_.clear();
+	return 0;
+}
+
+int BlasBuilder::recordCompaction(ID3D12GraphicsCommandList4* commandList)
+{
+	if (built_.empty()) return 0;
+
+	UINT64* compactedSizes = nullptr;
+	D3D12_RANGE readRange = { 0, sizeof(UINT64) * built_.size() };
+	if (FAILED(compactedSizesReadback_->Map(0, &readRange, (void**)&compactedSizes)))
+	{
+		std::cerr << "Error: Failed reading back BLAS compacted sizes\n";
+		return 1;
+	}
+
+	for (size_t i = 0; i < built_.size(); i++)
+	{
+		BuildRequest& request = built_[i];
+
+		ID3D12Resource1* compacted = bufferAllocator_->createBuffer(compactedSizes[i], D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, D3D12_HEAP_TYPE_DEFAULT, MemoryCategory_Blas);
+		if (compacted == nullptr)
+		{
+			std::cerr << "Error: Failed creating compacted BLAS buffer, keeping mesh " << i << " uncompacted\n";
+			continue;
+		}
+
+		commandList->CopyRaytracingAccelerationStructure(compacted->GetGPUVirtualAddress(), (*request.ppResult)->GetGPUVirtualAddress(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+
+		//The original is still read by the copy, so it is only released once the copies have completed
+		compaction_.addCompaction((uint32_t)i, request.Info.ResultDataMaxSizeInBytes, compactedSizes[i],
+			bufferAllocator_->blockSize(*request.ppResult), bufferAllocator_->blockSize(compacted), *request.ppResult);
+		*request.ppResult = compacted;
+	}
+
+	D3D12_RANGE writeRange = { 0, 0 };
+	compactedSizesReadback_->Unmap(0, &writeRange);
+
+	D3D12_RESOURCE_BARRIER uavBarrier = {};
+	uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	uavBarrier.UAV.pResource = nullptr;
+	commandList->ResourceBarrier(1, &uavBarrier);
+
+	compaction_.report(std::cout);
+
+	built_.clear();
+	return 0;
+}
+
+void BlasBuilder::releaseScratch()
+{
+	if (bufferAllocator_ == nullptr) return;
+
+	bufferAllocator_->releaseBuffer(&scratch_);
+	bufferAllocator_->releaseBuffer(&compactedSizes_);
+	bufferAllocator_->releaseBuffer(&compactedSizesReadback_);
+	for (void* original : compaction_.takeOriginals())
+	{
+		ID3D12Resource1* buffer = (ID3D12Resource1*)original;
+		bufferAllocator_->releaseBuffer(&buffer);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "stdafx.h"
+
+#include "GenericIncludes.h"
+#include "GpuAllocator.h"
+#include "CompactionLedger.h"
+
+//Collects bottom level builds and records them together, sharing one scratch pool.
+//Builds are packed into batches that fit the pool, each batch ends in a single UAV barrier.
+//With compaction enabled the builds also emit their compacted size, which a second pass uses to copy each BLAS into a tight buffer
+class BlasBuilder
+{
+	struct BuildRequest
+	{
+		std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> GeometryDescs;
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO Info;
+		ID3D12Resource1** ppResult;
+	};
+
+	ID3D12Device5* device_ = nullptr;
+	GpuAllocator* bufferAllocator_ = nullptr;
+	uint64_t scratchBudget_ = 0;
+	bool allowCompaction_ = false;
+
+	std::mutex mutex_; //guards requests_, builds can be added from several threads
+	std::vector<BuildRequest> requests_;
+	std::vector<BuildRequest> built_; //recorded builds waiting for compaction
+
+	ID3D12Resource1* scratch_ = nullptr;
+	ID3D12Resource1* compactedSizes_ = nullptr; //written by the builds
+	ID3D12Resource1* compactedSizesReadback_ = nullptr;
+	CompactionLedger compaction_; //holds the originals until the compacting copies are done
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags() const;
+
+public:
+	BlasBuilder();
+	~BlasBuilder();
+
+	void init(ID3D12Device5* device, GpuAllocator* bufferAllocator, uint64_t scratchBudget, bool allowCompaction);
+
+	//Can be called from several threads at once.
+	//Creates the result buffer right away and stores it in *ppResult, so it can be referenced before the build is recorded.
+	//Compaction later replaces *ppResult with the compacted buffer
+	int addBuild(const D3D12_RAYTRACING_GEOMETRY_DESC* geometryDescs, uint32_t numDescs, ID3D12Resource1** ppResult);
+
+	//Records every build added since the last call
+	int record(ID3D12GraphicsCommandList4* commandList);
+
+	//Records copies of the recorded builds into tight buffers. Only call once the builds have completed on the GPU
+	int recordCompaction(ID3D12GraphicsCommandList4* commandList);
+
+	//Frees the scratch pool and the uncompacted originals. Only call once everything recorded has completed on the GPU
+	void releaseScratch();
+};
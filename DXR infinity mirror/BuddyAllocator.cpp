@@ -0,0 +1,107 @@
+#include "BuddyAllocator.h"
+#include <algorithm>
+#include <iostream>
+
+BuddyAllocator::BuddyAllocator(uint64_t size, uint64_t minBlockSize)
+{
+	size_ = size;
+	minBlockSize_ = minBlockSize;
+
+	numOrders_ = 1;
+	while (blockSize(numOrders_ - 1) < size_)
+	{
+		numOrders_++;
+	}
+
+	freeBlocks_.resize(numOrders_);
+	freeBlocks_[numOrders_ - 1].insert(0);
+}
+
+uint64_t BuddyAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+	//blocks are aligned to their size, so asking for a bigger alignment means asking for a bigger block
+	uint64_t needed = std::max(size, alignment);
+
+	uint32_t order = 0;
+	while (order < numOrders_ && blockSize(order) < needed)
+	{
+		order++;
+	}
+	if (order >= numOrders_) return INVALID_OFFSET;
+
+	//smallest free block that fits
+	uint32_t freeOrder = order;
+	while (freeOrder < numOrders_ && freeBlocks_[freeOrder].empty())
+	{
+		freeOrder++;
+	}
+	if (freeOrder >= numOrders_) return INVALID_OFFSET;
+
+	uint64_t offset = *freeBlocks_[freeOrder].begin();
+	freeBlocks_[freeOrder].erase(freeBlocks_[freeOrder].begin());
+
+	//split it down, keeping the lower half and freeing the upper buddy at each step
+	while (freeOrder > order)
+	{
+		freeOrder--;
+		freeBlocks_[freeOrder].insert(offset + blockSize(freeOrder));
+	}
+
+	allocations_[offset] = { order, size };
+	allocatedBytes_ += blockSize(order);
+	requestedBytes_ += size;
+
+	return offset;
+}
+
+void BuddyAllocator::free(uint64_t offset)
+{
+	auto allocation = allocations_.find(offset);
+	if (allocation == allocations_.end())
+	{
+		std::cerr << "Error: freeing unknown heap offset " << offset << "\n";
+		return;
+	}
+
+	uint32_t order = allocation->second.first;
+	allocatedBytes_ -= blockSize(order);
+	requestedBytes_ -= allocation->second.second;
+	allocations_.erase(allocation);
+
+	//merge with the buddy for as long as it is free
+	while (order < numOrders_ - 1)
+	{
+		uint64_t buddy = offset ^ blockSize(order);
+		auto freeBuddy = freeBlocks_[order].find(buddy);
+		if (freeBuddy == freeBlocks_[order].end()) break;
+
+		freeBlocks_[order].erase(freeBuddy);
+		offset = std::min(offset, buddy);
+		order++;
+	}
+	freeBlocks_[order].insert(offset);
+}
+
+uint64_t BuddyAllocator::blockSizeAt(uint64_t offset) const
+{
+	auto allocation = allocations_.find(offset);
+	return allocation == allocations_.end() ? 0 : blockSize(allocation->second.first);
+}
+
+void BuddyAllocator::addStats(GpuAllocatorStats* stats) const
+{
+	stats->HeapBytes += size_;
+	stats->AllocatedBytes += allocatedBytes_;
+	stats->RequestedBytes += requestedBytes_;
+	stats->NumHeaps++;
+	stats->NumAllocations += (uint32_t)allocations_.size();
+
+	for (uint32_t order = numOrders_; order > 0; order--)
+	{
+		if (!freeBlocks_[order - 1].empty())
+		{
+			stats->LargestFreeBlock = std::max(stats->LargestFreeBlock, blockSize(order - 1));
+			break;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+struct GpuAllocatorStats
+{
+	uint64_t HeapBytes = 0;			//bytes reserved in heaps
+	uint64_t AllocatedBytes = 0;	//bytes handed out, rounded up to block sizes
+	uint64_t RequestedBytes = 0;	//bytes actually asked for
+	uint64_t LargestFreeBlock = 0;
+	uint32_t NumHeaps = 0;
+	uint32_t NumAllocations = 0;
+
+	uint64_t FreeBytes() const { return HeapBytes - AllocatedBytes; }
+
+	//0 when all free memory is one contiguous block, approaching 1 as it gets split into small pieces
+	float Fragmentation() const { return FreeBytes() == 0 ? 0.0f : 1.0f - (float)LargestFreeBlock / (float)FreeBytes(); }
+};
+
+//Pure bookkeeping for a single heap, does not touch the device.
+//Blocks are powers of two and aligned to their own size relative to the start of the heap. Only uses the standard library
+class BuddyAllocator
+{
+	uint64_t size_;
+	uint64_t minBlockSize_;
+	uint32_t numOrders_;
+
+	std::vector<std::set<uint64_t>> freeBlocks_; //free block offsets per order
+	std::unordered_map<uint64_t, std::pair<uint32_t, uint64_t>> allocations_; //offset -> order, requested size
+
+	uint64_t allocatedBytes_ = 0;
+	uint64_t requestedBytes_ = 0;
+
+	uint64_t blockSize(uint32_t order) const { return minBlockSize_ << order; }
+
+public:
+	static const uint64_t INVALID_OFFSET = UINT64_MAX;
+
+	//size must be minBlockSize times a power of two
+	BuddyAllocator(uint64_t size, uint64_t minBlockSize);
+
+	uint64_t allocate(uint64_t size, uint64_t alignment);
+	void free(uint64_t offset);
+
+	//Size of the block the allocation at offset took, 0 if there is none
+	uint64_t blockSizeAt(uint64_t offset) const;
+
+	bool empty() const { return allocations_.empty(); }
+	uint64_t size() const { return size_; }
+
+	void addStats(GpuAllocatorStats* stats) const;
+};
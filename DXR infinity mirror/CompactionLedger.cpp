@@ -0,0 +1,52 @@
+#include "CompactionLedger.h"
+
+void CompactionLedger::addCompaction(uint32_t mesh, uint64_t prebuildBytes, uint64_t compactedBytes, uint64_t blockBytesBefore, uint64_t blockBytesAfter, void* original)
+{
+	entries_.push_back({ mesh, prebuildBytes, compactedBytes, blockBytesBefore, blockBytesAfter });
+	originals_.push_back(original);
+}
+
+std::vector<void*> CompactionLedger::takeOriginals()
+{
+	std::vector<void*> originals;
+	originals.swap(originals_);
+	return originals;
+}
+
+uint64_t CompactionLedger::blockBytesBefore() const
+{
+	uint64_t bytes = 0;
+	for (const Entry& entry : entries_)
+	{
+		bytes += entry.BlockBytesBefore;
+	}
+	return bytes;
+}
+
+uint64_t CompactionLedger::blockBytesAfter() const
+{
+	uint64_t bytes = 0;
+	for (const Entry& entry : entries_)
+	{
+		bytes += entry.BlockBytesAfter;
+	}
+	return bytes;
+}
+
+void CompactionLedger::report(std::ostream& stream) const
+{
+	uint64_t prebuildBytes = 0;
+	uint64_t compactedBytes = 0;
+	for (const Entry& entry : entries_)
+	{
+		stream << "BLAS " << entry.Mesh << " compacted from " << entry.PrebuildBytes << " to " << entry.CompactedBytes << " bytes, its blocks from "
+			<< entry.BlockBytesBefore / 1024 << " KB to " << entry.BlockBytesAfter / 1024 << " KB\n";
+		prebuildBytes += entry.PrebuildBytes;
+		compactedBytes += entry.CompactedBytes;
+	}
+
+	const uint64_t before = blockBytesBefore();
+	const uint64_t after = blockBytesAfter();
+	stream << "BLAS compaction: " << prebuildBytes / 1024 << " KB -> " << compactedBytes / 1024 << " KB of acceleration structures, "
+		<< before / 1024 << " KB -> " << after / 1024 << " KB of heap blocks, freeing " << (before - after) / 1024 << " KB\n";
+}
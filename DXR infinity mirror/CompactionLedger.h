@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+//What a BLAS compaction pass saves, and the uncompacted originals it has to keep alive until its copies are done.
+//Sizes are counted both as the driver reports them and in the allocator blocks the buffers take, since only whole
+//blocks go back to the heaps. Only uses the standard library, the buffers are opaque handles
+class CompactionLedger
+{
+	struct Entry
+	{
+		uint32_t Mesh;
+		uint64_t PrebuildBytes;
+		uint64_t CompactedBytes;
+		uint64_t BlockBytesBefore;
+		uint64_t BlockBytesAfter;
+	};
+
+	std::vector<Entry> entries_;
+	std::vector<void*> originals_;
+
+public:
+	//The original is still read by the compacting copy, so it is held until takeOriginals
+	void addCompaction(uint32_t mesh, uint64_t prebuildBytes, uint64_t compactedBytes, uint64_t blockBytesBefore, uint64_t blockBytesAfter, void* original);
+
+	//Hands over the originals to release. Only call once the compacting copies have completed
+	std::vector<void*> takeOriginals();
+
+	uint64_t blockBytesBefore() const;
+	uint64_t blockBytesAfter() const;
+
+	//One line per mesh and the totals of everything compacted so far
+	void report(std::ostream& stream) const;
+};
@@ -5,6 +5,9 @@
 #pragma comment (lib, "d3d12.lib")
 #pragma comment (lib, "DXGI.lib")
 #include <DirectXMath.h>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
 
 
 #include "Settings.h"
@@ -12,6 +15,19 @@
 #include "WindowsHelper.h"
 #include "SceneObject.h"
 #include "ShaderCompiler.h"
+#include "GpuAllocator.h"
+#include "Uploader.h"
+#include "BlasBuilder.h"
+#include "ShaderTable.h"
+#include "TaskGraph.h"
+#include "ShaderPermutation.h"
+#include "PixelStatistics.h"
+#include "Profiler.h"
+#include "GpuTimings.h"
+#include "MemoryRegistry.h"
+#include "FrameCapture.h"
+#include "DynamicResolution.h"
+#include "RecordedListCache.h"
 
 const WCHAR* sRayGen = RAY_GEN_SHADER_NAME;
 const WCHAR* sMiss = MISS_SHADER_NAME;
@@ -21,6 +37,12 @@ const WCHAR* sClosestHitMirror = MIRROR_CLOSEST_HIT_SHADER_NAME;
 const WCHAR* sHitGroupEdges = EDGES_HIT_GROUP_SHADER_NAME;
 const WCHAR* sClosestHitEdges = EDGES_CLOSEST_HIT_SHADER_NAME;
 
+//Uniform scale of every instance in the TLAS
+static const float InstanceScale = 0.5f;
+
+//Written to the edges hit group record, and drawn into the visibility buffer for the hybrid raygen
+static const float EdgesColor[3] = { 2.0f / 3.0f, 2.0f / 3.0f, 1.0f };
+
 template<class Interface>
 inline void SafeRelease(Interface** ppInterfaceToRelease)
 {
@@ -32,17 +54,24 @@ inline void SafeRelease(Interface** ppInterfaceToRelease)
 	}
 }
 
+void releaseBuffer(ID3D12Resource1** ppBuffer);
+
 struct AccelerationStructureBuffers
 {
-	ID3D12Resource1* pScratch = nullptr;
+	ID3D12Resource1* pScratch = nullptr;         // Used only for top-level AS, BLAS scratch comes from the BlasBuilder pool
 	ID3D12Resource1* pResult = nullptr;
 	ID3D12Resource1* pInstanceDesc = nullptr;    // Used only for top-level AS
 
+	void Release()
+	{
+		releaseBuffer(&pScratch);
+		releaseBuffer(&pResult);
+		releaseBuffer(&pInstanceDesc);
+	}
+
 	~AccelerationStructureBuffers()
 	{
-		SafeRelease(&pScratch);
-		SafeRelease(&pResult);
-		SafeRelease(&pInstanceDesc);
+		Release();
 	}
 };
 
@@ -51,17 +80,162 @@ struct ShaderTableData
 	UINT64 SizeInBytes;
 	UINT32 StrideInBytes;
 	ID3D12Resource1* Resource = nullptr;
+	void* MappedData = nullptr; //Persistently mapped so records can be patched in place
+
+	void Release()
+	{
+		if (Resource != nullptr && MappedData != nullptr)
+		{
+			Resource->Unmap(0, nullptr);
+			MappedData = nullptr;
+		}
+		releaseBuffer(&Resource);
+	}
 
 	~ShaderTableData()
 	{
-		SafeRelease(&Resource);
+		Release();
+	}
+};
+
+//Local root arguments of every kind of shader record, in the order of the local root signatures
+namespace ShaderRecords
+{
+	struct RayGen
+	{
+		UINT64 DescriptorTable; //output UAV and gRtScene
+	};
+
+	struct MirrorHitGroup
+	{
+		UINT64 Scene;
+		UINT64 Vertecies;
+		UINT64 Indecies;
+	};
+
+	//Mirror hit group of the flat normal permutation
+	struct FlatMirrorHitGroup
+	{
+		UINT64 Scene;
+		UINT64 FaceNormals;
+	};
+
+	struct EdgesHitGroup
+	{
+		float ShaderTableColor[3];
+	};
+}
+
+//Layout of the counters the shaders add to, see RayStatistics in the shaders
+struct RayStatisticsTotals
+{
+	UINT32 ConeBouncesSaved;
+	UINT32 RayDepthSum; //final depth of every primary ray
+	UINT32 ThroughputTerminations;
+};
+
+//C++ mirror of RayPayload in the shaders, which sizes the payload of the pipeline
+struct RayPayload
+{
+	float Color[3];
+	UINT32 Depth;
+	float ConeWidth;
+	float ConeSpreadAngle;
+};
+
+//RayPayload with the RAY_INSTRUMENTATION members
+struct InstrumentedRayPayload : RayPayload
+{
+	UINT32 HitType;
+};
+static_assert(sizeof(RayPayload) == 24 && sizeof(InstrumentedRayPayload) == 28, "RayPayload has to match the shaders");
+
+//CB_Frame of the shaders, written for every dispatch of a frame slot
+struct CheckerboardConstants
+{
+	UINT32 Checkerboard;
+	UINT32 CheckerboardParity;
+	UINT32 RenderWidth;
+	UINT32 RenderHeight;
+	UINT32 HistoryValid;
+	UINT32 FrameIndex;
+};
+
+//Root constants of the visibility pass, CB_Visibility in Visibility.hlsl
+struct VisibilityConstants
+{
+	DirectX::XMFLOAT3X4 ObjectToWorld;
+	float PixelOffset[2];
+	float AspectRatio;
+	UINT32 Instance;
+	float EdgesColor[3];
+	UINT32 FlatNormals;
+};
+
+//Timestamp query indices within a frame slot. The compute heap holds both slots back to back, as does the direct heap
+enum ComputeTimestamp
+{
+	ComputeTimestamp_TlasBegin = 0,
+	ComputeTimestamp_TlasEnd = 1,
+	ComputeTimestamp_DispatchBegin = 2,
+	ComputeTimestamp_DispatchEnd = 3,
+	ComputeTimestamp_Count = 4
+};
+
+enum DirectTimestamp
+{
+	DirectTimestamp_CopyBegin = 0,
+	DirectTimestamp_CopyEnd = 1,
+	DirectTimestamp_Count = 2
+};
+
+//Everything that is replaced together when the shaders are reloaded.
+//The shader records hold identifiers of the state object, so the tables belong to it
+struct RaytracingPipeline
+{
+	ShaderPermutationKey Permutation;
+	ID3D12StateObject* State = nullptr;
+
+	ShaderTableData RayGenShaderTable[2]{ {}, {} };
+	ShaderTableData MissShaderTable{};
+	ShaderTableData HitGroupShaderTable{};
+
+	~RaytracingPipeline()
+	{
+		RayGenShaderTable[0].Release();
+		RayGenShaderTable[1].Release();
+		MissShaderTable.Release();
+		HitGroupShaderTable.Release();
+		SafeRelease(&State);
 	}
 };
 
+typedef ShaderTableBuilder<ShaderRecords::RayGen> RayGenShaderTableBuilder;
+typedef ShaderTableBuilder<> MissShaderTableBuilder;
+typedef ShaderTableBuilder<ShaderRecords::MirrorHitGroup, ShaderRecords::FlatMirrorHitGroup, ShaderRecords::EdgesHitGroup> HitGroupShaderTableBuilder;
+
 namespace Base
 {
 	ID3D12Device5* Dx12Device;
 	IDXGISwapChain4* DxgiSwapChain4;
+
+	namespace Memory
+	{
+		//Every buffer is placed in a few large heaps rather than created as its own committed resource
+		GpuAllocator BufferAllocator;
+
+		//Stages geometry into default heap buffers through the copy queue
+		Uploader GeometryUploader;
+	}
+
+	//Headless runs have no window, swap chain or backbuffers. The direct loop only releases the outputs
+	bool Headless = false;
+
+	namespace Animation
+	{
+		UINT64 Frame = 0; //advanced by every TLAS update, reset at the start of each benchmark point
+		DirectX::XMFLOAT3X4 Transform; //of the instances in the last TLAS update, the visibility pass draws with the same one
+	}
 	
 	namespace Queues
 	{
@@ -73,6 +247,21 @@ namespace Base
 		}
 
 		namespace Compute
+		{
+			ID3D12CommandQueue* Dx12Queue;
+			ID3D12CommandAllocator* Dx12CommandAllocator[2];
+			ID3D12GraphicsCommandList4* Dx12CommandList4[2];
+
+			//The dispatch itself never changes between frames, so it is recorded once per frame slot and re-executed.
+			//Only the TLAS update goes through the lists above every frame
+			ID3D12CommandAllocator* Dx12DispatchCommandAllocator[2];
+			ID3D12GraphicsCommandList4* Dx12DispatchCommandList4[2];
+			RecordedListCache DispatchLists;
+		}
+
+		//Second direct queue for the rasterised first hits, so they don't wait behind the presents.
+		//Only created along with the visibility pass, used by the compute loop
+		namespace Visibility
 		{
 			ID3D12CommandQueue* Dx12Queue;
 			ID3D12CommandAllocator* Dx12CommandAllocator[2];
@@ -83,7 +272,6 @@ namespace Base
 	namespace Synchronization
 	{
 		ID3D12Fence1* Dx12Fence[2];
-		bool terminate = false;
 
 		namespace ComputeLoop
 		{
@@ -101,6 +289,13 @@ namespace Base
 			UINT64 FenceValue;
 			HANDLE EventHandle;
 		}
+
+		//The compute queue waits on it before a hybrid dispatch
+		namespace Visibility
+		{
+			ID3D12Fence1* Dx12Fence;
+			UINT64 FenceValue = 0;
+		}
 	}
 	
 	
@@ -127,12 +322,83 @@ namespace Base
 			D3D12_CPU_DESCRIPTOR_HANDLE Dx12OutputUAV_CPUHandle[2];
 			D3D12_CPU_DESCRIPTOR_HANDLE Dx12Accelleration_CPUHandle;
 
-			namespace Shaders
-			{
-				ShaderTableData RayGenShaderTable[2]{ {}, {} };
-				ShaderTableData MissShaderTable{};
-				ShaderTableData HitGroupShaderTable{};
-			}
+			//World space width at which a ray cone stops reflecting, passed to the shaders as a root constant
+			float ConeFootprintLimit = 0.0f;
+
+			//Rays are dispatched for the top left corner of the outputs, smaller than the outputs while benchmarking
+			//or when dynamic resolution has scaled them down. Only changed by the compute loop
+			UINT DispatchWidth = SCREEN_WIDTH;
+			UINT DispatchHeight = SCREEN_HEIGHT;
+
+			//Width << 16 | height of the dispatch list recorded for each output, for the direct loop to upscale from
+			std::atomic<UINT32> OutputDispatchSize[2] = { { SCREEN_WIDTH << 16 | SCREEN_HEIGHT }, { SCREEN_WIDTH << 16 | SCREEN_HEIGHT } };
+		}
+
+		//Compute pass on the direct queue that scales a smaller dispatch up to the full size target,
+		//which is then copied to the backbuffer instead of the output
+		namespace Upscale
+		{
+			ID3D12RootSignature* Dx12RootSignature;
+			ID3D12PipelineState* Dx12PipelineState;
+			ID3D12DescriptorHeap* Dx12DescriptorHeap; //output SRV and target UAV for each output
+			ID3D12Resource1* Dx12TargetResource;
+		}
+
+		//Compute pass at the end of the dispatch list that fills the pixels a checkerboard frame did not trace.
+		//The frame constants are used by the ray tracing shaders as well, so they exist even when checkerboard rendering is off
+		namespace Checkerboard
+		{
+			ID3D12RootSignature* Dx12RootSignature; //nullptr unless CHECKERBOARD_RENDERING is set
+			ID3D12PipelineState* Dx12PipelineState;
+			ID3D12Resource1* Dx12FrameConstants[2]; //persistently mapped, one per frame slot
+			CheckerboardConstants* MappedFrameConstants[2];
+
+			//Compute loop side
+			UINT32 FramesRendered[2] = { 0, 0 };
+			UINT32 HistorySize[2] = { 0, 0 }; //width << 16 | height of the last frame of the slot, 0 before the first
+		}
+
+		//First hit of every pixel rasterised for the hybrid raygen, one buffer per frame slot.
+		//Created when HYBRID_PRIMARY_VISIBILITY is set or for benchmark runs, which can compare both
+		namespace Visibility
+		{
+			ID3D12RootSignature* Dx12RootSignature;
+			ID3D12PipelineState* Dx12PipelineState;
+			ID3D12DescriptorHeap* Dx12RTVDescriptorHeap;
+			ID3D12DescriptorHeap* Dx12DSVDescriptorHeap;
+			ID3D12Resource1* Dx12VisibilityResource[2];
+			ID3D12Resource1* Dx12DepthResource; //the visibility queue draws one frame at a time
+		}
+
+		//Running totals written by the shaders of each frame slot, copied to the readback buffers at the end of the dispatch
+		namespace RayStatistics
+		{
+			ID3D12Resource1* Dx12CounterResource[2];
+			ID3D12Resource1* Dx12ReadbackResource[2];
+
+			//One packed record per pixel, only created when RAY_INSTRUMENTATION is set
+			ID3D12Resource1* Dx12PixelResource[2];
+			ID3D12Resource1* Dx12PixelReadbackResource;
+		}
+
+		//Resolved at the end of the lists of each frame slot into that slot's part of the readback buffers,
+		//and read when the loops come back around to the slot. nullptr when GPU_TIMESTAMPS is off
+		namespace Timestamps
+		{
+			ID3D12QueryHeap* Dx12ComputeQueryHeap;
+			ID3D12QueryHeap* Dx12DirectQueryHeap;
+			ID3D12Resource1* Dx12ComputeReadbackResource;
+			ID3D12Resource1* Dx12DirectReadbackResource;
+			UINT64 ComputeFrequency;
+			UINT64 DirectFrequency;
+		}
+
+		//Persistently mapped, the encoder thread reads a buffer once the fence of the frame that copied into it has passed
+		namespace Capture
+		{
+			ID3D12Resource1* Dx12ReadbackResource[CAPTURE_RING_SIZE];
+			const uint8_t* MappedPixels[CAPTURE_RING_SIZE];
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT Footprint;
 		}
 
 		namespace Geometry
@@ -141,12 +407,112 @@ namespace Base
 			uint32_t numIndecies[MODEL_PARTS];
 			ID3D12Resource1* Dx12VBResources[MODEL_PARTS];
 			ID3D12Resource1* Dx12IBResources[MODEL_PARTS];
+			ID3D12Resource1* Dx12FaceNormalResources[MODEL_PARTS]; //nullptr unless the mesh is flat shaded
 		}
 	}
 
 	namespace States
 	{
-		ID3D12StateObject* DXRPipelineState;
+		RaytracingPipeline* Pipeline = nullptr; //only replaced by the compute loop
+	}
+
+	namespace ShaderPermutations
+	{
+		std::mutex Mutex; //the reload thread and SelectShaderPermutation may compile at the same time
+		ShaderPermutationKey Current;
+		std::map<ShaderPermutationKey, IDxcBlob*> Compiled; //libraries compiled this run, dropped when the source changes
+	}
+
+	//Per frame numbers derived from the readbacks, only touched by the compute loop
+	namespace RayStatistics
+	{
+		RayStatisticsTotals LastTotals[2];
+		UINT32 Readbacks[2] = { 0, 0 };
+
+		UINT64 ReportConeBouncesSaved = 0;
+		UINT64 ReportRayDepthSum = 0;
+		UINT64 ReportThroughputTerminations = 0;
+		UINT32 ReportFrames = 0;
+
+		//The pixel statistics of one frame are copied out by the update list and written once the slot comes back around
+		UINT32 InstrumentedFrames = 0;
+		int PixelCaptureSlot = -1;
+		UINT32 PixelCaptureSize = 0; //width << 16 | height of the captured dispatch
+		bool PixelCaptureDone = false;
+	}
+
+	namespace Timestamps
+	{
+		GpuTimingStatistics Statistics;
+		bool ComputeResolved[2] = { false, false }; //only touched by the compute loop
+		bool DirectResolved[2] = { false, false }; //only touched by the direct loop
+	}
+
+	namespace Capture
+	{
+		CaptureEncoder Encoder;
+		HANDLE EventHandle = nullptr; //only waited on by the encoder thread
+		std::atomic<bool> SlotBusy[CAPTURE_RING_SIZE]; //set by the direct loop, cleared by the encoder thread
+
+		//Direct loop side
+		UINT NextSlot = 0;
+		UINT64 FramesPresented = 0;
+		UINT32 FramesSkipped = 0;
+	}
+
+	namespace DynamicResolution
+	{
+		DynamicResolutionController Controller(DYNAMIC_RESOLUTION_TARGET_MS, DYNAMIC_RESOLUTION_MIN_SCALE, 1.0f, DYNAMIC_RESOLUTION_STEP, DYNAMIC_RESOLUTION_SETTLE_FRAMES); //compute loop
+	}
+
+	namespace FrameMetrics
+	{
+		FrameStatistics Statistics;
+		std::chrono::steady_clock::time_point LastDispatch; //compute loop
+		std::chrono::steady_clock::time_point LastPresent; //direct loop
+		UINT64 FramesDispatched = 0;
+		UINT64 FramesPresented = 0;
+
+		//Set by the compute loop every FRAME_STATISTICS_EXPORT_FRAMES frames, the export thread writes the file
+		std::mutex ExportMutex;
+		std::condition_variable ExportRequested;
+		bool ExportPending = false;
+	}
+
+	namespace Benchmark
+	{
+		bool Active = false; //set before the loops start
+
+		std::mutex Mutex;
+		std::condition_variable PointDone;
+
+		//Requested by RunBenchmark, applied by the compute loop at the start of a dispatch
+		bool PointRequested = false;
+		UINT Width;
+		UINT Height;
+		UINT32 WarmupFrames;
+		UINT32 Frames;
+
+		//Compute loop side of the current point
+		bool Recording = false;
+		UINT32 FramesDispatched = 0;
+		std::chrono::steady_clock::time_point LastDispatch;
+		std::vector<double> FrameTimes;
+	}
+
+	namespace ShaderReload
+	{
+		//Built by the reload thread, picked up by the compute loop at the start of the next dispatch
+		std::atomic<RaytracingPipeline*> Pending{ nullptr };
+
+		//Notified when the compute loop takes Pending, for RunBenchmark
+		std::mutex SwapMutex;
+		std::condition_variable Swapped;
+
+		//Pipeline replaced by the compute loop, released once RetireFence shows the GPU is done with it
+		RaytracingPipeline* Retired = nullptr;
+		ID3D12Fence1* RetireFence;
+		UINT64 RetireFenceValue = 0;
 	}
 }
 
@@ -188,43 +554,218 @@ int CreateDirect3DDevice();
 int CreateCommandInterfaces();
 int CreateSwapChain(HWND wndHandle);
 int CreateFenceAndEventHandle();
+int CreateTimestampQueries();
+int CreateCaptureResources();
 int CreateRenderTargets();
-int CreateAccelerationStructures();
-int CreateRaytracingPipelineState();
+int LoadScene(SceneObject* pScene, const char* modelFilePath);
+int CreateMeshGeometry(MeshGeometry* mesh, UINT meshIndex, BlasBuilder* blasBuilder);
+int CreateAccelerationStructures(BlasBuilder* blasBuilder);
+int CompileRaytracingShaders(const ShaderPermutationKey& permutation, IDxcBlob** ppShaders);
+int CreateRaytracingPipelineState(IDxcBlob* pShaders, RaytracingPipeline* pipeline);
 int CreateShaderResources();
-int CreateShaderTables();
-
-int DX12Setup(HWND wndHandle)
+int CreateShaderTables(RaytracingPipeline* pipeline);
+int CompileShader(const char* filePath, LPCWSTR entryPoint, LPCWSTR targetProfile, IDxcBlob** ppShader);
+int CreateUpscalePass(IDxcBlob* pShader);
+int CreateCheckerboardPass(IDxcBlob* pShader);
+int CreateVisibilityPass(IDxcBlob* pVertexShader, IDxcBlob* pPixelShader);
+
+// The setup stages run as a task graph. Scene import and shader compilation only need the CPU,
+// so they run on workers while the device, queues and swap chain are created.
+// Each mesh is uploaded and added to the BLAS builds as soon as the scene and the queues are there
+int DX12Setup(HWND wndHandle, const char* modelFilePath, bool benchmark)
 {
-	if (CreateDirect3DDevice() != 0) return 1;
+	Base::Headless = (wndHandle == nullptr);
+	Base::Benchmark::Active = benchmark;
+	PROFILE_SCOPE("DX12Setup");
+
+	SceneObject scene;
+	IDxcBlob* pShaders = nullptr;
+	IDxcBlob* pUpscaleShader = nullptr;
+	IDxcBlob* pCheckerboardShader = nullptr;
+	IDxcBlob* pVisibilityShaders[2] = { nullptr, nullptr };
+	BlasBuilder blasBuilder;
+
+	TaskGraph startup;
+
+	TaskGraph::TaskId importScene = startup.addTask("Import scene", [&]() { return LoadScene(&scene, modelFilePath); });
 
-	if (CreateCommandInterfaces() != 0) return 1;
+	//The permutation depends on whether the mirror is flat shaded, so compilation starts once the scene is in.
+	//With a warm shader cache this is only a file read
+	TaskGraph::TaskId compileShaders = startup.addTask("Compile shaders", [&]()
+	{
+		ShaderPermutationKey permutation;
+		permutation.MaxRayDepth = MAX_RAY_DEPTH;
+		permutation.FlatNormals = scene.meshGeometries[MIRROR_PART].numFaceNormals > 0;
+		permutation.ReflectionBias = REFLECTON_BIAS;
+		permutation.Termination = (TerminationPolicy)RAY_TERMINATION_POLICY;
+		permutation.Instrumentation = RAY_INSTRUMENTATION;
+		permutation.HybridPrimary = HYBRID_PRIMARY_VISIBILITY;
+
+		Base::ShaderPermutations::Current = permutation;
+		return CompileRaytracingShaders(permutation, &pShaders);
+	}, { importScene });
+
+	TaskGraph::TaskId device = startup.addTask("Device", [&]()
+	{
+		if (CreateDirect3DDevice() != 0) return 1;
+
+		//The BLASes are built together out of one scratch pool, which is freed as soon as the builds are done
+		blasBuilder.init(Base::Dx12Device, &Base::Memory::BufferAllocator, BLAS_SCRATCH_BUDGET, BLAS_COMPACTION);
+		return 0;
+	});
+	TaskGraph::TaskId commandInterfaces = startup.addTask("Command interfaces", []() { return CreateCommandInterfaces(); }, { device });
+	TaskGraph::TaskId fences = startup.addTask("Fences", []() { return CreateFenceAndEventHandle(); }, { device });
+	startup.addTask("Timestamp queries", []() { return CreateTimestampQueries(); }, { commandInterfaces });
+	startup.addTask("Capture buffers", []() { return CreateCaptureResources(); }, { device });
+
+	if (!Base::Headless)
+	{
+		//The swap chain sends messages to the window, so it is created on the thread that owns it
+		TaskGraph::TaskId swapChain = startup.addTask("Swap chain", [&]() { return CreateSwapChain(wndHandle); }, { commandInterfaces }, TaskGraph::TaskAffinity_MainThread);
+		startup.addTask("Render targets", []() { return CreateRenderTargets(); }, { swapChain });
+	}
+
+	std::vector<TaskGraph::TaskId> accelerationStructureDependencies = { fences };
+	for (UINT i = 0; i < MODEL_PARTS; i++)
+	{
+		accelerationStructureDependencies.push_back(startup.addTask("Mesh " + std::to_string(i) + " geometry", [&, i]()
+		{
+			return CreateMeshGeometry(&scene.meshGeometries[i], i, &blasBuilder);
+		}, { importScene, commandInterfaces }));
+	}
+	TaskGraph::TaskId accelerationStructures = startup.addTask("Acceleration structures", [&]() { return CreateAccelerationStructures(&blasBuilder); }, accelerationStructureDependencies);
+
+	TaskGraph::TaskId pipelineState = startup.addTask("Pipeline state", [&]()
+	{
+		Base::States::Pipeline = new RaytracingPipeline();
+		Base::States::Pipeline->Permutation = Base::ShaderPermutations::Current;
+		return CreateRaytracingPipelineState(pShaders, Base::States::Pipeline);
+	}, { compileShaders, device });
+	TaskGraph::TaskId shaderResources = startup.addTask("Shader resources", []() { return CreateShaderResources(); }, { accelerationStructures });
+	startup.addTask("Shader tables", []() { return CreateShaderTables(Base::States::Pipeline); }, { pipelineState, shaderResources });
+
+	TaskGraph::TaskId compileUpscale = startup.addTask("Compile upscale shader", [&]() { return CompileShader(UPSCALE_SHADER_FILEPATH, L"upscale", L"cs_6_0", &pUpscaleShader); });
+	startup.addTask("Upscale pass", [&]() { return CreateUpscalePass(pUpscaleShader); }, { compileUpscale, shaderResources });
+
+	if (CHECKERBOARD_RENDERING)
+	{
+		TaskGraph::TaskId compileCheckerboard = startup.addTask("Compile checkerboard shader", [&]() { return CompileShader(CHECKERBOARD_SHADER_FILEPATH, L"reconstruct", L"cs_6_0", &pCheckerboardShader); });
+		startup.addTask("Checkerboard pass", [&]() { return CreateCheckerboardPass(pCheckerboardShader); }, { compileCheckerboard, device });
+	}
 
-	if (CreateSwapChain(wndHandle) != 0) return 1;
+	if (HYBRID_PRIMARY_VISIBILITY || benchmark)
+	{
+		TaskGraph::TaskId compileVisibility = startup.addTask("Compile visibility shaders", [&]()
+		{
+			if (CompileShader(VISIBILITY_SHADER_FILEPATH, L"visibilityVS", L"vs_6_0", &pVisibilityShaders[0]) != 0) return 1;
+			return CompileShader(VISIBILITY_SHADER_FILEPATH, L"visibilityPS", L"ps_6_0", &pVisibilityShaders[1]);
+		});
+		startup.addTask("Visibility pass", [&]() { return CreateVisibilityPass(pVisibilityShaders[0], pVisibilityShaders[1]); }, { compileVisibility, shaderResources });
+	}
 
-	if (CreateFenceAndEventHandle() != 0) return 1;
+	int result = startup.run(STARTUP_WORKER_THREADS);
 
-	if (CreateRenderTargets()) return 1;
+	//The imported meshes are freed with the scene once setup returns
+	for (const MeshGeometry& mesh : scene.meshGeometries)
+	{
+		MemoryRegistry::untrack(mesh.vertecies.get());
+		MemoryRegistry::untrack(mesh.indecies.get());
+		MemoryRegistry::untrack(mesh.faceNormals.get());
+	}
 
-	if (CreateAccelerationStructures() != 0) return 1;
+	SafeRelease(&pShaders);
+	SafeRelease(&pUpscaleShader);
+	SafeRelease(&pCheckerboardShader);
+	SafeRelease(&pVisibilityShaders[0]);
+	SafeRelease(&pVisibilityShaders[1]);
 
-	if (CreateRaytracingPipelineState() != 0) return 1;
+	std::cout << "Startup timings:\n";
+	startup.printTimings();
 
-	if (CreateShaderResources() != 0) return 1;
+	if (result != 0)
+	{
+		std::cerr << "Error: Setup failed, see the failed and skipped tasks above\n";
+		return 1;
+	}
 
-	if (CreateShaderTables() != 0) return 1;
+	Base::Memory::BufferAllocator.printStats();
 	
 	return 0;
 }
 
 void DX12Free()
 {
+	if (CAPTURE_FRAME_INTERVAL != 0)
+	{
+		//Writes what is still queued, the loops have stopped and the GPU is idle
+		Base::Capture::Encoder.stop();
+		std::cout << Base::Capture::Encoder.written() << " frames captured, " << Base::Capture::FramesSkipped << " skipped while the encoder was behind\n";
+		for (UINT i = 0; i < CAPTURE_RING_SIZE; i++)
+		{
+			if (Base::Resources::Capture::MappedPixels[i] != nullptr)
+			{
+				D3D12_RANGE writeRange = { 0, 0 };
+				Base::Resources::Capture::Dx12ReadbackResource[i]->Unmap(0, &writeRange);
+				Base::Resources::Capture::MappedPixels[i] = nullptr;
+			}
+			releaseBuffer(&Base::Resources::Capture::Dx12ReadbackResource[i]);
+		}
+		if (Base::Capture::EventHandle != nullptr)
+		{
+			CloseHandle(Base::Capture::EventHandle);
+		}
+	}
+
+	MemoryRegistry::report(std::cout);
+	if (Base::FrameMetrics::FramesDispatched > 0 && Base::FrameMetrics::Statistics.writeMetrics(FRAME_STATISTICS_OUTPUT) == 0)
+	{
+		std::cout << "Frame statistics written to " << FRAME_STATISTICS_OUTPUT << "\n";
+	}
+
+	MemoryRegistry::untrack(Base::Resources::DXR::Dx12OutputResource[0]);
+	MemoryRegistry::untrack(Base::Resources::DXR::Dx12OutputResource[1]);
 	SafeRelease(&Base::Resources::DXR::Dx12OutputResource[0]);
 	SafeRelease(&Base::Resources::DXR::Dx12RTDescriptorHeap[0]);
 	SafeRelease(&Base::Resources::DXR::Dx12OutputResource[1]);
 	SafeRelease(&Base::Resources::DXR::Dx12RTDescriptorHeap[1]);
-	SafeRelease(&Base::States::DXRPipelineState);
+	for (int i = 0; i < 2; i++)
+	{
+		releaseBuffer(&Base::Resources::RayStatistics::Dx12CounterResource[i]);
+		releaseBuffer(&Base::Resources::RayStatistics::Dx12ReadbackResource[i]);
+		releaseBuffer(&Base::Resources::RayStatistics::Dx12PixelResource[i]);
+	}
+	releaseBuffer(&Base::Resources::RayStatistics::Dx12PixelReadbackResource);
+	SafeDelete(Base::States::Pipeline);
+	SafeDelete(Base::ShaderReload::Retired);
+	delete Base::ShaderReload::Pending.exchange(nullptr);
 	SafeRelease(&Base::Resources::DXR::Dx12GlobalRS);
+	MemoryRegistry::untrack(Base::Resources::Upscale::Dx12TargetResource);
+	SafeRelease(&Base::Resources::Upscale::Dx12TargetResource);
+	SafeRelease(&Base::Resources::Upscale::Dx12DescriptorHeap);
+	SafeRelease(&Base::Resources::Upscale::Dx12PipelineState);
+	SafeRelease(&Base::Resources::Upscale::Dx12RootSignature);
+	for (int i = 0; i < 2; i++)
+	{
+		releaseBuffer(&Base::Resources::Checkerboard::Dx12FrameConstants[i]);
+	}
+	SafeRelease(&Base::Resources::Checkerboard::Dx12PipelineState);
+	SafeRelease(&Base::Resources::Checkerboard::Dx12RootSignature);
+	for (int i = 0; i < 2; i++)
+	{
+		MemoryRegistry::untrack(Base::Resources::Visibility::Dx12VisibilityResource[i]);
+		SafeRelease(&Base::Resources::Visibility::Dx12VisibilityResource[i]);
+	}
+	MemoryRegistry::untrack(Base::Resources::Visibility::Dx12DepthResource);
+	SafeRelease(&Base::Resources::Visibility::Dx12DepthResource);
+	SafeRelease(&Base::Resources::Visibility::Dx12RTVDescriptorHeap);
+	SafeRelease(&Base::Resources::Visibility::Dx12DSVDescriptorHeap);
+	SafeRelease(&Base::Resources::Visibility::Dx12PipelineState);
+	SafeRelease(&Base::Resources::Visibility::Dx12RootSignature);
+	for (std::pair<const ShaderPermutationKey, IDxcBlob*>& compiled : Base::ShaderPermutations::Compiled)
+	{
+		SafeRelease(&compiled.second);
+	}
+	Base::ShaderPermutations::Compiled.clear();
 
 
 	SafeRelease(&Base::Resources::Backbuffers::Dx12RTVDescriptorHeap);
@@ -235,9 +776,18 @@ void DX12Free()
 
 	for (int i = 0; i < MODEL_PARTS; i++)
 	{
-		SafeRelease(Base::Resources::Geometry::Dx12VBResources[i]);
-		SafeRelease(Base::Resources::Geometry::Dx12IBResources[i]);
+		releaseBuffer(&Base::Resources::Geometry::Dx12VBResources[i]);
+		releaseBuffer(&Base::Resources::Geometry::Dx12IBResources[i]);
+		releaseBuffer(&Base::Resources::Geometry::Dx12FaceNormalResources[i]);
+		Base::Resources::DXR::BottomBuffers[i].Release();
 	}
+	Base::Resources::DXR::TopBuffers.Release();
+	releaseBuffer(&Base::Resources::Timestamps::Dx12ComputeReadbackResource);
+	releaseBuffer(&Base::Resources::Timestamps::Dx12DirectReadbackResource);
+
+
+	Base::Memory::GeometryUploader.release();
+	Base::Memory::BufferAllocator.release();
 	
 	CloseHandle(Base::Synchronization::ComputeLoop::EventHandle);
 	CloseHandle(Base::Synchronization::DirectLoop::EventHandle);
@@ -245,17 +795,31 @@ void DX12Free()
 	SafeRelease(&Base::Synchronization::Dx12Fence[1]);
 	CloseHandle(Base::Synchronization::WaitFunction::EventHandle);
 	SafeRelease(&Base::Synchronization::WaitFunction::Dx12Fence);
+	SafeRelease(&Base::ShaderReload::RetireFence);
+	SafeRelease(&Base::Synchronization::Visibility::Dx12Fence);
+	SafeRelease(&Base::Resources::Timestamps::Dx12ComputeQueryHeap);
+	SafeRelease(&Base::Resources::Timestamps::Dx12DirectQueryHeap);
 
 	SafeRelease(&Base::DxgiSwapChain4);
 
 	SafeRelease(&Base::Queues::Compute::Dx12CommandList4[0]);
 	SafeRelease(&Base::Queues::Compute::Dx12CommandAllocator[0]);
+	SafeRelease(&Base::Queues::Compute::Dx12DispatchCommandList4[0]);
+	SafeRelease(&Base::Queues::Compute::Dx12DispatchCommandAllocator[0]);
 	SafeRelease(&Base::Queues::Direct::Dx12CommandList4[0]);
 	SafeRelease(&Base::Queues::Direct::Dx12CommandAllocator[0]);
 	SafeRelease(&Base::Queues::Compute::Dx12CommandList4[1]);
 	SafeRelease(&Base::Queues::Compute::Dx12CommandAllocator[1]);
+	SafeRelease(&Base::Queues::Compute::Dx12DispatchCommandList4[1]);
+	SafeRelease(&Base::Queues::Compute::Dx12DispatchCommandAllocator[1]);
 	SafeRelease(&Base::Queues::Direct::Dx12CommandList4[1]);
 	SafeRelease(&Base::Queues::Direct::Dx12CommandAllocator[1]);
+	for (int i = 0; i < 2; i++)
+	{
+		SafeRelease(&Base::Queues::Visibility::Dx12CommandList4[i]);
+		SafeRelease(&Base::Queues::Visibility::Dx12CommandAllocator[i]);
+	}
+	SafeRelease(&Base::Queues::Visibility::Dx12Queue);
 	SafeRelease(&Base::Queues::Compute::Dx12Queue);
 	SafeRelease(&Base::Queues::Direct::Dx12Queue);
 
@@ -331,6 +895,7 @@ int CreateDirect3DDevice()
 			std::cout << "Successfully created DXR compatible device\n";
 			SafeRelease(&adapter_supporting_dxr);
 			NameInterface(Base::Dx12Device);
+			Base::Memory::BufferAllocator.init(Base::Dx12Device, GPU_HEAP_SIZE);
 			return 0;
 		}
 		std::cerr << "Error: No DXR compatible device matching minimum feature level\n";
@@ -368,6 +933,11 @@ int CreateCommandInterfaces()
 		if (FAILED(Base::Dx12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&Base::Queues::Compute::Dx12CommandAllocator[1])))) break;
 		NameInterface(Base::Queues::Compute::Dx12CommandAllocator[1]);
 
+		if (FAILED(Base::Dx12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&Base::Queues::Compute::Dx12DispatchCommandAllocator[0])))) break;
+		NameInterface(Base::Queues::Compute::Dx12DispatchCommandAllocator[0]);
+		if (FAILED(Base::Dx12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&Base::Queues::Compute::Dx12DispatchCommandAllocator[1])))) break;
+		NameInterface(Base::Queues::Compute::Dx12DispatchCommandAllocator[1]);
+
 		//Create command list.
 		if (FAILED(Base::Dx12Device->CreateCommandList(
 			0,
@@ -399,12 +969,31 @@ int CreateCommandInterfaces()
 			IID_PPV_ARGS(&Base::Queues::Compute::Dx12CommandList4[1])))) break;
 		NameInterface(Base::Queues::Compute::Dx12CommandList4[1]);
 
+		if (FAILED(Base::Dx12Device->CreateCommandList(
+			0,
+			D3D12_COMMAND_LIST_TYPE_COMPUTE,
+			Base::Queues::Compute::Dx12DispatchCommandAllocator[0],
+			nullptr,
+			IID_PPV_ARGS(&Base::Queues::Compute::Dx12DispatchCommandList4[0])))) break;
+		NameInterface(Base::Queues::Compute::Dx12DispatchCommandList4[0]);
+		if (FAILED(Base::Dx12Device->CreateCommandList(
+			0,
+			D3D12_COMMAND_LIST_TYPE_COMPUTE,
+			Base::Queues::Compute::Dx12DispatchCommandAllocator[1],
+			nullptr,
+			IID_PPV_ARGS(&Base::Queues::Compute::Dx12DispatchCommandList4[1])))) break;
+		NameInterface(Base::Queues::Compute::Dx12DispatchCommandList4[1]);
+
 		//Command lists are created in the recording state. Since there is nothing to
 		//record right now and the main loop expects it to be closed, we close it.
 		Base::Queues::Direct::Dx12CommandList4[0]->Close();
 		Base::Queues::Direct::Dx12CommandList4[1]->Close();
 		Base::Queues::Compute::Dx12CommandList4[0]->Close();
 		Base::Queues::Compute::Dx12CommandList4[1]->Close();
+		Base::Queues::Compute::Dx12DispatchCommandList4[0]->Close();
+		Base::Queues::Compute::Dx12DispatchCommandList4[1]->Close();
+
+		if (Base::Memory::GeometryUploader.init(Base::Dx12Device, &Base::Memory::BufferAllocator, UPLOAD_RING_SIZE) != 0) break;
 
 		std::cout << "Command Queues setup successful\n";
 		return 0;
@@ -496,6 +1085,13 @@ int CreateFenceAndEventHandle()
 	Base::Synchronization::WaitFunction::FenceValue = 0;
 	Base::Synchronization::WaitFunction::EventHandle = CreateEvent(0, false, false, 0);
 
+	if (FAILED(Base::Dx12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&Base::ShaderReload::RetireFence))))
+	{
+		std::cerr << "Error: Shader reload fence creation failed\n";
+		return 1;
+	}
+	NameInterface(Base::ShaderReload::RetireFence);
+
 	std::cout << "Fence setup successful\n";
 	return 0;
 }
@@ -553,45 +1149,138 @@ static const D3D12_HEAP_PROPERTIES defaultHeapProps =
 	0
 };
 
-ID3D12Resource1* createBuffer(uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initState, const D3D12_HEAP_PROPERTIES& heapProps)
-{
-	D3D12_RESOURCE_DESC bufDesc = {};
-	bufDesc.Alignment = 0;
-	bufDesc.DepthOrArraySize = 1;
-	bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	bufDesc.Flags = flags;
-	bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-	bufDesc.Height = 1;
-	bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-	bufDesc.MipLevels = 1;
-	bufDesc.SampleDesc.Count = 1;
-	bufDesc.SampleDesc.Quality = 0;
-	bufDesc.Width = size;
-
-	ID3D12Resource1* pBuffer = nullptr;
-	Base::Dx12Device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, initState, nullptr, IID_PPV_ARGS(&pBuffer));
-	return pBuffer;
+static const D3D12_HEAP_PROPERTIES readbackHeapProps =
+{
+	D3D12_HEAP_TYPE_READBACK,
+	D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+	D3D12_MEMORY_POOL_UNKNOWN,
+	0,
+	0
+};
+
+ID3D12Resource1* createBuffer(uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initState, const D3D12_HEAP_PROPERTIES& heapProps, MemoryCategory category)
+{
+	return Base::Memory::BufferAllocator.createBuffer(size, flags, initState, heapProps.Type, category);
+}
+
+void releaseBuffer(ID3D12Resource1** ppBuffer)
+{
+	Base::Memory::BufferAllocator.releaseBuffer(ppBuffer);
+}
+
+// The queue frequencies can differ, so each heap is converted with the frequency of the queue it is used on
+int CreateTimestampQueries()
+{
+	if (!GPU_TIMESTAMPS)
+	{
+		return 0;
+	}
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+
+	queryHeapDesc.Count = 2 * ComputeTimestamp_Count;
+	if (FAILED(Base::Dx12Device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&Base::Resources::Timestamps::Dx12ComputeQueryHeap))))
+	{
+		std::cerr << "Error: Failed creating the compute timestamp query heap\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Timestamps::Dx12ComputeQueryHeap);
+
+	queryHeapDesc.Count = 2 * DirectTimestamp_Count;
+	if (FAILED(Base::Dx12Device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&Base::Resources::Timestamps::Dx12DirectQueryHeap))))
+	{
+		std::cerr << "Error: Failed creating the direct timestamp query heap\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Timestamps::Dx12DirectQueryHeap);
+
+	Base::Resources::Timestamps::Dx12ComputeReadbackResource = createBuffer(sizeof(UINT64) * 2 * ComputeTimestamp_Count, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, readbackHeapProps, MemoryCategory_Readback);
+	Base::Resources::Timestamps::Dx12DirectReadbackResource = createBuffer(sizeof(UINT64) * 2 * DirectTimestamp_Count, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, readbackHeapProps, MemoryCategory_Readback);
+	if (Base::Resources::Timestamps::Dx12ComputeReadbackResource == nullptr || Base::Resources::Timestamps::Dx12DirectReadbackResource == nullptr)
+	{
+		std::cerr << "Error: Failed creating the timestamp readback buffers\n";
+		return 1;
+	}
+
+	if (FAILED(Base::Queues::Compute::Dx12Queue->GetTimestampFrequency(&Base::Resources::Timestamps::ComputeFrequency)) ||
+		FAILED(Base::Queues::Direct::Dx12Queue->GetTimestampFrequency(&Base::Resources::Timestamps::DirectFrequency)))
+	{
+		std::cerr << "Error: Failed getting the queue timestamp frequencies\n";
+		return 1;
+	}
+
+	std::cout << "Timestamp query setup successful\n";
+	return 0;
+}
+
+// Sized for the output texture with the row pitch alignment copies to buffers need
+int CreateCaptureResources()
+{
+	if (CAPTURE_FRAME_INTERVAL == 0)
+	{
+		return 0;
+	}
+
+	D3D12_RESOURCE_DESC outputDesc = {};
+	outputDesc.DepthOrArraySize = 1;
+	outputDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	outputDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	outputDesc.Width = SCREEN_WIDTH;
+	outputDesc.Height = SCREEN_HEIGHT;
+	outputDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	outputDesc.MipLevels = 1;
+	outputDesc.SampleDesc.Count = 1;
+
+	UINT64 captureSize = 0;
+	Base::Dx12Device->GetCopyableFootprints(&outputDesc, 0, 1, 0, &Base::Resources::Capture::Footprint, nullptr, nullptr, &captureSize);
+
+	for (UINT i = 0; i < CAPTURE_RING_SIZE; i++)
+	{
+		Base::Resources::Capture::Dx12ReadbackResource[i] = createBuffer(captureSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, readbackHeapProps, MemoryCategory_Readback);
+		if (Base::Resources::Capture::Dx12ReadbackResource[i] == nullptr)
+		{
+			std::cerr << "Error: Failed creating the capture readback buffers\n";
+			return 1;
+		}
+
+		uint8_t* pMapped = nullptr;
+		D3D12_RANGE readRange = { 0, (SIZE_T)captureSize };
+		if (FAILED(Base::Resources::Capture::Dx12ReadbackResource[i]->Map(0, &readRange, (void**)&pMapped)))
+		{
+			std::cerr << "Error: Failed mapping the capture readback buffers\n";
+			return 1;
+		}
+		Base::Resources::Capture::MappedPixels[i] = pMapped + Base::Resources::Capture::Footprint.Offset;
+	}
+
+	Base::Capture::EventHandle = CreateEvent(0, false, false, 0);
+	Base::Capture::Encoder.start();
+
+	std::cout << "Capture setup successful\n";
+	return 0;
 }
 
+// The geometry lives on the default heap. The copy is only queued here and goes out with the next flush of the uploader.
+// Buffers are created in the common state, which is implicitly promoted to copy destination on the copy queue and to shader resource for the AS builds
 ID3D12Resource1* createTriangleVB(MeshGeometry* mesh)
 {
-	// For simplicity, we create the vertex buffer on the upload heap, but that's not required
-	ID3D12Resource1* pBuffer = createBuffer(sizeof(Vertex) * mesh->numVertecies, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProperties);
-	uint8_t* pData;
-	pBuffer->Map(0, nullptr, (void**)&pData);
-	memcpy(pData, mesh->vertecies.get(), sizeof(Vertex) * mesh->numVertecies);
-	pBuffer->Unmap(0, nullptr);
+	ID3D12Resource1* pBuffer = createBuffer(sizeof(Vertex) * mesh->numVertecies, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, defaultHeapProps, MemoryCategory_Geometry);
+	Base::Memory::GeometryUploader.uploadBuffer(pBuffer, 0, mesh->vertecies.get(), sizeof(Vertex) * mesh->numVertecies);
 	return pBuffer;
 }
 
 ID3D12Resource1* createTriangleIB(MeshGeometry* mesh)
 {
-	// For simplicity, we create the index buffer on the upload heap, but that's not required
-	ID3D12Resource1* pBuffer = createBuffer(sizeof(uint32_t) * mesh->numIndecies, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProperties);
-	uint8_t* pData;
-	pBuffer->Map(0, nullptr, (void**)&pData);
-	memcpy(pData, mesh->indecies.get(), sizeof(uint32_t) * mesh->numIndecies);
-	pBuffer->Unmap(0, nullptr);
+	ID3D12Resource1* pBuffer = createBuffer(sizeof(uint32_t) * mesh->numIndecies, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, defaultHeapProps, MemoryCategory_Geometry);
+	Base::Memory::GeometryUploader.uploadBuffer(pBuffer, 0, mesh->indecies.get(), sizeof(uint32_t) * mesh->numIndecies);
+	return pBuffer;
+}
+
+ID3D12Resource1* createFaceNormalBuffer(MeshGeometry* mesh)
+{
+	ID3D12Resource1* pBuffer = createBuffer(sizeof(uint32_t) * mesh->numFaceNormals, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, defaultHeapProps, MemoryCategory_Geometry);
+	Base::Memory::GeometryUploader.uploadBuffer(pBuffer, 0, mesh->faceNormals.get(), sizeof(uint32_t) * mesh->numFaceNormals);
 	return pBuffer;
 }
 
@@ -611,42 +1300,9 @@ void SetupGeometryDesc(D3D12_RAYTRACING_GEOMETRY_DESC* geomDesc, ID3D12Resource1
 	geomDesc->Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
 }
 
-void createBottomLevelAS(ID3D12GraphicsCommandList4* pCmdList, D3D12_RAYTRACING_GEOMETRY_DESC* geomDesc, uint32_t numDescs, AccelerationStructureBuffers* ASBuffers)
+void createTopLevelAS(ID3D12GraphicsCommandList4* pCmdList)
 {
-	// Get the size requirements for the scratch and AS buffers
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
-	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-	inputs.NumDescs = numDescs;
-	inputs.pGeometryDescs = geomDesc;
-	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
-	Base::Dx12Device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
-
-	// Create the buffers. They need to support UAV, and since we are going to immediately use them, we create them with an unordered-access state
-
-	ASBuffers->pScratch = createBuffer(info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, defaultHeapProps);
-	ASBuffers->pResult = createBuffer(info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, defaultHeapProps);
-
-	// Create the bottom-level AS
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
-	asDesc.Inputs = inputs;
-	asDesc.DestAccelerationStructureData = ASBuffers->pResult->GetGPUVirtualAddress();
-	asDesc.ScratchAccelerationStructureData = ASBuffers->pScratch->GetGPUVirtualAddress();
-
-	pCmdList->BuildRaytracingAccelerationStructure(&asDesc, 0, nullptr);
-
-	// We need to insert a UAV barrier before using the acceleration structures in a raytracing operation
-	D3D12_RESOURCE_BARRIER uavBarrier = {};
-	uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-	uavBarrier.UAV.pResource = ASBuffers->pResult;
-	pCmdList->ResourceBarrier(1, &uavBarrier);
-}
-
-void createTopLevelAS(ID3D12GraphicsCommandList4* pCmdList)
-{
-	// First, get the size of the TLAS buffers and create them
+	// First, get the size of the TLAS buffers and create them
 	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
 	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
@@ -662,12 +1318,12 @@ void createTopLevelAS(ID3D12GraphicsCommandList4* pCmdList)
 		// Create the buffers
 		if (Base::Resources::DXR::TopBuffers.pScratch == nullptr)
 		{
-			Base::Resources::DXR::TopBuffers.pScratch = createBuffer(info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, defaultHeapProps);
+			Base::Resources::DXR::TopBuffers.pScratch = createBuffer(info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, defaultHeapProps, MemoryCategory_Scratch);
 		}
 
 		if (Base::Resources::DXR::TopBuffers.pResult == nullptr)
 		{
-			Base::Resources::DXR::TopBuffers.pResult = createBuffer(info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, defaultHeapProps);
+			Base::Resources::DXR::TopBuffers.pResult = createBuffer(info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, defaultHeapProps, MemoryCategory_Tlas);
 		}
 		Base::Resources::DXR::ConservativeTopSize = info.ResultDataMaxSizeInBytes;
 
@@ -675,14 +1331,14 @@ void createTopLevelAS(ID3D12GraphicsCommandList4* pCmdList)
 			sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * MODEL_PARTS,
 			D3D12_RESOURCE_FLAG_NONE,
 			D3D12_RESOURCE_STATE_GENERIC_READ,
-			uploadHeapProperties);
+			uploadHeapProperties,
+			MemoryCategory_Tlas);
 	}
 
 	D3D12_RAYTRACING_INSTANCE_DESC* pInstanceDesc;
 	Base::Resources::DXR::TopBuffers.pInstanceDesc->Map(0, nullptr, (void**)&pInstanceDesc);
 
-	static float rotY = 0;
-	rotY += 0.001f;
+	float rotY = ANIMATION_ROTATION_PER_FRAME * (float)Base::Animation::Frame++;
 	for (int i = 0; i < MODEL_PARTS; i++)
 	{
 		pInstanceDesc->InstanceID = i;                            // exposed to the shader via InstanceID()
@@ -692,8 +1348,9 @@ void createTopLevelAS(ID3D12GraphicsCommandList4* pCmdList)
 		
 		//apply transform
 		DirectX::XMFLOAT3X4 m;
-		DirectX::XMStoreFloat3x4(&m, DirectX::XMMatrixScaling(0.5f, 0.5f, 0.5f) * DirectX::XMMatrixRotationY(0.25f + rotY) * DirectX::XMMatrixTranslation(0, 0, 0));
+		DirectX::XMStoreFloat3x4(&m, DirectX::XMMatrixScaling(InstanceScale, InstanceScale, InstanceScale) * DirectX::XMMatrixRotationY(0.25f + rotY) * DirectX::XMMatrixTranslation(0, 0, 0));
 		memcpy(pInstanceDesc->Transform, &m, sizeof(pInstanceDesc->Transform));
+		Base::Animation::Transform = m;
 
 		pInstanceDesc->AccelerationStructure = Base::Resources::DXR::BottomBuffers[i].pResult->GetGPUVirtualAddress();
 		pInstanceDesc->InstanceMask = 0xFF;
@@ -719,50 +1376,92 @@ void createTopLevelAS(ID3D12GraphicsCommandList4* pCmdList)
 	pCmdList->ResourceBarrier(1, &uavBarrier);
 }
 
-int CreateAccelerationStructures()
+int LoadScene(SceneObject* pScene, const char* modelFilePath)
 {
-	Base::Queues::Compute::Dx12CommandAllocator[0]->Reset();
-	Base::Queues::Compute::Dx12CommandList4[0]->Reset(Base::Queues::Compute::Dx12CommandAllocator[0], nullptr);
+	*pScene = LoadSceneObjectFile(modelFilePath);
+	if (pScene->sceneObjectData == Scene_Object_Data_Null)
+	{
+		std::cerr << "Error: Failed loading model " << modelFilePath << "\n";
+		return 1;
+	}
 
-	SceneObject infiniMirror = LoadSceneObjectFile(MODEL_FILEPATH);
-	if (infiniMirror.sceneObjectData == Scene_Object_Data_Null)
+	if (pScene->meshGeometries.size() < MODEL_PARTS)
 	{
-		std::cerr << "Error: Failed loading model test\n";
+		std::cerr << "Error: Model " << modelFilePath << " has " << pScene->meshGeometries.size() << " meshes, expected " << MODEL_PARTS << "\n";
 		return 1;
 	}
 
-	Base::Resources::Geometry::Dx12VBResources[0] = createTriangleVB(&infiniMirror.meshGeometries[0]);
-	Base::Resources::Geometry::Dx12IBResources[0] = createTriangleIB(&infiniMirror.meshGeometries[0]);
-	Base::Resources::Geometry::Dx12VBResources[1] = createTriangleVB(&infiniMirror.meshGeometries[1]);
-	Base::Resources::Geometry::Dx12IBResources[1] = createTriangleIB(&infiniMirror.meshGeometries[1]);
+	for (const MeshGeometry& mesh : pScene->meshGeometries)
+	{
+		MemoryRegistry::track(mesh.vertecies.get(), MemoryCategory_MeshData, sizeof(Vertex) * mesh.numVertecies);
+		MemoryRegistry::track(mesh.indecies.get(), MemoryCategory_MeshData, sizeof(uint32_t) * mesh.numIndecies);
+		MemoryRegistry::track(mesh.faceNormals.get(), MemoryCategory_MeshData, sizeof(uint32_t) * mesh.numFaceNormals);
+	}
+
+	//Once the cone is wider than the edges the deeper reflections can't show anything new
+	Base::Resources::DXR::ConeFootprintLimit = CONE_FOOTPRINT_LIMIT * InstanceScale * SmallestExtent(pScene->meshGeometries[EDGES_PART]);
+
+	std::cout << "Scene import successful\n";
+	return 0;
+}
+
+int CreateMeshGeometry(MeshGeometry* mesh, UINT meshIndex, BlasBuilder* blasBuilder)
+{
+	Base::Resources::Geometry::Dx12VBResources[meshIndex] = createTriangleVB(mesh);
+	Base::Resources::Geometry::Dx12IBResources[meshIndex] = createTriangleIB(mesh);
+	if (mesh->numFaceNormals > 0)
+	{
+		Base::Resources::Geometry::Dx12FaceNormalResources[meshIndex] = createFaceNormalBuffer(mesh);
+	}
+	Base::Resources::Geometry::numVertecies[meshIndex] = mesh->numVertecies;
+	Base::Resources::Geometry::numIndecies[meshIndex] = mesh->numIndecies;
+
+	D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
+	SetupGeometryDesc(&geomDesc, Base::Resources::Geometry::Dx12VBResources[meshIndex], mesh->numVertecies, Base::Resources::Geometry::Dx12IBResources[meshIndex], mesh->numIndecies);
 
-	D3D12_RAYTRACING_GEOMETRY_DESC geomDesc[2] = {};
+	return blasBuilder->addBuild(&geomDesc, 1, &Base::Resources::DXR::BottomBuffers[meshIndex].pResult);
+}
+
+int CreateAccelerationStructures(BlasBuilder* blasBuilder)
+{
+	Base::Queues::Compute::Dx12CommandAllocator[0]->Reset();
+	Base::Queues::Compute::Dx12CommandList4[0]->Reset(Base::Queues::Compute::Dx12CommandAllocator[0], nullptr);
 
-	SetupGeometryDesc(&geomDesc[0], Base::Resources::Geometry::Dx12VBResources[0], infiniMirror.meshGeometries[0].numVertecies, Base::Resources::Geometry::Dx12IBResources[0], infiniMirror.meshGeometries[0].numIndecies);
-	SetupGeometryDesc(&geomDesc[1], Base::Resources::Geometry::Dx12VBResources[1], infiniMirror.meshGeometries[1].numVertecies, Base::Resources::Geometry::Dx12IBResources[1], infiniMirror.meshGeometries[1].numIndecies);
+	if (blasBuilder->record(Base::Queues::Compute::Dx12CommandList4[0]) != 0) return 1;
 
-	createBottomLevelAS(Base::Queues::Compute::Dx12CommandList4[0], geomDesc, 1, &Base::Resources::DXR::BottomBuffers[0]);
-	createBottomLevelAS(Base::Queues::Compute::Dx12CommandList4[0], geomDesc + 1, 1, &Base::Resources::DXR::BottomBuffers[1]);
 	createTopLevelAS(Base::Queues::Compute::Dx12CommandList4[0]);
 
 	Base::Queues::Compute::Dx12CommandList4[0]->Close();
+
+	//All meshes go to the copy queue in one submission, the AS builds wait for it on the GPU
+	UINT64 uploadFenceValue = Base::Memory::GeometryUploader.flush();
+	Base::Memory::GeometryUploader.queueWait(Base::Queues::Compute::Dx12Queue, uploadFenceValue);
+
 	ID3D12CommandList* listsToExec[] = { Base::Queues::Compute::Dx12CommandList4[0]};
 	Base::Queues::Compute::Dx12Queue->ExecuteCommandLists(_countof(listsToExec), listsToExec);
 
-	Base::Resources::Geometry::numVertecies[0] = infiniMirror.meshGeometries[0].numVertecies;
-	Base::Resources::Geometry::numIndecies[0] = infiniMirror.meshGeometries[0].numIndecies;
-	Base::Resources::Geometry::numVertecies[1] = infiniMirror.meshGeometries[1].numVertecies;
-	Base::Resources::Geometry::numIndecies[1] = infiniMirror.meshGeometries[1].numIndecies;
-
 	WaitForCompute();
 
+	if (BLAS_COMPACTION)
+	{
+		//Now that the compacted sizes are known, copy the BLASes into tight buffers.
+		//The TLAS is rebuilt every frame, so it picks up the compacted BLASes on its own
+		Base::Queues::Compute::Dx12CommandAllocator[0]->Reset();
+		Base::Queues::Compute::Dx12CommandList4[0]->Reset(Base::Queues::Compute::Dx12CommandAllocator[0], nullptr);
+		if (blasBuilder->recordCompaction(Base::Queues::Compute::Dx12CommandList4[0]) != 0) return 1;
+		Base::Queues::Compute::Dx12CommandList4[0]->Close();
+		Base::Queues::Compute::Dx12Queue->ExecuteCommandLists(_countof(listsToExec), listsToExec);
+		WaitForCompute();
+	}
+	blasBuilder->releaseScratch();
+
 	std::cout << "DXR Acceleration Structures and geometry buffers setup successful\n";
 	return 0;
 }
 
 ID3D12RootSignature* createRayGenLocalRootSignature()
 {
-	D3D12_DESCRIPTOR_RANGE range[2]{};
+	D3D12_DESCRIPTOR_RANGE range[4]{};
 	D3D12_ROOT_PARAMETER rootParams[1]{};
 
 	range[0].BaseShaderRegister = 0;
@@ -778,6 +1477,20 @@ ID3D12RootSignature* createRayGenLocalRootSignature()
 	range[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
 	range[1].OffsetInDescriptorsFromTableStart = 1;
 
+	// PixelStatistics, only written by the instrumented permutation
+	range[2].BaseShaderRegister = 2;
+	range[2].NumDescriptors = 1;
+	range[2].RegisterSpace = 0;
+	range[2].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+	range[2].OffsetInDescriptorsFromTableStart = 2;
+
+	// VisibilityBuffer, only read by the hybrid permutation
+	range[3].BaseShaderRegister = 4;
+	range[3].NumDescriptors = 1;
+	range[3].RegisterSpace = 0;
+	range[3].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+	range[3].OffsetInDescriptorsFromTableStart = 3;
+
 	rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
 	rootParams[0].DescriptorTable.NumDescriptorRanges = _countof(range);
 	rootParams[0].DescriptorTable.pDescriptorRanges = range;
@@ -805,7 +1518,8 @@ ID3D12RootSignature* createRayGenLocalRootSignature()
 	return pRootSig;
 }
 
-ID3D12RootSignature* createMirrorHitGroupLocalRootSignature()
+// The flat normal permutation only binds the scene and the face normals (t3) instead of the vertices and indices
+ID3D12RootSignature* createMirrorHitGroupLocalRootSignature(bool flatNormals)
 {
 	D3D12_ROOT_PARAMETER rootParams[3]{};
 
@@ -815,14 +1529,14 @@ ID3D12RootSignature* createMirrorHitGroupLocalRootSignature()
 
 	rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
 	rootParams[1].Descriptor.RegisterSpace = 0;
-	rootParams[1].Descriptor.ShaderRegister = 1;
+	rootParams[1].Descriptor.ShaderRegister = flatNormals ? 3 : 1;
 
 	rootParams[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
 	rootParams[2].Descriptor.RegisterSpace = 0;
 	rootParams[2].Descriptor.ShaderRegister = 2;
 
 	D3D12_ROOT_SIGNATURE_DESC desc = {};
-	desc.NumParameters = _countof(rootParams);
+	desc.NumParameters = flatNormals ? 2 : _countof(rootParams);
 	desc.pParameters = rootParams;
 	desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
 
@@ -898,13 +1612,23 @@ ID3D12RootSignature* createMissLocalRootSignature()
 
 ID3D12RootSignature* createGlobalRootSignature()
 {
-	D3D12_ROOT_PARAMETER rootParams[1]{};
+	D3D12_ROOT_PARAMETER rootParams[3]{};
 
-	//float3 ShaderTableColor;
+	//CB_Global
 	rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
 	rootParams[0].Constants.RegisterSpace = 0;
 	rootParams[0].Constants.ShaderRegister = 0;
-	rootParams[0].Constants.Num32BitValues = 2;
+	rootParams[0].Constants.Num32BitValues = 4;
+
+	//RayStatistics
+	rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_UAV;
+	rootParams[1].Descriptor.RegisterSpace = 0;
+	rootParams[1].Descriptor.ShaderRegister = 1;
+
+	//CB_Frame
+	rootParams[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+	rootParams[2].Descriptor.RegisterSpace = 0;
+	rootParams[2].Descriptor.ShaderRegister = 1;
 
 	D3D12_ROOT_SIGNATURE_DESC desc = {};
 	desc.NumParameters = _countof(rootParams);
@@ -926,17 +1650,31 @@ ID3D12RootSignature* createGlobalRootSignature()
 	return pRootSig;
 }
 
-int CreateRaytracingPipelineState()
+// Does not touch the device, so it can run before the device exists.
+// Permutations compiled earlier in the run are reused, the others go through the on disk cache
+int CompileRaytracingShaders(const ShaderPermutationKey& permutation, IDxcBlob** ppShaders)
 {
-	D3D12_STATE_SUBOBJECT soMem[100]{};
-	UINT numSubobjects = 0;
-	auto nextSubobject = [&]()
+	PROFILE_SCOPE("CompileRaytracingShaders");
+	std::lock_guard<std::mutex> lock(Base::ShaderPermutations::Mutex);
+
+	std::map<ShaderPermutationKey, IDxcBlob*>::iterator compiled = Base::ShaderPermutations::Compiled.find(permutation);
+	if (compiled != Base::ShaderPermutations::Compiled.end())
 	{
-		return soMem + numSubobjects++;
-	};
+		compiled->second->AddRef();
+		*ppShaders = compiled->second;
+		return 0;
+	}
+
+	ShaderCache shaderCache;
+	shaderCache.init(SHADER_CACHE_DIRECTORY);
 
 	ShaderCompiler dxilCompiler;
-	dxilCompiler.init();
+	if (FAILED(dxilCompiler.init()))
+	{
+		std::cerr << "Error: Failed loading the DXC compiler\n";
+		return 1;
+	}
+	dxilCompiler.setCache(&shaderCache);
 
 	ShaderCompilationDesc shaderDesc;
 
@@ -944,153 +1682,557 @@ int CreateRaytracingPipelineState()
 	shaderDesc.CompileArguments.push_back(L"/Gis");
 
 	//Vertex shader
-	shaderDesc.FilePath = L"RayTracingShaders.hlsl";
+	shaderDesc.FilePath = _CRT_WIDE(RAY_TRACING_SHADERS_FILEPATH);
 	shaderDesc.EntryPoint = L"";
 	shaderDesc.TargetProfile = L"lib_6_3";
 
-	IDxcBlob* pShaders = nullptr;
-	dxilCompiler.compileFromFile(&shaderDesc, &pShaders);
-
-	//Init DXIL subobject
-	D3D12_EXPORT_DESC dxilExports[] = {
-		sRayGen, nullptr, D3D12_EXPORT_FLAG_NONE,
-		sMiss, nullptr, D3D12_EXPORT_FLAG_NONE,
-		sClosestHitMirror, nullptr, D3D12_EXPORT_FLAG_NONE,
-		sClosestHitEdges, nullptr, D3D12_EXPORT_FLAG_NONE,
-	};
-	D3D12_DXIL_LIBRARY_DESC dxilLibraryDesc;
-	dxilLibraryDesc.DXILLibrary.pShaderBytecode = pShaders->GetBufferPointer();
-	dxilLibraryDesc.DXILLibrary.BytecodeLength = pShaders->GetBufferSize();
-	dxilLibraryDesc.pExports = dxilExports;
-	dxilLibraryDesc.NumExports = _countof(dxilExports);
+	//DxcDefine only points at the strings, so they are kept alive here until the compile is done
+	std::vector<std::pair<std::wstring, std::wstring>> defines = permutation.defines();
+	for (const std::pair<std::wstring, std::wstring>& define : defines)
+	{
+		shaderDesc.Defines.push_back({ define.first.c_str(), define.second.c_str() });
+	}
 
-	D3D12_STATE_SUBOBJECT* soDXIL = nextSubobject();
-	soDXIL->Type = D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY;
-	soDXIL->pDesc = &dxilLibraryDesc;
+	if (FAILED(dxilCompiler.compileFromFile(&shaderDesc, ppShaders)) || *ppShaders == nullptr)
+	{
+		std::cerr << "Error: Failed compiling " << RAY_TRACING_SHADERS_FILEPATH << " (" << permutation.name() << ")\n";
+		return 1;
+	}
 
+	(*ppShaders)->AddRef();
+	Base::ShaderPermutations::Compiled[permutation] = *ppShaders;
 
-	//Init hit group Mirror
-	D3D12_HIT_GROUP_DESC hitGroupDescMirror;
-	hitGroupDescMirror.AnyHitShaderImport = nullptr;
-	hitGroupDescMirror.ClosestHitShaderImport = sClosestHitMirror;
-	hitGroupDescMirror.HitGroupExport = sHitGroupMirror;
-	hitGroupDescMirror.IntersectionShaderImport = nullptr;
-	hitGroupDescMirror.Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
+	std::cout << "Ray tracing shader compilation successful (" << permutation.name() << ")\n";
+	return 0;
+}
 
-	D3D12_STATE_SUBOBJECT* soHitGroupMirror = nextSubobject();
-	soHitGroupMirror->Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
-	soHitGroupMirror->pDesc = &hitGroupDescMirror;
+// For the passes around the ray tracing. Only compiled once, they are not part of the shader reload
+int CompileShader(const char* filePath, LPCWSTR entryPoint, LPCWSTR targetProfile, IDxcBlob** ppShader)
+{
+	PROFILE_SCOPE("CompileShader");
+	ShaderCache shaderCache;
+	shaderCache.init(SHADER_CACHE_DIRECTORY);
 
-	//Init hit group Edges
-	D3D12_HIT_GROUP_DESC hitGroupDescEdges;
-	hitGroupDescEdges.AnyHitShaderImport = nullptr;
-	hitGroupDescEdges.ClosestHitShaderImport = sClosestHitEdges;
-	hitGroupDescEdges.HitGroupExport = sHitGroupEdges;
-	hitGroupDescEdges.IntersectionShaderImport = nullptr;
-	hitGroupDescEdges.Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
+	ShaderCompiler dxilCompiler;
+	if (FAILED(dxilCompiler.init()))
+	{
+		std::cerr << "Error: Failed loading the DXC compiler\n";
+		return 1;
+	}
+	dxilCompiler.setCache(&shaderCache);
 
-	D3D12_STATE_SUBOBJECT* soHitGroupEdges = nextSubobject();
-	soHitGroupEdges->Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
-	soHitGroupEdges->pDesc = &hitGroupDescEdges;
+	ShaderCompilationDesc shaderDesc;
+	shaderDesc.CompileArguments.push_back(L"/Gis");
+	const std::wstring wideFilePath(filePath, filePath + strlen(filePath)); //the paths in Settings.h are ASCII
+	shaderDesc.FilePath = wideFilePath.c_str();
+	shaderDesc.EntryPoint = entryPoint;
+	shaderDesc.TargetProfile = targetProfile;
 
-	//Init rayGen local root signature
-	ID3D12RootSignature* rayGenLocalRoot = createRayGenLocalRootSignature();
-	D3D12_STATE_SUBOBJECT* soRayGenLocalRoot = nextSubobject();
-	soRayGenLocalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
-	soRayGenLocalRoot->pDesc = &rayGenLocalRoot;
+	if (FAILED(dxilCompiler.compileFromFile(&shaderDesc, ppShader)) || *ppShader == nullptr)
+	{
+		std::cerr << "Error: Failed compiling " << filePath << "\n";
+		return 1;
+	}
 
-	//Bind local root signature to rayGen shader
-	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION rayGenLocalRootAssociation;
-	LPCWSTR rayGenLocalRootAssociationShaderNames[] = { sRayGen };
-	rayGenLocalRootAssociation.pExports = rayGenLocalRootAssociationShaderNames;
-	rayGenLocalRootAssociation.NumExports = _countof(rayGenLocalRootAssociationShaderNames);
-	rayGenLocalRootAssociation.pSubobjectToAssociate = soRayGenLocalRoot; //<-- address to local root subobject
+	std::cout << "Shader compilation successful (" << filePath << ")\n";
+	return 0;
+}
 
-	D3D12_STATE_SUBOBJECT* soRayGenLocalRootAssociation = nextSubobject();
-	soRayGenLocalRootAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-	soRayGenLocalRootAssociation->pDesc = &rayGenLocalRootAssociation;
+// Reads an output through an SRV and writes the full size target, whose UAV sits right after it in the heap
+int CreateUpscalePass(IDxcBlob* pShader)
+{
+	D3D12_DESCRIPTOR_RANGE range[2]{};
 
+	// Source
+	range[0].BaseShaderRegister = 0;
+	range[0].NumDescriptors = 1;
+	range[0].RegisterSpace = 0;
+	range[0].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+	range[0].OffsetInDescriptorsFromTableStart = 0;
 
-	//Init mirror hit group local root signature
-	ID3D12RootSignature* mirrorHitGroupLocalRoot = createMirrorHitGroupLocalRootSignature();
-	D3D12_STATE_SUBOBJECT* soMirrorHitGroupLocalRoot = nextSubobject();
-	soMirrorHitGroupLocalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
-	soMirrorHitGroupLocalRoot->pDesc = &mirrorHitGroupLocalRoot;
+	// Destination
+	range[1].BaseShaderRegister = 0;
+	range[1].NumDescriptors = 1;
+	range[1].RegisterSpace = 0;
+	range[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+	range[1].OffsetInDescriptorsFromTableStart = 1;
 
+	D3D12_ROOT_PARAMETER rootParams[2]{};
 
-	//Bind local root signature to mirror hit group shaders
-	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION mirrorHitGroupLocalRootAssociation;
-	LPCWSTR mirrorHitGroupLocalRootAssociationShaderNames[] = { sClosestHitMirror };
-	mirrorHitGroupLocalRootAssociation.pExports = mirrorHitGroupLocalRootAssociationShaderNames;
-	mirrorHitGroupLocalRootAssociation.NumExports = _countof(mirrorHitGroupLocalRootAssociationShaderNames);
-	mirrorHitGroupLocalRootAssociation.pSubobjectToAssociate = soMirrorHitGroupLocalRoot; //<-- address to local root subobject
+	//CB_Upscale, source and destination sizes
+	rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+	rootParams[0].Constants.ShaderRegister = 0;
+	rootParams[0].Constants.RegisterSpace = 0;
+	rootParams[0].Constants.Num32BitValues = 4;
 
-	D3D12_STATE_SUBOBJECT* soMirrorEdgesHitGroupLocalRootAssociation = nextSubobject();
-	soMirrorEdgesHitGroupLocalRootAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-	soMirrorEdgesHitGroupLocalRootAssociation->pDesc = &mirrorHitGroupLocalRootAssociation;
+	rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+	rootParams[1].DescriptorTable.NumDescriptorRanges = _countof(range);
+	rootParams[1].DescriptorTable.pDescriptorRanges = range;
 
-	//Init edges hit group local root signature
-	ID3D12RootSignature* edgesHitGroupLocalRoot = createEdgesHitGroupLocalRootSignature();
-	D3D12_STATE_SUBOBJECT* soEdgesHitGroupLocalRoot = nextSubobject();
-	soEdgesHitGroupLocalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
-	soEdgesHitGroupLocalRoot->pDesc = &edgesHitGroupLocalRoot;
+	D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
+	rootSignatureDesc.NumParameters = _countof(rootParams);
+	rootSignatureDesc.pParameters = rootParams;
+	rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
 
+	ID3DBlob* pSigBlob = nullptr;
+	ID3DBlob* pErrorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &pSigBlob, &pErrorBlob);
+	if (FAILED(hr))
+	{
+		std::cerr << "Error: Failed serializing the upscale root signature\n";
+		SafeRelease(&pErrorBlob);
+		return 1;
+	}
+	hr = Base::Dx12Device->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(), IID_PPV_ARGS(&Base::Resources::Upscale::Dx12RootSignature));
+	SafeRelease(&pSigBlob);
+	if (FAILED(hr))
+	{
+		std::cerr << "Error: Failed creating the upscale root signature\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Upscale::Dx12RootSignature);
 
-	//Bind local root signature to edges hit group shaders
-	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION edgesHitGroupLocalRootAssociation;
-	LPCWSTR edgesHitGroupLocalRootAssociationShaderNames[] = { sClosestHitEdges };
-	edgesHitGroupLocalRootAssociation.pExports = edgesHitGroupLocalRootAssociationShaderNames;
-	edgesHitGroupLocalRootAssociation.NumExports = _countof(edgesHitGroupLocalRootAssociationShaderNames);
-	edgesHitGroupLocalRootAssociation.pSubobjectToAssociate = soEdgesHitGroupLocalRoot; //<-- address to local root subobject
+	D3D12_COMPUTE_PIPELINE_STATE_DESC pipelineDesc = {};
+	pipelineDesc.pRootSignature = Base::Resources::Upscale::Dx12RootSignature;
+	pipelineDesc.CS.pShaderBytecode = pShader->GetBufferPointer();
+	pipelineDesc.CS.BytecodeLength = pShader->GetBufferSize();
+	if (FAILED(Base::Dx12Device->CreateComputePipelineState(&pipelineDesc, IID_PPV_ARGS(&Base::Resources::Upscale::Dx12PipelineState))))
+	{
+		std::cerr << "Error: Failed creating the upscale pipeline state\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Upscale::Dx12PipelineState);
 
-	D3D12_STATE_SUBOBJECT* soEdgesHitGroupLocalRootAssociation = nextSubobject();
-	soEdgesHitGroupLocalRootAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-	soEdgesHitGroupLocalRootAssociation->pDesc = &edgesHitGroupLocalRootAssociation;
+	// Same size and format as the outputs, so it can be copied to the backbuffer the same way
+	D3D12_RESOURCE_DESC resDesc = Base::Resources::DXR::Dx12OutputResource[0]->GetDesc();
+	if (FAILED(Base::Dx12Device->CreateCommittedResource(&defaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&Base::Resources::Upscale::Dx12TargetResource))))
+	{
+		std::cerr << "Error: Failed creating the upscale target\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Upscale::Dx12TargetResource);
+	MemoryRegistry::track(Base::Resources::Upscale::Dx12TargetResource, MemoryCategory_OutputTextures, Base::Dx12Device->GetResourceAllocationInfo(0, 1, &resDesc).SizeInBytes);
 
+	D3D12_DESCRIPTOR_HEAP_DESC heapDescriptorDesc = {};
+	heapDescriptorDesc.NumDescriptors = 4;
+	heapDescriptorDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	heapDescriptorDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	if (FAILED(Base::Dx12Device->CreateDescriptorHeap(&heapDescriptorDesc, IID_PPV_ARGS(&Base::Resources::Upscale::Dx12DescriptorHeap))))
+	{
+		std::cerr << "Error: Failed creating the upscale descriptor heap\n";
+		return 1;
+	}
 
-	//Init miss local root signature
-	ID3D12RootSignature* missLocalRoot = createMissLocalRootSignature();
-	D3D12_STATE_SUBOBJECT* soMissLocalRoot = nextSubobject();
-	soMissLocalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
-	soMissLocalRoot->pDesc = &missLocalRoot;
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Format = resDesc.Format;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Texture2D.MipLevels = 1;
 
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
 
-	//Bind local root signature to miss shader
-	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION missLocalRootAssociation;
-	LPCWSTR missLocalRootAssociationShaderNames[] = { sMiss };
-	missLocalRootAssociation.pExports = missLocalRootAssociationShaderNames;
-	missLocalRootAssociation.NumExports = _countof(missLocalRootAssociationShaderNames);
-	missLocalRootAssociation.pSubobjectToAssociate = soMissLocalRoot; //<-- address to local root subobject
+	const UINT descriptorSize = Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	D3D12_CPU_DESCRIPTOR_HANDLE handle = Base::Resources::Upscale::Dx12DescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	for (int i = 0; i < 2; i++)
+	{
+		Base::Dx12Device->CreateShaderResourceView(Base::Resources::DXR::Dx12OutputResource[i], &srvDesc, handle);
+		handle.ptr += descriptorSize;
+		Base::Dx12Device->CreateUnorderedAccessView(Base::Resources::Upscale::Dx12TargetResource, nullptr, &uavDesc, handle);
+		handle.ptr += descriptorSize;
+	}
 
-	D3D12_STATE_SUBOBJECT* soMissLocalRootAssociation = nextSubobject();
-	soMissLocalRootAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-	soMissLocalRootAssociation->pDesc = &missLocalRootAssociation;
+	std::cout << "Upscale pass setup successful\n";
+	return 0;
+}
 
+// The pass writes the output through slot 0 of the ray tracing descriptor heaps, which the dispatch list already has set
+int CreateCheckerboardPass(IDxcBlob* pShader)
+{
+	D3D12_DESCRIPTOR_RANGE range = {};
+	range.BaseShaderRegister = 0;
+	range.NumDescriptors = 1;
+	range.RegisterSpace = 0;
+	range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+	range.OffsetInDescriptorsFromTableStart = 0;
 
-	//Init shader config
-	D3D12_RAYTRACING_SHADER_CONFIG shaderConfig = {};
-	shaderConfig.MaxAttributeSizeInBytes = sizeof(float) * 2;
-	shaderConfig.MaxPayloadSizeInBytes = sizeof(float) * 3 + sizeof(UINT) * 1;
+	D3D12_ROOT_PARAMETER rootParams[2]{};
 
-	D3D12_STATE_SUBOBJECT* soShaderConfig = nextSubobject();
-	soShaderConfig->Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_SHADER_CONFIG;
-	soShaderConfig->pDesc = &shaderConfig;
+	//Output
+	rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+	rootParams[0].DescriptorTable.NumDescriptorRanges = 1;
+	rootParams[0].DescriptorTable.pDescriptorRanges = &range;
 
-	//Bind the payload size to the programs
-	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION shaderConfigAssociation;
-	const WCHAR* shaderNamesToConfig[] = { sMiss, sClosestHitMirror, sClosestHitEdges, sRayGen };
-	shaderConfigAssociation.pExports = shaderNamesToConfig;
-	shaderConfigAssociation.NumExports = _countof(shaderNamesToConfig);
-	shaderConfigAssociation.pSubobjectToAssociate = soShaderConfig; //<-- address to shader config subobject
+	//CB_Frame
+	rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+	rootParams[1].Descriptor.RegisterSpace = 0;
+	rootParams[1].Descriptor.ShaderRegister = 0;
 
-	D3D12_STATE_SUBOBJECT* soShaderConfigAssociation = nextSubobject();
-	soShaderConfigAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-	soShaderConfigAssociation->pDesc = &shaderConfigAssociation;
+	D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
+	rootSignatureDesc.NumParameters = _countof(rootParams);
+	rootSignatureDesc.pParameters = rootParams;
+	rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
 
+	ID3DBlob* pSigBlob = nullptr;
+	ID3DBlob* pErrorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &pSigBlob, &pErrorBlob);
+	if (FAILED(hr))
+	{
+		std::cerr << "Error: Failed serializing the checkerboard root signature\n";
+		SafeRelease(&pErrorBlob);
+		return 1;
+	}
+	hr = Base::Dx12Device->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(), IID_PPV_ARGS(&Base::Resources::Checkerboard::Dx12RootSignature));
+	SafeRelease(&pSigBlob);
+	if (FAILED(hr))
+	{
+		std::cerr << "Error: Failed creating the checkerboard root signature\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Checkerboard::Dx12RootSignature);
 
-	//Init pipeline config
+	D3D12_COMPUTE_PIPELINE_STATE_DESC pipelineDesc = {};
+	pipelineDesc.pRootSignature = Base::Resources::Checkerboard::Dx12RootSignature;
+	pipelineDesc.CS.pShaderBytecode = pShader->GetBufferPointer();
+	pipelineDesc.CS.BytecodeLength = pShader->GetBufferSize();
+	if (FAILED(Base::Dx12Device->CreateComputePipelineState(&pipelineDesc, IID_PPV_ARGS(&Base::Resources::Checkerboard::Dx12PipelineState))))
+	{
+		std::cerr << "Error: Failed creating the checkerboard pipeline state\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Checkerboard::Dx12PipelineState);
+
+	std::cout << "Checkerboard pass setup successful\n";
+	return 0;
+}
+
+// Draws the mesh parts into visibility buffers, which the ray tracing descriptor heaps see in slot 3.
+// Also creates the direct queue the pass runs on, so it doesn't wait behind the presents
+int CreateVisibilityPass(IDxcBlob* pVertexShader, IDxcBlob* pPixelShader)
+{
+	D3D12_ROOT_PARAMETER rootParams[2]{};
+
+	//CB_Visibility
+	rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+	rootParams[0].Constants.ShaderRegister = 0;
+	rootParams[0].Constants.RegisterSpace = 0;
+	rootParams[0].Constants.Num32BitValues = sizeof(VisibilityConstants) / 4;
+
+	//FaceNormals
+	rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+	rootParams[1].Descriptor.RegisterSpace = 0;
+	rootParams[1].Descriptor.ShaderRegister = 0;
+
+	D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
+	rootSignatureDesc.NumParameters = _countof(rootParams);
+	rootSignatureDesc.pParameters = rootParams;
+	rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+
+	ID3DBlob* pSigBlob = nullptr;
+	ID3DBlob* pErrorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &pSigBlob, &pErrorBlob);
+	if (FAILED(hr))
+	{
+		std::cerr << "Error: Failed serializing the visibility root signature\n";
+		SafeRelease(&pErrorBlob);
+		return 1;
+	}
+	hr = Base::Dx12Device->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(), IID_PPV_ARGS(&Base::Resources::Visibility::Dx12RootSignature));
+	SafeRelease(&pSigBlob);
+	if (FAILED(hr))
+	{
+		std::cerr << "Error: Failed creating the visibility root signature\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Visibility::Dx12RootSignature);
+
+	//Only the position and normal of Vertex are read
+	D3D12_INPUT_ELEMENT_DESC inputElements[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(Vertex, pos), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(Vertex, norm), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+	};
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineDesc = {};
+	pipelineDesc.pRootSignature = Base::Resources::Visibility::Dx12RootSignature;
+	pipelineDesc.VS.pShaderBytecode = pVertexShader->GetBufferPointer();
+	pipelineDesc.VS.BytecodeLength = pVertexShader->GetBufferSize();
+	pipelineDesc.PS.pShaderBytecode = pPixelShader->GetBufferPointer();
+	pipelineDesc.PS.BytecodeLength = pPixelShader->GetBufferSize();
+	pipelineDesc.InputLayout.pInputElementDescs = inputElements;
+	pipelineDesc.InputLayout.NumElements = _countof(inputElements);
+	pipelineDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	pipelineDesc.SampleMask = UINT_MAX;
+	pipelineDesc.SampleDesc.Count = 1;
+	pipelineDesc.NumRenderTargets = 1;
+	pipelineDesc.RTVFormats[0] = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	pipelineDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+	pipelineDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+
+	//Clockwise front faces, as for the primary rays, which cull back facing triangles
+	pipelineDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+	pipelineDesc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
+	pipelineDesc.RasterizerState.FrontCounterClockwise = FALSE;
+	pipelineDesc.RasterizerState.DepthClipEnable = TRUE;
+
+	pipelineDesc.DepthStencilState.DepthEnable = TRUE;
+	pipelineDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+	pipelineDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+
+	if (FAILED(Base::Dx12Device->CreateGraphicsPipelineState(&pipelineDesc, IID_PPV_ARGS(&Base::Resources::Visibility::Dx12PipelineState))))
+	{
+		std::cerr << "Error: Failed creating the visibility pipeline state\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Visibility::Dx12PipelineState);
+
+	//w is 0 where nothing was drawn, which the raygen reads as a miss
+	D3D12_RESOURCE_DESC resDesc = Base::Resources::DXR::Dx12OutputResource[0]->GetDesc();
+	resDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	resDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+	D3D12_CLEAR_VALUE colorClear = {};
+	colorClear.Format = resDesc.Format;
+	for (int i = 0; i < 2; i++)
+	{
+		if (FAILED(Base::Dx12Device->CreateCommittedResource(&defaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, &colorClear, IID_PPV_ARGS(&Base::Resources::Visibility::Dx12VisibilityResource[i]))))
+		{
+			std::cerr << "Error: Failed creating the visibility buffers\n";
+			return 1;
+		}
+		NameInterfaceIndex(Base::Resources::Visibility::Dx12VisibilityResource[i], i);
+		MemoryRegistry::track(Base::Resources::Visibility::Dx12VisibilityResource[i], MemoryCategory_OutputTextures, Base::Dx12Device->GetResourceAllocationInfo(0, 1, &resDesc).SizeInBytes);
+	}
+
+	D3D12_RESOURCE_DESC depthDesc = resDesc;
+	depthDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	depthDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL | D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE;
+	D3D12_CLEAR_VALUE depthClear = {};
+	depthClear.Format = depthDesc.Format;
+	depthClear.DepthStencil.Depth = 1.0f;
+	if (FAILED(Base::Dx12Device->CreateCommittedResource(&defaultHeapProps, D3D12_HEAP_FLAG_NONE, &depthDesc, D3D12_RESOURCE_STATE_DEPTH_WRITE, &depthClear, IID_PPV_ARGS(&Base::Resources::Visibility::Dx12DepthResource))))
+	{
+		std::cerr << "Error: Failed creating the visibility depth buffer\n";
+		return 1;
+	}
+	NameInterface(Base::Resources::Visibility::Dx12DepthResource);
+	MemoryRegistry::track(Base::Resources::Visibility::Dx12DepthResource, MemoryCategory_OutputTextures, Base::Dx12Device->GetResourceAllocationInfo(0, 1, &depthDesc).SizeInBytes);
+
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.NumDescriptors = 2;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+	if (FAILED(Base::Dx12Device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&Base::Resources::Visibility::Dx12RTVDescriptorHeap))))
+	{
+		std::cerr << "Error: Failed creating the visibility RTV heap\n";
+		return 1;
+	}
+	heapDesc.NumDescriptors = 1;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+	if (FAILED(Base::Dx12Device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&Base::Resources::Visibility::Dx12DSVDescriptorHeap))))
+	{
+		std::cerr << "Error: Failed creating the visibility DSV heap\n";
+		return 1;
+	}
+	Base::Dx12Device->CreateDepthStencilView(Base::Resources::Visibility::Dx12DepthResource, nullptr, Base::Resources::Visibility::Dx12DSVDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Format = resDesc.Format;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Texture2D.MipLevels = 1;
+
+	D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = Base::Resources::Visibility::Dx12RTVDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	for (int i = 0; i < 2; i++)
+	{
+		Base::Dx12Device->CreateRenderTargetView(Base::Resources::Visibility::Dx12VisibilityResource[i], nullptr, rtvHandle);
+		rtvHandle.ptr += Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+
+		D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = Base::Resources::DXR::Dx12RTDescriptorHeap[i]->GetCPUDescriptorHandleForHeapStart();
+		srvHandle.ptr += 3 * Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		Base::Dx12Device->CreateShaderResourceView(Base::Resources::Visibility::Dx12VisibilityResource[i], &srvDesc, srvHandle);
+	}
+
+	D3D12_COMMAND_QUEUE_DESC cqd = {};
+	cqd.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+	if (FAILED(Base::Dx12Device->CreateCommandQueue(&cqd, IID_PPV_ARGS(&Base::Queues::Visibility::Dx12Queue))))
+	{
+		std::cerr << "Error: Failed creating the visibility queue\n";
+		return 1;
+	}
+	NameInterface(Base::Queues::Visibility::Dx12Queue);
+	for (int i = 0; i < 2; i++)
+	{
+		if (FAILED(Base::Dx12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&Base::Queues::Visibility::Dx12CommandAllocator[i]))) ||
+			FAILED(Base::Dx12Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, Base::Queues::Visibility::Dx12CommandAllocator[i], nullptr, IID_PPV_ARGS(&Base::Queues::Visibility::Dx12CommandList4[i]))))
+		{
+			std::cerr << "Error: Failed creating the visibility command lists\n";
+			return 1;
+		}
+		NameInterfaceIndex(Base::Queues::Visibility::Dx12CommandAllocator[i], i);
+		NameInterfaceIndex(Base::Queues::Visibility::Dx12CommandList4[i], i);
+		Base::Queues::Visibility::Dx12CommandList4[i]->Close();
+	}
+
+	if (FAILED(Base::Dx12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&Base::Synchronization::Visibility::Dx12Fence))))
+	{
+		std::cerr << "Error: Visibility fence creation failed\n";
+		return 1;
+	}
+	NameInterface(Base::Synchronization::Visibility::Dx12Fence);
+
+	std::cout << "Visibility pass setup successful\n";
+	return 0;
+}
+
+// Root signatures are only created the first time. A reloaded pipeline has to keep the same bindings
+int CreateRaytracingPipelineState(IDxcBlob* pShaders, RaytracingPipeline* pipeline)
+{
+	D3D12_STATE_SUBOBJECT soMem[100]{};
+	UINT numSubobjects = 0;
+	auto nextSubobject = [&]()
+	{
+		return soMem + numSubobjects++;
+	};
+
+	//Init DXIL subobject
+	D3D12_EXPORT_DESC dxilExports[] = {
+		sRayGen, nullptr, D3D12_EXPORT_FLAG_NONE,
+		sMiss, nullptr, D3D12_EXPORT_FLAG_NONE,
+		sClosestHitMirror, nullptr, D3D12_EXPORT_FLAG_NONE,
+		sClosestHitEdges, nullptr, D3D12_EXPORT_FLAG_NONE,
+	};
+	D3D12_DXIL_LIBRARY_DESC dxilLibraryDesc;
+	dxilLibraryDesc.DXILLibrary.pShaderBytecode = pShaders->GetBufferPointer();
+	dxilLibraryDesc.DXILLibrary.BytecodeLength = pShaders->GetBufferSize();
+	dxilLibraryDesc.pExports = dxilExports;
+	dxilLibraryDesc.NumExports = _countof(dxilExports);
+
+	D3D12_STATE_SUBOBJECT* soDXIL = nextSubobject();
+	soDXIL->Type = D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY;
+	soDXIL->pDesc = &dxilLibraryDesc;
+
+
+	//Init hit group Mirror
+	D3D12_HIT_GROUP_DESC hitGroupDescMirror;
+	hitGroupDescMirror.AnyHitShaderImport = nullptr;
+	hitGroupDescMirror.ClosestHitShaderImport = sClosestHitMirror;
+	hitGroupDescMirror.HitGroupExport = sHitGroupMirror;
+	hitGroupDescMirror.IntersectionShaderImport = nullptr;
+	hitGroupDescMirror.Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
+
+	D3D12_STATE_SUBOBJECT* soHitGroupMirror = nextSubobject();
+	soHitGroupMirror->Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
+	soHitGroupMirror->pDesc = &hitGroupDescMirror;
+
+	//Init hit group Edges
+	D3D12_HIT_GROUP_DESC hitGroupDescEdges;
+	hitGroupDescEdges.AnyHitShaderImport = nullptr;
+	hitGroupDescEdges.ClosestHitShaderImport = sClosestHitEdges;
+	hitGroupDescEdges.HitGroupExport = sHitGroupEdges;
+	hitGroupDescEdges.IntersectionShaderImport = nullptr;
+	hitGroupDescEdges.Type = D3D12_HIT_GROUP_TYPE_TRIANGLES;
+
+	D3D12_STATE_SUBOBJECT* soHitGroupEdges = nextSubobject();
+	soHitGroupEdges->Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
+	soHitGroupEdges->pDesc = &hitGroupDescEdges;
+
+	//Init rayGen local root signature
+	ID3D12RootSignature* rayGenLocalRoot = createRayGenLocalRootSignature();
+	D3D12_STATE_SUBOBJECT* soRayGenLocalRoot = nextSubobject();
+	soRayGenLocalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
+	soRayGenLocalRoot->pDesc = &rayGenLocalRoot;
+
+	//Bind local root signature to rayGen shader
+	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION rayGenLocalRootAssociation;
+	LPCWSTR rayGenLocalRootAssociationShaderNames[] = { sRayGen };
+	rayGenLocalRootAssociation.pExports = rayGenLocalRootAssociationShaderNames;
+	rayGenLocalRootAssociation.NumExports = _countof(rayGenLocalRootAssociationShaderNames);
+	rayGenLocalRootAssociation.pSubobjectToAssociate = soRayGenLocalRoot; //<-- address to local root subobject
+
+	D3D12_STATE_SUBOBJECT* soRayGenLocalRootAssociation = nextSubobject();
+	soRayGenLocalRootAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
+	soRayGenLocalRootAssociation->pDesc = &rayGenLocalRootAssociation;
+
+
+	//Init mirror hit group local root signature
+	ID3D12RootSignature* mirrorHitGroupLocalRoot = createMirrorHitGroupLocalRootSignature(pipeline->Permutation.FlatNormals);
+	D3D12_STATE_SUBOBJECT* soMirrorHitGroupLocalRoot = nextSubobject();
+	soMirrorHitGroupLocalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
+	soMirrorHitGroupLocalRoot->pDesc = &mirrorHitGroupLocalRoot;
+
+
+	//Bind local root signature to mirror hit group shaders
+	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION mirrorHitGroupLocalRootAssociation;
+	LPCWSTR mirrorHitGroupLocalRootAssociationShaderNames[] = { sClosestHitMirror };
+	mirrorHitGroupLocalRootAssociation.pExports = mirrorHitGroupLocalRootAssociationShaderNames;
+	mirrorHitGroupLocalRootAssociation.NumExports = _countof(mirrorHitGroupLocalRootAssociationShaderNames);
+	mirrorHitGroupLocalRootAssociation.pSubobjectToAssociate = soMirrorHitGroupLocalRoot; //<-- address to local root subobject
+
+	D3D12_STATE_SUBOBJECT* soMirrorEdgesHitGroupLocalRootAssociation = nextSubobject();
+	soMirrorEdgesHitGroupLocalRootAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
+	soMirrorEdgesHitGroupLocalRootAssociation->pDesc = &mirrorHitGroupLocalRootAssociation;
+
+	//Init edges hit group local root signature
+	ID3D12RootSignature* edgesHitGroupLocalRoot = createEdgesHitGroupLocalRootSignature();
+	D3D12_STATE_SUBOBJECT* soEdgesHitGroupLocalRoot = nextSubobject();
+	soEdgesHitGroupLocalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
+	soEdgesHitGroupLocalRoot->pDesc = &edgesHitGroupLocalRoot;
+
+
+	//Bind local root signature to edges hit group shaders
+	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION edgesHitGroupLocalRootAssociation;
+	LPCWSTR edgesHitGroupLocalRootAssociationShaderNames[] = { sClosestHitEdges };
+	edgesHitGroupLocalRootAssociation.pExports = edgesHitGroupLocalRootAssociationShaderNames;
+	edgesHitGroupLocalRootAssociation.NumExports = _countof(edgesHitGroupLocalRootAssociationShaderNames);
+	edgesHitGroupLocalRootAssociation.pSubobjectToAssociate = soEdgesHitGroupLocalRoot; //<-- address to local root subobject
+
+	D3D12_STATE_SUBOBJECT* soEdgesHitGroupLocalRootAssociation = nextSubobject();
+	soEdgesHitGroupLocalRootAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
+	soEdgesHitGroupLocalRootAssociation->pDesc = &edgesHitGroupLocalRootAssociation;
+
+
+	//Init miss local root signature
+	ID3D12RootSignature* missLocalRoot = createMissLocalRootSignature();
+	D3D12_STATE_SUBOBJECT* soMissLocalRoot = nextSubobject();
+	soMissLocalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
+	soMissLocalRoot->pDesc = &missLocalRoot;
+
+
+	//Bind local root signature to miss shader
+	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION missLocalRootAssociation;
+	LPCWSTR missLocalRootAssociationShaderNames[] = { sMiss };
+	missLocalRootAssociation.pExports = missLocalRootAssociationShaderNames;
+	missLocalRootAssociation.NumExports = _countof(missLocalRootAssociationShaderNames);
+	missLocalRootAssociation.pSubobjectToAssociate = soMissLocalRoot; //<-- address to local root subobject
+
+	D3D12_STATE_SUBOBJECT* soMissLocalRootAssociation = nextSubobject();
+	soMissLocalRootAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
+	soMissLocalRootAssociation->pDesc = &missLocalRootAssociation;
+
+
+	//Init shader config
+	D3D12_RAYTRACING_SHADER_CONFIG shaderConfig = {};
+	shaderConfig.MaxAttributeSizeInBytes = sizeof(float) * 2;
+	shaderConfig.MaxPayloadSizeInBytes = pipeline->Permutation.Instrumentation ? sizeof(InstrumentedRayPayload) : sizeof(RayPayload);
+
+	D3D12_STATE_SUBOBJECT* soShaderConfig = nextSubobject();
+	soShaderConfig->Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_SHADER_CONFIG;
+	soShaderConfig->pDesc = &shaderConfig;
+
+	//Bind the payload size to the programs
+	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION shaderConfigAssociation;
+	const WCHAR* shaderNamesToConfig[] = { sMiss, sClosestHitMirror, sClosestHitEdges, sRayGen };
+	shaderConfigAssociation.pExports = shaderNamesToConfig;
+	shaderConfigAssociation.NumExports = _countof(shaderNamesToConfig);
+	shaderConfigAssociation.pSubobjectToAssociate = soShaderConfig; //<-- address to shader config subobject
+
+	D3D12_STATE_SUBOBJECT* soShaderConfigAssociation = nextSubobject();
+	soShaderConfigAssociation->Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
+	soShaderConfigAssociation->pDesc = &shaderConfigAssociation;
+
+
+	//Init pipeline config
 	D3D12_RAYTRACING_PIPELINE_CONFIG pipelineConfig;
-	pipelineConfig.MaxTraceRecursionDepth = MAX_RAY_DEPTH;
+	pipelineConfig.MaxTraceRecursionDepth = pipeline->Permutation.MaxRayDepth;
 
 	D3D12_STATE_SUBOBJECT* soPipelineConfig = nextSubobject();
 	soPipelineConfig->Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_PIPELINE_CONFIG;
@@ -1099,7 +2241,10 @@ int CreateRaytracingPipelineState()
 
 
 	//Init global root signature
-	Base::Resources::DXR::Dx12GlobalRS = createGlobalRootSignature();
+	if (Base::Resources::DXR::Dx12GlobalRS == nullptr)
+	{
+		Base::Resources::DXR::Dx12GlobalRS = createGlobalRootSignature();
+	}
 
 	D3D12_STATE_SUBOBJECT* soGlobalRoot = nextSubobject();
 	soGlobalRoot->Type = D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE;
@@ -1112,7 +2257,7 @@ int CreateRaytracingPipelineState()
 	desc.pSubobjects = soMem;
 	desc.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
 
-	HRESULT hr = Base::Dx12Device->CreateStateObject(&desc, IID_PPV_ARGS(&Base::States::DXRPipelineState));
+	HRESULT hr = Base::Dx12Device->CreateStateObject(&desc, IID_PPV_ARGS(&pipeline->State));
 
 
 	//release local root signatures
@@ -1121,6 +2266,12 @@ int CreateRaytracingPipelineState()
 	SafeRelease(&edgesHitGroupLocalRoot);
 	SafeRelease(&missLocalRoot);
 
+	if (FAILED(hr))
+	{
+		std::cerr << "Error: Ray tracing pipeline state creation failed\n";
+		return 1;
+	}
+
 	std::cout << "Ray tracing pipeline state setup done\n";
 	return 0;
 }
@@ -1152,6 +2303,9 @@ int CreateShaderResources()
 	//both resources start in unordered access state for integration with the start of the rendering loops
 	Base::Dx12Device->CreateCommittedResource(&defaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&Base::Resources::DXR::Dx12OutputResource[0]));
 	Base::Dx12Device->CreateCommittedResource(&defaultHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&Base::Resources::DXR::Dx12OutputResource[1]));
+	UINT64 outputBytes = Base::Dx12Device->GetResourceAllocationInfo(0, 1, &resDesc).SizeInBytes;
+	MemoryRegistry::track(Base::Resources::DXR::Dx12OutputResource[0], MemoryCategory_OutputTextures, outputBytes);
+	MemoryRegistry::track(Base::Resources::DXR::Dx12OutputResource[1], MemoryCategory_OutputTextures, outputBytes);
 
 	// Create the UAV. Based on the root signature we created it should be the first entry
 	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
@@ -1177,141 +2331,156 @@ int CreateShaderResources()
 	Base::Resources::DXR::Dx12Accelleration_CPUHandle.ptr += Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 	Base::Dx12Device->CreateShaderResourceView(nullptr, &srvDesc, Base::Resources::DXR::Dx12Accelleration_CPUHandle);
 
-	std::cout << "Shader descriptors setup done\n";
-	return 0;
-}
+	// The pixel statistics UAV goes after the TLAS SRV. The raygen table always declares it, so it is a null descriptor
+	// until the instrumentation creates the buffers
+	D3D12_UNORDERED_ACCESS_VIEW_DESC nullPixelUavDesc = {};
+	nullPixelUavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	nullPixelUavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	nullPixelUavDesc.Buffer.StructureByteStride = sizeof(UINT32);
+	for (int i = 0; i < 2; i++)
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE pixelUavHandle = Base::Resources::DXR::Dx12RTDescriptorHeap[i]->GetCPUDescriptorHandleForHeapStart();
+		pixelUavHandle.ptr += 2 * Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		Base::Dx12Device->CreateUnorderedAccessView(nullptr, nullptr, &nullPixelUavDesc, pixelUavHandle);
+	}
 
+	// The visibility buffer SRV goes after the pixel statistics UAV. It stays a null descriptor unless the visibility pass is created
+	D3D12_SHADER_RESOURCE_VIEW_DESC nullVisibilityDesc = {};
+	nullVisibilityDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	nullVisibilityDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	nullVisibilityDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	nullVisibilityDesc.Texture2D.MipLevels = 1;
+	for (int i = 0; i < 2; i++)
+	{
+		D3D12_CPU_DESCRIPTOR_HANDLE visibilityHandle = Base::Resources::DXR::Dx12RTDescriptorHeap[i]->GetCPUDescriptorHandleForHeapStart();
+		visibilityHandle.ptr += 3 * Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		Base::Dx12Device->CreateShaderResourceView(nullptr, &nullVisibilityDesc, visibilityHandle);
+	}
 
-int CreateShaderTables()
-{
-	ID3D12StateObjectProperties* pRtsoProps = nullptr;
-	if (SUCCEEDED(Base::States::DXRPipelineState->QueryInterface(IID_PPV_ARGS(&pRtsoProps))))
+	// The counters are never cleared, the compute loop takes the difference between two readbacks of a slot
+	for (int i = 0; i < 2; i++)
 	{
-		//raygen
+		Base::Resources::RayStatistics::Dx12CounterResource[i] = createBuffer(sizeof(RayStatisticsTotals), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, defaultHeapProps, MemoryCategory_Statistics);
+		Base::Resources::RayStatistics::Dx12ReadbackResource[i] = createBuffer(sizeof(RayStatisticsTotals), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, readbackHeapProps, MemoryCategory_Readback);
+		if (Base::Resources::RayStatistics::Dx12CounterResource[i] == nullptr || Base::Resources::RayStatistics::Dx12ReadbackResource[i] == nullptr)
 		{
+			std::cerr << "Error: Failed creating the ray statistics buffers\n";
+			return 1;
+		}
+	}
 
-			struct alignas(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT) RAY_GEN_SHADER_TABLE_DATA
-			{
-				unsigned char ShaderIdentifier[D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES];
-				UINT64 RTVDescriptor;
-			} tableData;
-
-			//how big is the biggest?
-			union MaxSize
-			{
-				RAY_GEN_SHADER_TABLE_DATA data0;
-			};
+	// Constant buffer views have to start at a multiple of 256 bytes, so every slot gets its own buffer
+	for (int i = 0; i < 2; i++)
+	{
+		Base::Resources::Checkerboard::Dx12FrameConstants[i] = createBuffer(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProperties, MemoryCategory_Constants);
+		if (Base::Resources::Checkerboard::Dx12FrameConstants[i] == nullptr || FAILED(Base::Resources::Checkerboard::Dx12FrameConstants[i]->Map(0, nullptr, (void**)&Base::Resources::Checkerboard::MappedFrameConstants[i])))
+		{
+			std::cerr << "Error: Failed creating the frame constant buffers\n";
+			return 1;
+		}
+		*Base::Resources::Checkerboard::MappedFrameConstants[i] = {};
+	}
 
-			//create table for the first UAV output
-			memcpy(tableData.ShaderIdentifier, pRtsoProps->GetShaderIdentifier(sRayGen), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-			tableData.RTVDescriptor = Base::Resources::DXR::Dx12RTDescriptorHeap[0]->GetGPUDescriptorHandleForHeapStart().ptr;
+	// Replaces the null pixel statistics UAV in each heap
+	if (RAY_INSTRUMENTATION)
+	{
+		const UINT64 pixelStatisticsSize = sizeof(UINT32) * SCREEN_WIDTH * SCREEN_HEIGHT;
 
-			Base::Resources::DXR::Shaders::RayGenShaderTable[0].StrideInBytes = sizeof(MaxSize);
-			Base::Resources::DXR::Shaders::RayGenShaderTable[0].SizeInBytes = Base::Resources::DXR::Shaders::RayGenShaderTable[0].StrideInBytes * 1; //<-- only one for now...
-			Base::Resources::DXR::Shaders::RayGenShaderTable[0].Resource = createBuffer(Base::Resources::DXR::Shaders::RayGenShaderTable[0].SizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProperties);
+		D3D12_UNORDERED_ACCESS_VIEW_DESC pixelUavDesc = {};
+		pixelUavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+		pixelUavDesc.Format = DXGI_FORMAT_UNKNOWN;
+		pixelUavDesc.Buffer.NumElements = SCREEN_WIDTH * SCREEN_HEIGHT;
+		pixelUavDesc.Buffer.StructureByteStride = sizeof(UINT32);
 
+		for (int i = 0; i < 2; i++)
+		{
+			Base::Resources::RayStatistics::Dx12PixelResource[i] = createBuffer(pixelStatisticsSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, defaultHeapProps, MemoryCategory_Statistics);
+			if (Base::Resources::RayStatistics::Dx12PixelResource[i] == nullptr)
 			{
-				// Map the buffer
-				void* pData;
-				Base::Resources::DXR::Shaders::RayGenShaderTable[0].Resource->Map(0, nullptr, &pData);
-				memcpy(pData, &tableData, sizeof(tableData));
-				Base::Resources::DXR::Shaders::RayGenShaderTable[0].Resource->Unmap(0, nullptr);
+				std::cerr << "Error: Failed creating the pixel statistics buffers\n";
+				return 1;
 			}
 
-
-			//create table for the second UAV output
-			memcpy(tableData.ShaderIdentifier, pRtsoProps->GetShaderIdentifier(sRayGen), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-			tableData.RTVDescriptor = Base::Resources::DXR::Dx12RTDescriptorHeap[1]->GetGPUDescriptorHandleForHeapStart().ptr;
-
-			Base::Resources::DXR::Shaders::RayGenShaderTable[1].StrideInBytes = sizeof(MaxSize);
-			Base::Resources::DXR::Shaders::RayGenShaderTable[1].SizeInBytes = Base::Resources::DXR::Shaders::RayGenShaderTable[1].StrideInBytes * 1; //<-- only one for now...
-			Base::Resources::DXR::Shaders::RayGenShaderTable[1].Resource = createBuffer(Base::Resources::DXR::Shaders::RayGenShaderTable[1].SizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProperties);
-
-			{
-				// Map the buffer
-				void* pData;
-				Base::Resources::DXR::Shaders::RayGenShaderTable[1].Resource->Map(0, nullptr, &pData);
-				memcpy(pData, &tableData, sizeof(tableData));
-				Base::Resources::DXR::Shaders::RayGenShaderTable[1].Resource->Unmap(0, nullptr);
-			}
+			D3D12_CPU_DESCRIPTOR_HANDLE pixelUavHandle = Base::Resources::DXR::Dx12RTDescriptorHeap[i]->GetCPUDescriptorHandleForHeapStart();
+			pixelUavHandle.ptr += 2 * Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			Base::Dx12Device->CreateUnorderedAccessView(Base::Resources::RayStatistics::Dx12PixelResource[i], nullptr, &pixelUavDesc, pixelUavHandle);
 		}
 
-		//miss
+		Base::Resources::RayStatistics::Dx12PixelReadbackResource = createBuffer(pixelStatisticsSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, readbackHeapProps, MemoryCategory_Readback);
+		if (Base::Resources::RayStatistics::Dx12PixelReadbackResource == nullptr)
 		{
+			std::cerr << "Error: Failed creating the pixel statistics readback buffer\n";
+			return 1;
+		}
+	}
 
-			struct alignas(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT) MISS_SHADER_TABLE_DATA
-			{
-				unsigned char ShaderIdentifier[D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES];
-			} tableData;
+	std::cout << "Shader descriptors setup done\n";
+	return 0;
+}
 
-			memcpy(tableData.ShaderIdentifier, pRtsoProps->GetShaderIdentifier(sMiss), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
 
-			//how big is the biggest?
-			union MaxSize
-			{
-				MISS_SHADER_TABLE_DATA data0;
-			};
-
-			Base::Resources::DXR::Shaders::MissShaderTable.StrideInBytes = sizeof(MaxSize);
-			Base::Resources::DXR::Shaders::MissShaderTable.SizeInBytes = Base::Resources::DXR::Shaders::MissShaderTable.StrideInBytes * 1; //<-- only one for now...
-			Base::Resources::DXR::Shaders::MissShaderTable.Resource = createBuffer(Base::Resources::DXR::Shaders::MissShaderTable.SizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProperties);
-
-			// Map the buffer
-			void* pData;
-			Base::Resources::DXR::Shaders::MissShaderTable.Resource->Map(0, nullptr, &pData);
-			memcpy(pData, &tableData, sizeof(tableData));
-			Base::Resources::DXR::Shaders::MissShaderTable.Resource->Unmap(0, nullptr);
-		}
+// Creates a persistently mapped table sized for the builder's record layout and returns a builder writing into it
+template<typename Builder>
+Builder createShaderTable(ShaderTableData* table, UINT32 numRecords)
+{
+	table->StrideInBytes = Builder::StrideInBytes;
+	table->SizeInBytes = Builder::SizeInBytes(numRecords);
+	table->Resource = createBuffer(table->SizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProperties, MemoryCategory_ShaderTables);
+	table->Resource->Map(0, nullptr, &table->MappedData);
 
-		//hit programs
-		{
+	return Builder(table->MappedData, numRecords);
+}
 
-			struct alignas(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT) HIT_GROUP_MIRROR_SHADER_TABLE_DATA
-			{
-				unsigned char ShaderIdentifier[D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES];
-				UINT64 RTVDescriptor;
-				UINT64 vertDescriptor;
-				UINT64 indDescriptor;
-			} mirrorTableData{};
+int CreateShaderTables(RaytracingPipeline* pipeline)
+{
+	ID3D12StateObjectProperties* pRtsoProps = nullptr;
+	if (FAILED(pipeline->State->QueryInterface(IID_PPV_ARGS(&pRtsoProps))))
+	{
+		std::cerr << "Error: Failed getting ray tracing pipeline state properties\n";
+		return 1;
+	}
 
-			struct alignas(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT) HIT_GROUP_EDGES_SHADER_TABLE_DATA
-			{
-				unsigned char ShaderIdentifier[D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES];
-				float ShaderTableColor[3];
-			} edgesTableData{};
-
-			memcpy(mirrorTableData.ShaderIdentifier, pRtsoProps->GetShaderIdentifier(sHitGroupMirror), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-			mirrorTableData.RTVDescriptor = Base::Resources::DXR::TopBuffers.pResult->GetGPUVirtualAddress();
-			mirrorTableData.vertDescriptor = Base::Resources::Geometry::Dx12VBResources[0]->GetGPUVirtualAddress();
-			mirrorTableData.indDescriptor = Base::Resources::Geometry::Dx12IBResources[0]->GetGPUVirtualAddress();
-
-			memcpy(edgesTableData.ShaderIdentifier, pRtsoProps->GetShaderIdentifier(sHitGroupEdges), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-			edgesTableData.ShaderTableColor[0] = 2.0f / 3.0f;
-			edgesTableData.ShaderTableColor[1] = 2.0f / 3.0f;
-			edgesTableData.ShaderTableColor[2] = 1.0f;
-
-			//how big is the biggest?
-			union MaxSize
-			{
-				HIT_GROUP_MIRROR_SHADER_TABLE_DATA data0;
-				HIT_GROUP_EDGES_SHADER_TABLE_DATA data1;
-			};
-
-			Base::Resources::DXR::Shaders::HitGroupShaderTable.StrideInBytes = sizeof(MaxSize);
-			Base::Resources::DXR::Shaders::HitGroupShaderTable.SizeInBytes = Base::Resources::DXR::Shaders::HitGroupShaderTable.StrideInBytes * MODEL_PARTS;
-			Base::Resources::DXR::Shaders::HitGroupShaderTable.Resource = createBuffer(Base::Resources::DXR::Shaders::HitGroupShaderTable.SizeInBytes, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProperties);
-
-			// Map the buffer
-			void* pData;
-			Base::Resources::DXR::Shaders::HitGroupShaderTable.Resource->Map(0, nullptr, &pData);
-			memcpy(pData, &mirrorTableData, sizeof(mirrorTableData));
-			memcpy((void*)((char*)pData + sizeof(MaxSize)), &edgesTableData, sizeof(edgesTableData));
-			Base::Resources::DXR::Shaders::HitGroupShaderTable.Resource->Unmap(0, nullptr);
-		}
+	//raygen, one table per UAV output since the record points to the descriptor heap of that output
+	for (UINT i = 0; i < 2; i++)
+	{
+		RayGenShaderTableBuilder rayGenTable = createShaderTable<RayGenShaderTableBuilder>(&pipeline->RayGenShaderTable[i], 1);
+
+		ShaderRecords::RayGen rayGenRecord = {};
+		rayGenRecord.DescriptorTable = Base::Resources::DXR::Dx12RTDescriptorHeap[i]->GetGPUDescriptorHandleForHeapStart().ptr;
+		rayGenTable.write(0, pRtsoProps->GetShaderIdentifier(sRayGen), rayGenRecord);
+	}
+
+	//miss
+	MissShaderTableBuilder missTable = createShaderTable<MissShaderTableBuilder>(&pipeline->MissShaderTable, 1);
+	missTable.write(0, pRtsoProps->GetShaderIdentifier(sMiss));
+
+	//hit programs, one record per instance indexed by InstanceContributionToHitGroupIndex
+	HitGroupShaderTableBuilder hitGroupTable = createShaderTable<HitGroupShaderTableBuilder>(&pipeline->HitGroupShaderTable, MODEL_PARTS);
 
-		pRtsoProps->Release();
+	if (pipeline->Permutation.FlatNormals)
+	{
+		ShaderRecords::FlatMirrorHitGroup mirrorRecord = {};
+		mirrorRecord.Scene = Base::Resources::DXR::TopBuffers.pResult->GetGPUVirtualAddress();
+		mirrorRecord.FaceNormals = Base::Resources::Geometry::Dx12FaceNormalResources[MIRROR_PART]->GetGPUVirtualAddress();
+		hitGroupTable.write(MIRROR_PART, pRtsoProps->GetShaderIdentifier(sHitGroupMirror), mirrorRecord);
+	}
+	else
+	{
+		ShaderRecords::MirrorHitGroup mirrorRecord = {};
+		mirrorRecord.Scene = Base::Resources::DXR::TopBuffers.pResult->GetGPUVirtualAddress();
+		mirrorRecord.Vertecies = Base::Resources::Geometry::Dx12VBResources[MIRROR_PART]->GetGPUVirtualAddress();
+		mirrorRecord.Indecies = Base::Resources::Geometry::Dx12IBResources[MIRROR_PART]->GetGPUVirtualAddress();
+		hitGroupTable.write(MIRROR_PART, pRtsoProps->GetShaderIdentifier(sHitGroupMirror), mirrorRecord);
 	}
 
+	ShaderRecords::EdgesHitGroup edgesRecord = {};
+	edgesRecord.ShaderTableColor[0] = EdgesColor[0];
+	edgesRecord.ShaderTableColor[1] = EdgesColor[1];
+	edgesRecord.ShaderTableColor[2] = EdgesColor[2];
+	hitGroupTable.write(EDGES_PART, pRtsoProps->GetShaderIdentifier(sHitGroupEdges), edgesRecord);
+
+	pRtsoProps->Release();
+
 	std::cout << "Shader tables setup done\n";
 	return 0;
 }
@@ -1331,183 +2500,1028 @@ void SetResourceTransitionBarrier(ID3D12GraphicsCommandList* commandList, ID3D12
 	commandList->ResourceBarrier(1, &barrierDesc);
 }
 
-void RecordDispatchList(ID3D12CommandAllocator* commandAllocator, ID3D12GraphicsCommandList4* commandList, ID3D12DescriptorHeap* constantBufferDescriptorHeap, ShaderTableData* raygenTable)
+// pixelCapture is the pixel statistics buffer to copy to the readback buffer before the TLAS update, or nullptr
+void RecordUpdateList(ID3D12CommandAllocator* commandAllocator, ID3D12GraphicsCommandList4* commandList, ID3D12Resource1* pixelCapture, UINT outputIndex)
 {
+	PROFILE_SCOPE("RecordUpdateList");
 	commandAllocator->Reset();
 	commandList->Reset(commandAllocator, nullptr);
 
-	//Set constant buffer descriptor heap
-	ID3D12DescriptorHeap* descriptorHeaps[] = { constantBufferDescriptorHeap };
-	commandList->SetDescriptorHeaps(ARRAYSIZE(descriptorHeaps), descriptorHeaps);
+	if (pixelCapture != nullptr)
+	{
+		SetResourceTransitionBarrier(commandList, pixelCapture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		commandList->CopyResource(Base::Resources::RayStatistics::Dx12PixelReadbackResource, pixelCapture);
+		SetResourceTransitionBarrier(commandList, pixelCapture, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	}
+
+	ID3D12QueryHeap* queryHeap = Base::Resources::Timestamps::Dx12ComputeQueryHeap;
+	if (queryHeap != nullptr)
+	{
+		commandList->EndQuery(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, outputIndex * ComputeTimestamp_Count + ComputeTimestamp_TlasBegin);
+	}
 
 	//hack to update every frame...
 	createTopLevelAS(commandList);
 
+	if (queryHeap != nullptr)
+	{
+		commandList->EndQuery(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, outputIndex * ComputeTimestamp_Count + ComputeTimestamp_TlasEnd);
+	}
+
+	//Close the list to prepare it for execution.
+	commandList->Close();
+}
+
+void RecordDispatchList(ID3D12CommandAllocator* commandAllocator, ID3D12GraphicsCommandList4* commandList, ID3D12DescriptorHeap* constantBufferDescriptorHeap, RaytracingPipeline* pipeline, UINT outputIndex)
+{
+	PROFILE_SCOPE("RecordDispatchList");
+	commandAllocator->Reset();
+	commandList->Reset(commandAllocator, nullptr);
+
+	//Set constant buffer descriptor heap
+	ID3D12DescriptorHeap* descriptorHeaps[] = { constantBufferDescriptorHeap };
+	commandList->SetDescriptorHeaps(ARRAYSIZE(descriptorHeaps), descriptorHeaps);
+
 	// Let's raytrace
 	
+	// A checkerboard frame launches one ray for every other pixel of a row
+	const UINT renderWidth = Base::Resources::DXR::DispatchWidth;
+	const UINT renderHeight = Base::Resources::DXR::DispatchHeight;
 	D3D12_DISPATCH_RAYS_DESC raytraceDesc = {};
-	raytraceDesc.Width = SCREEN_WIDTH;
-	raytraceDesc.Height = SCREEN_HEIGHT;
+	raytraceDesc.Width = CHECKERBOARD_RENDERING ? (renderWidth + 1) / 2 : renderWidth;
+	raytraceDesc.Height = renderHeight;
+	Base::Resources::DXR::OutputDispatchSize[outputIndex].store(renderWidth << 16 | renderHeight, std::memory_order_release);
 	raytraceDesc.Depth = 1;
 
 	//set shader tables
-	raytraceDesc.RayGenerationShaderRecord.StartAddress = raygenTable->Resource->GetGPUVirtualAddress();
-	raytraceDesc.RayGenerationShaderRecord.SizeInBytes = raygenTable->SizeInBytes;
+	raytraceDesc.RayGenerationShaderRecord.StartAddress = pipeline->RayGenShaderTable[outputIndex].Resource->GetGPUVirtualAddress();
+	raytraceDesc.RayGenerationShaderRecord.SizeInBytes = pipeline->RayGenShaderTable[outputIndex].SizeInBytes;
 
-	raytraceDesc.MissShaderTable.StartAddress = Base::Resources::DXR::Shaders::MissShaderTable.Resource->GetGPUVirtualAddress();
-	raytraceDesc.MissShaderTable.StrideInBytes = Base::Resources::DXR::Shaders::MissShaderTable.StrideInBytes;
-	raytraceDesc.MissShaderTable.SizeInBytes = Base::Resources::DXR::Shaders::MissShaderTable.SizeInBytes;
+	raytraceDesc.MissShaderTable.StartAddress = pipeline->MissShaderTable.Resource->GetGPUVirtualAddress();
+	raytraceDesc.MissShaderTable.StrideInBytes = pipeline->MissShaderTable.StrideInBytes;
+	raytraceDesc.MissShaderTable.SizeInBytes = pipeline->MissShaderTable.SizeInBytes;
 
-	raytraceDesc.HitGroupTable.StartAddress = Base::Resources::DXR::Shaders::HitGroupShaderTable.Resource->GetGPUVirtualAddress();
-	raytraceDesc.HitGroupTable.StrideInBytes = Base::Resources::DXR::Shaders::HitGroupShaderTable.StrideInBytes;
-	raytraceDesc.HitGroupTable.SizeInBytes = Base::Resources::DXR::Shaders::HitGroupShaderTable.SizeInBytes;
+	raytraceDesc.HitGroupTable.StartAddress = pipeline->HitGroupShaderTable.Resource->GetGPUVirtualAddress();
+	raytraceDesc.HitGroupTable.StrideInBytes = pipeline->HitGroupShaderTable.StrideInBytes;
+	raytraceDesc.HitGroupTable.SizeInBytes = pipeline->HitGroupShaderTable.SizeInBytes;
 
 	// Bind the empty root signature
 	commandList->SetComputeRootSignature(Base::Resources::DXR::Dx12GlobalRS);
 
 	// Set parameters in global root signature
-	commandList->SetComputeRoot32BitConstant(0, MAX_RAY_DEPTH, 0);
-	commandList->SetComputeRoot32BitConstant(0, *(UINT*)((void*)&REFLECTON_BIAS), 1);
+	// Only read by shaders compiled without the permutation defines
+	commandList->SetComputeRoot32BitConstant(0, pipeline->Permutation.MaxRayDepth, 0);
+	commandList->SetComputeRoot32BitConstant(0, pipeline->Permutation.reflectionBiasBits(), 1);
+	commandList->SetComputeRoot32BitConstants(0, 1, &Base::Resources::DXR::ConeFootprintLimit, 2);
+	commandList->SetComputeRoot32BitConstants(0, 1, &RAY_TERMINATION_THRESHOLD, 3);
+	commandList->SetComputeRootUnorderedAccessView(1, Base::Resources::RayStatistics::Dx12CounterResource[outputIndex]->GetGPUVirtualAddress());
+	commandList->SetComputeRootConstantBufferView(2, Base::Resources::Checkerboard::Dx12FrameConstants[outputIndex]->GetGPUVirtualAddress());
 
 	// Dispatch
-	commandList->SetPipelineState1(Base::States::DXRPipelineState);
+	ID3D12QueryHeap* queryHeap = Base::Resources::Timestamps::Dx12ComputeQueryHeap;
+	const UINT firstQuery = outputIndex * ComputeTimestamp_Count;
+	commandList->SetPipelineState1(pipeline->State);
+	if (queryHeap != nullptr)
+	{
+		commandList->EndQuery(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstQuery + ComputeTimestamp_DispatchBegin);
+	}
 	commandList->DispatchRays(&raytraceDesc);
 
+	// Fill in the other half, each thread of the pass reads the four traced neighbours of one pixel
+	if (Base::Resources::Checkerboard::Dx12PipelineState != nullptr)
+	{
+		D3D12_RESOURCE_BARRIER uavBarrier = {};
+		uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+		uavBarrier.UAV.pResource = Base::Resources::DXR::Dx12OutputResource[outputIndex];
+		commandList->ResourceBarrier(1, &uavBarrier);
+
+		commandList->SetComputeRootSignature(Base::Resources::Checkerboard::Dx12RootSignature);
+		commandList->SetComputeRootDescriptorTable(0, constantBufferDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+		commandList->SetComputeRootConstantBufferView(1, Base::Resources::Checkerboard::Dx12FrameConstants[outputIndex]->GetGPUVirtualAddress());
+		commandList->SetPipelineState(Base::Resources::Checkerboard::Dx12PipelineState);
+		commandList->Dispatch((raytraceDesc.Width + 7) / 8, (raytraceDesc.Height + 7) / 8, 1);
+	}
+
+	if (queryHeap != nullptr)
+	{
+		commandList->EndQuery(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstQuery + ComputeTimestamp_DispatchEnd);
+
+		//Resolves the update list's queries of the slot as well, they ran earlier on the same queue
+		commandList->ResolveQueryData(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstQuery, ComputeTimestamp_Count,
+			Base::Resources::Timestamps::Dx12ComputeReadbackResource, sizeof(UINT64) * firstQuery);
+	}
+
+	// Copy the running totals out. They are read when the compute loop comes back to this frame slot
+	SetResourceTransitionBarrier(commandList, Base::Resources::RayStatistics::Dx12CounterResource[outputIndex], D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	commandList->CopyBufferRegion(Base::Resources::RayStatistics::Dx12ReadbackResource[outputIndex], 0, Base::Resources::RayStatistics::Dx12CounterResource[outputIndex], 0, sizeof(RayStatisticsTotals));
+	SetResourceTransitionBarrier(commandList, Base::Resources::RayStatistics::Dx12CounterResource[outputIndex], D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
 	//Close the list to prepare it for execution.
 	commandList->Close();
 }
 
-void RecordPresentList(ID3D12CommandAllocator* commandAllocator, ID3D12GraphicsCommandList4* commandList, UINT backBufferIndex, ID3D12Resource1* outputResource)
+// Rasterises the first hits for the frame on the visibility queue, with the instance transform the update list was just
+// recorded with. Re-recorded every frame since the transform changes. Returns the fence value the dispatch has to wait for
+UINT64 RecordVisibilityList(UINT outputIndex)
 {
+	PROFILE_SCOPE("RecordVisibilityList");
+	ID3D12CommandAllocator* commandAllocator = Base::Queues::Visibility::Dx12CommandAllocator[outputIndex];
+	ID3D12GraphicsCommandList4* commandList = Base::Queues::Visibility::Dx12CommandList4[outputIndex];
+	ID3D12Resource1* visibility = Base::Resources::Visibility::Dx12VisibilityResource[outputIndex];
+	commandAllocator->Reset();
+	commandList->Reset(commandAllocator, Base::Resources::Visibility::Dx12PipelineState);
+
+	const UINT32 renderSize = Base::Resources::DXR::OutputDispatchSize[outputIndex].load(std::memory_order_relaxed);
+	const UINT width = renderSize >> 16;
+	const UINT height = renderSize & 0xFFFF;
+
+	D3D12_VIEWPORT viewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
+	D3D12_RECT scissorRect = { 0, 0, (LONG)width, (LONG)height };
+
+	D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = Base::Resources::Visibility::Dx12RTVDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	rtvHandle.ptr += outputIndex * Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+	D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = Base::Resources::Visibility::Dx12DSVDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+
+	SetResourceTransitionBarrier(commandList, visibility, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	const float clearColor[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	commandList->ClearRenderTargetView(rtvHandle, clearColor, 1, &scissorRect);
+	commandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 1, &scissorRect);
+	commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, &dsvHandle);
+	commandList->RSSetViewports(1, &viewport);
+	commandList->RSSetScissorRects(1, &scissorRect);
+	commandList->SetGraphicsRootSignature(Base::Resources::Visibility::Dx12RootSignature);
+	commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	VisibilityConstants constants = {};
+	constants.ObjectToWorld = Base::Animation::Transform;
+	constants.PixelOffset[0] = 1.0f / (float)width;
+	constants.PixelOffset[1] = -1.0f / (float)height;
+	constants.AspectRatio = (float)width / (float)height;
+	memcpy(constants.EdgesColor, EdgesColor, sizeof(constants.EdgesColor));
+	constants.FlatNormals = Base::States::Pipeline->Permutation.FlatNormals ? 1 : 0;
+
+	for (UINT i = 0; i < MODEL_PARTS; i++)
+	{
+		constants.Instance = i;
+		commandList->SetGraphicsRoot32BitConstants(0, sizeof(VisibilityConstants) / 4, &constants, 0);
+
+		//The root SRV has to point at something even where the shader doesn't read it
+		ID3D12Resource1* faceNormals = Base::Resources::Geometry::Dx12FaceNormalResources[i];
+		commandList->SetGraphicsRootShaderResourceView(1, (faceNormals != nullptr ? faceNormals : Base::Resources::Geometry::Dx12VBResources[i])->GetGPUVirtualAddress());
+
+		D3D12_VERTEX_BUFFER_VIEW vertexBufferView = {};
+		vertexBufferView.BufferLocation = Base::Resources::Geometry::Dx12VBResources[i]->GetGPUVirtualAddress();
+		vertexBufferView.SizeInBytes = sizeof(Vertex) * Base::Resources::Geometry::numVertecies[i];
+		vertexBufferView.StrideInBytes = sizeof(Vertex);
+		commandList->IASetVertexBuffers(0, 1, &vertexBufferView);
+
+		D3D12_INDEX_BUFFER_VIEW indexBufferView = {};
+		indexBufferView.BufferLocation = Base::Resources::Geometry::Dx12IBResources[i]->GetGPUVirtualAddress();
+		indexBufferView.SizeInBytes = sizeof(uint32_t) * Base::Resources::Geometry::numIndecies[i];
+		indexBufferView.Format = DXGI_FORMAT_R32_UINT;
+		commandList->IASetIndexBuffer(&indexBufferView);
+
+		commandList->DrawIndexedInstanced(Base::Resources::Geometry::numIndecies[i], 1, 0, 0, 0);
+	}
+
+	SetResourceTransitionBarrier(commandList, visibility, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	commandList->Close();
+
+	ID3D12CommandList* listsToExecute[] = { commandList };
+	Base::Queues::Visibility::Dx12Queue->ExecuteCommandLists(ARRAYSIZE(listsToExecute), listsToExecute);
+	Base::Queues::Visibility::Dx12Queue->Signal(Base::Synchronization::Visibility::Dx12Fence, ++Base::Synchronization::Visibility::FenceValue);
+	return Base::Synchronization::Visibility::FenceValue;
+}
+
+// Forces the dispatch lists to be recorded again the next time their frame slot is used,
+// needed whenever anything recorded in them (pipeline state, shader tables, descriptors) is replaced
+void InvalidateDispatchLists()
+{
+	Base::Queues::Compute::DispatchLists.invalidate();
+}
+
+// Copies the output to the backbuffer, and into a capture buffer when the frame is captured. Headless runs pass no backbuffer.
+// An output rendered at a reduced resolution is first scaled up to full size into the upscale target, which is then copied instead
+void RecordPresentList(ID3D12CommandAllocator* commandAllocator, ID3D12GraphicsCommandList4* commandList, ID3D12Resource1* backBuffer, ID3D12Resource1* outputResource, ID3D12Resource1* captureBuffer, UINT outputIndex)
+{
+	PROFILE_SCOPE("RecordPresentList");
 	commandAllocator->Reset();
 	commandList->Reset(commandAllocator, nullptr);
 
+	ID3D12QueryHeap* queryHeap = Base::Resources::Timestamps::Dx12DirectQueryHeap;
+	const UINT firstQuery = outputIndex * DirectTimestamp_Count;
+
+	const UINT32 dispatchSize = Base::Resources::DXR::OutputDispatchSize[outputIndex].load(std::memory_order_acquire);
+	const bool upscale = dispatchSize != (SCREEN_WIDTH << 16 | SCREEN_HEIGHT) && Base::Resources::Upscale::Dx12PipelineState != nullptr;
+	ID3D12Resource1* copySource = upscale ? Base::Resources::Upscale::Dx12TargetResource : outputResource;
+
+	if (backBuffer != nullptr && queryHeap != nullptr)
+	{
+		commandList->EndQuery(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstQuery + DirectTimestamp_CopyBegin);
+	}
+
+	if (upscale)
+	{
+		SetResourceTransitionBarrier(commandList, outputResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+		ID3D12DescriptorHeap* descriptorHeaps[] = { Base::Resources::Upscale::Dx12DescriptorHeap };
+		commandList->SetDescriptorHeaps(ARRAYSIZE(descriptorHeaps), descriptorHeaps);
+		commandList->SetComputeRootSignature(Base::Resources::Upscale::Dx12RootSignature);
+
+		//CB_Upscale
+		const UINT32 sizes[4] = { dispatchSize >> 16, dispatchSize & 0xFFFF, SCREEN_WIDTH, SCREEN_HEIGHT };
+		commandList->SetComputeRoot32BitConstants(0, 4, sizes, 0);
+
+		D3D12_GPU_DESCRIPTOR_HANDLE table = Base::Resources::Upscale::Dx12DescriptorHeap->GetGPUDescriptorHandleForHeapStart();
+		table.ptr += 2 * outputIndex * Base::Dx12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		commandList->SetComputeRootDescriptorTable(1, table);
+
+		commandList->SetPipelineState(Base::Resources::Upscale::Dx12PipelineState);
+		commandList->Dispatch((SCREEN_WIDTH + 7) / 8, (SCREEN_HEIGHT + 7) / 8, 1);
+
+		SetResourceTransitionBarrier(commandList, copySource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	}
+	else
+	{
+		SetResourceTransitionBarrier(commandList, outputResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	}
+
 	// Copy the results to the back-buffer
-	SetResourceTransitionBarrier(commandList, outputResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-	SetResourceTransitionBarrier(commandList, Base::Resources::Backbuffers::Dx12RTVResources[backBufferIndex], D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST);
-	commandList->CopyResource(Base::Resources::Backbuffers::Dx12RTVResources[backBufferIndex], outputResource);
+	if (backBuffer != nullptr)
+	{
+		SetResourceTransitionBarrier(commandList, backBuffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST);
+		commandList->CopyResource(backBuffer, copySource);
+		if (queryHeap != nullptr)
+		{
+			commandList->EndQuery(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstQuery + DirectTimestamp_CopyEnd);
+			commandList->ResolveQueryData(queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstQuery, DirectTimestamp_Count,
+				Base::Resources::Timestamps::Dx12DirectReadbackResource, sizeof(UINT64) * firstQuery);
+		}
+
+		//Indicate that the back buffer will now be used to present
+		SetResourceTransitionBarrier(commandList, backBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
+	}
 
+	if (captureBuffer != nullptr)
+	{
+		D3D12_TEXTURE_COPY_LOCATION destination = {};
+		destination.pResource = captureBuffer;
+		destination.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		destination.PlacedFootprint = Base::Resources::Capture::Footprint;
+
+		D3D12_TEXTURE_COPY_LOCATION source = {};
+		source.pResource = copySource;
+		source.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+		source.SubresourceIndex = 0;
 
-	//Indicate that the back buffer will now be used to present and ray output be used as UAV.
-	SetResourceTransitionBarrier(commandList, Base::Resources::Backbuffers::Dx12RTVResources[backBufferIndex], D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
-	SetResourceTransitionBarrier(commandList, outputResource, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		commandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+	}
+
+	//The ray output, and the upscale target, go back to being used as UAV
+	if (upscale)
+	{
+		SetResourceTransitionBarrier(commandList, copySource, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		SetResourceTransitionBarrier(commandList, outputResource, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	}
+	else
+	{
+		SetResourceTransitionBarrier(commandList, outputResource, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	}
 
 	//Close the list to prepare it for execution.
 	commandList->Close();
 }
 
 
+// Blocks until the fence reaches the value or shutdown is signaled. Returns false when the loop should exit
+bool WaitForFenceOrShutdown(ID3D12Fence1* fence, UINT64 value, HANDLE eventHandle)
+{
+	PROFILE_SCOPE("Wait for frame slot");
+	if (fence->GetCompletedValue() < value)
+	{
+		fence->SetEventOnCompletion(value, eventHandle);
+		HANDLE handles[] = { eventHandle, ShutdownSignalHandle() };
+		WaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE);
+	}
+	return !ShutdownSignaled();
+}
+
+// Updates the TLAS and dispatches the rays into the output of the frame slot
+// Takes over a pipeline the reload thread has finished, without waiting on anything.
+// The dispatch of the other output may still be running with the old pipeline, so it is retired behind a fence
+// signaled after that dispatch and released once the fence has passed
+void SwapReloadedPipeline()
+{
+	if (Base::ShaderReload::Retired != nullptr)
+	{
+		if (Base::ShaderReload::RetireFence->GetCompletedValue() < Base::ShaderReload::RetireFenceValue)
+		{
+			return; //a newer pipeline has to wait until the previous swap is done
+		}
+		SafeDelete(Base::ShaderReload::Retired);
+	}
+
+	RaytracingPipeline* pipeline = Base::ShaderReload::Pending.exchange(nullptr);
+	if (pipeline == nullptr)
+	{
+		return;
+	}
+
+	Base::ShaderReload::Retired = Base::States::Pipeline;
+	Base::States::Pipeline = pipeline;
+	Base::Queues::Compute::Dx12Queue->Signal(Base::ShaderReload::RetireFence, ++Base::ShaderReload::RetireFenceValue);
+
+	//The static dispatch lists reference the old state object and tables
+	InvalidateDispatchLists();
+
+	{
+		std::lock_guard<std::mutex> lock(Base::ShaderReload::SwapMutex);
+	}
+	Base::ShaderReload::Swapped.notify_all();
+
+	std::cout << "Ray tracing shaders reloaded\n";
+}
+
+// Reads the counters of the last dispatch in the frame slot, which the fence wait before the next dispatch has made visible.
+// The totals are 32 bit and allowed to wrap, the per frame difference stays correct
+void ReadRayStatistics(UINT outputIndex)
+{
+	RayStatisticsTotals* pTotals = nullptr;
+	D3D12_RANGE readRange = { 0, sizeof(RayStatisticsTotals) };
+	if (FAILED(Base::Resources::RayStatistics::Dx12ReadbackResource[outputIndex]->Map(0, &readRange, (void**)&pTotals)))
+	{
+		return;
+	}
+	RayStatisticsTotals totals = *pTotals;
+	D3D12_RANGE writeRange = { 0, 0 };
+	Base::Resources::RayStatistics::Dx12ReadbackResource[outputIndex]->Unmap(0, &writeRange);
+
+	//Nothing has been copied out before the first dispatch of the slot, and the counters start out uninitialized,
+	//so the first real readback only sets the baseline
+	if (Base::RayStatistics::Readbacks[outputIndex] < 2)
+	{
+		Base::RayStatistics::LastTotals[outputIndex] = totals;
+		Base::RayStatistics::Readbacks[outputIndex]++;
+		return;
+	}
+
+	const RayStatisticsTotals& last = Base::RayStatistics::LastTotals[outputIndex];
+	UINT32 coneBouncesSaved = totals.ConeBouncesSaved - last.ConeBouncesSaved;
+	UINT32 rayDepthSum = totals.RayDepthSum - last.RayDepthSum;
+	UINT32 throughputTerminations = totals.ThroughputTerminations - last.ThroughputTerminations;
+	Base::RayStatistics::LastTotals[outputIndex] = totals;
+
+	if (RAY_STATISTICS_REPORT_FRAMES == 0)
+	{
+		return;
+	}
+
+	Base::RayStatistics::ReportConeBouncesSaved += coneBouncesSaved;
+	Base::RayStatistics::ReportRayDepthSum += rayDepthSum;
+	Base::RayStatistics::ReportThroughputTerminations += throughputTerminations;
+	if (++Base::RayStatistics::ReportFrames >= RAY_STATISTICS_REPORT_FRAMES)
+	{
+		const UINT32 frames = Base::RayStatistics::ReportFrames;
+		const double tracedPixels = (double)Base::Resources::DXR::DispatchWidth * Base::Resources::DXR::DispatchHeight * (CHECKERBOARD_RENDERING ? 0.5 : 1.0);
+		std::cout << "Ray statistics over " << frames << " frames: average depth " << (double)Base::RayStatistics::ReportRayDepthSum / (frames * tracedPixels)
+			<< ", cone termination saved " << Base::RayStatistics::ReportConeBouncesSaved / frames << " bounces per frame"
+			<< ", " << Base::RayStatistics::ReportThroughputTerminations / frames << " rays per frame stopped by the termination policy\n";
+		Base::RayStatistics::ReportConeBouncesSaved = 0;
+		Base::RayStatistics::ReportRayDepthSum = 0;
+		Base::RayStatistics::ReportThroughputTerminations = 0;
+		Base::RayStatistics::ReportFrames = 0;
+		Base::Timestamps::Statistics.report(std::cout);
+	}
+}
+
+// Copies the timestamps the lists of the frame slot resolved last time, which the fence wait for the slot has made visible
+bool ReadTimestamps(ID3D12Resource1* readbackResource, UINT outputIndex, UINT count, UINT64* pTimestamps)
+{
+	UINT64* pMapped = nullptr;
+	D3D12_RANGE readRange = { sizeof(UINT64) * outputIndex * count, sizeof(UINT64) * (outputIndex + 1) * count };
+	if (FAILED(readbackResource->Map(0, &readRange, (void**)&pMapped)))
+	{
+		return false;
+	}
+	memcpy(pTimestamps, pMapped + outputIndex * count, sizeof(UINT64) * count);
+	D3D12_RANGE writeRange = { 0, 0 };
+	readbackResource->Unmap(0, &writeRange);
+	return true;
+}
+
+// Nothing has been resolved before the first frame of a slot
+void ReadComputeTimestamps(UINT outputIndex)
+{
+	if (Base::Resources::Timestamps::Dx12ComputeQueryHeap == nullptr)
+	{
+		return;
+	}
+	if (!Base::Timestamps::ComputeResolved[outputIndex])
+	{
+		Base::Timestamps::ComputeResolved[outputIndex] = true;
+		return;
+	}
+
+	UINT64 timestamps[ComputeTimestamp_Count];
+	if (ReadTimestamps(Base::Resources::Timestamps::Dx12ComputeReadbackResource, outputIndex, ComputeTimestamp_Count, timestamps))
+	{
+		const UINT64 frequency = Base::Resources::Timestamps::ComputeFrequency;
+		Base::Timestamps::Statistics.addSample(GpuPass_TlasBuild, timestamps[ComputeTimestamp_TlasBegin], timestamps[ComputeTimestamp_TlasEnd], frequency);
+		Base::Timestamps::Statistics.addSample(GpuPass_DispatchRays, timestamps[ComputeTimestamp_DispatchBegin], timestamps[ComputeTimestamp_DispatchEnd], frequency);
+
+		double dispatchMilliseconds = GpuTimingStatistics::ticksToMilliseconds(timestamps[ComputeTimestamp_DispatchBegin], timestamps[ComputeTimestamp_DispatchEnd], frequency);
+		if (dispatchMilliseconds >= 0.0)
+		{
+			Base::FrameMetrics::Statistics.record(FrameMetric_DispatchTime, (uint64_t)(dispatchMilliseconds * 1000.0));
+		}
+	}
+}
+
+void ReadDirectTimestamps(UINT outputIndex)
+{
+	if (Base::Resources::Timestamps::Dx12DirectQueryHeap == nullptr)
+	{
+		return;
+	}
+	if (!Base::Timestamps::DirectResolved[outputIndex])
+	{
+		Base::Timestamps::DirectResolved[outputIndex] = true;
+		return;
+	}
+
+	UINT64 timestamps[DirectTimestamp_Count];
+	if (ReadTimestamps(Base::Resources::Timestamps::Dx12DirectReadbackResource, outputIndex, DirectTimestamp_Count, timestamps))
+	{
+		Base::Timestamps::Statistics.addSample(GpuPass_Copy, timestamps[DirectTimestamp_CopyBegin], timestamps[DirectTimestamp_CopyEnd], Base::Resources::Timestamps::DirectFrequency);
+	}
+}
+
+// Decides whether this dispatch copies out the pixel statistics, and writes them out once the copy has finished.
+// Returns the buffer the update list should copy, or nullptr
+ID3D12Resource1* CapturePixelStatistics(UINT outputIndex)
+{
+	if (Base::RayStatistics::PixelCaptureDone || !Base::States::Pipeline->Permutation.Instrumentation)
+	{
+		return nullptr;
+	}
+
+	//The fence wait before this dispatch covers the copy recorded the last time the slot was used
+	if (Base::RayStatistics::PixelCaptureSlot == (int)outputIndex)
+	{
+		UINT32* pPixels = nullptr;
+		D3D12_RANGE readRange = { 0, sizeof(UINT32) * SCREEN_WIDTH * SCREEN_HEIGHT };
+		if (SUCCEEDED(Base::Resources::RayStatistics::Dx12PixelReadbackResource->Map(0, &readRange, (void**)&pPixels)))
+		{
+			WritePixelStatistics(pPixels, Base::RayStatistics::PixelCaptureSize >> 16, Base::RayStatistics::PixelCaptureSize & 0xFFFF, Base::States::Pipeline->Permutation.MaxRayDepth, RAY_INSTRUMENTATION_OUTPUT);
+			D3D12_RANGE writeRange = { 0, 0 };
+			Base::Resources::RayStatistics::Dx12PixelReadbackResource->Unmap(0, &writeRange);
+		}
+		Base::RayStatistics::PixelCaptureDone = true;
+		return nullptr;
+	}
+
+	//The buffer of this slot still holds the last dispatch made with it
+	if (Base::RayStatistics::PixelCaptureSlot < 0 && ++Base::RayStatistics::InstrumentedFrames > RAY_INSTRUMENTATION_CAPTURE_FRAME)
+	{
+		Base::RayStatistics::PixelCaptureSlot = (int)outputIndex;
+		Base::RayStatistics::PixelCaptureSize = Base::Resources::DXR::OutputDispatchSize[outputIndex].load(std::memory_order_relaxed);
+		return Base::Resources::RayStatistics::Dx12PixelResource[outputIndex];
+	}
+
+	return nullptr;
+}
+
+// Applies a requested benchmark point and times the interval since the previous dispatch.
+// The loops are throttled by the fences, so in steady state that interval is the frame time
+void UpdateBenchmark()
+{
+	if (!Base::Benchmark::Active)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(Base::Benchmark::Mutex);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	if (Base::Benchmark::PointRequested)
+	{
+		Base::Benchmark::PointRequested = false;
+		Base::Benchmark::Recording = true;
+		Base::Benchmark::FramesDispatched = 0;
+		Base::Benchmark::FrameTimes.clear();
+
+		Base::Resources::DXR::DispatchWidth = Base::Benchmark::Width;
+		Base::Resources::DXR::DispatchHeight = Base::Benchmark::Height;
+		InvalidateDispatchLists();
+
+		//Every point starts the animation over
+		Base::Animation::Frame = 0;
+	}
+	else if (Base::Benchmark::Recording)
+	{
+		if (++Base::Benchmark::FramesDispatched > Base::Benchmark::WarmupFrames)
+		{
+			Base::Benchmark::FrameTimes.push_back(std::chrono::duration<double, std::milli>(now - Base::Benchmark::LastDispatch).count());
+		}
+
+		if (Base::Benchmark::FrameTimes.size() >= Base::Benchmark::Frames)
+		{
+			Base::Benchmark::Recording = false;
+			Base::Benchmark::PointDone.notify_all();
+		}
+	}
+
+	Base::Benchmark::LastDispatch = now;
+}
+
+uint64_t elapsedMicroseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+// Records the interval since the previous dispatch and asks for the metrics file to be rewritten every FRAME_STATISTICS_EXPORT_FRAMES frames.
+// The file is written on the export thread so the write doesn't land in the frame times it reports. Returns the interval, 0 for the first frame
+uint64_t RecordFrameTime()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	uint64_t frameMicroseconds = 0;
+	if (Base::FrameMetrics::FramesDispatched++ > 0)
+	{
+		frameMicroseconds = elapsedMicroseconds(Base::FrameMetrics::LastDispatch, now);
+		Base::FrameMetrics::Statistics.record(FrameMetric_FrameTime, frameMicroseconds);
+	}
+	Base::FrameMetrics::LastDispatch = now;
+
+	if (FRAME_STATISTICS_EXPORT_FRAMES != 0 && Base::FrameMetrics::FramesDispatched % FRAME_STATISTICS_EXPORT_FRAMES == 0)
+	{
+		std::lock_guard<std::mutex> lock(Base::FrameMetrics::ExportMutex);
+		Base::FrameMetrics::ExportPending = true;
+		Base::FrameMetrics::ExportRequested.notify_one();
+	}
+	return frameMicroseconds;
+}
+
+// Re-records the dispatch lists at a new size whenever the controller changes the scale
+void UpdateDynamicResolution(uint64_t frameMicroseconds)
+{
+	if (!DYNAMIC_RESOLUTION || Base::Benchmark::Active || frameMicroseconds == 0)
+	{
+		return;
+	}
+
+	if (Base::DynamicResolution::Controller.addFrame(frameMicroseconds / 1000.0))
+	{
+		float scale = Base::DynamicResolution::Controller.scale();
+		Base::Resources::DXR::DispatchWidth = DynamicResolutionController::scaledSize(SCREEN_WIDTH, scale);
+		Base::Resources::DXR::DispatchHeight = DynamicResolutionController::scaledSize(SCREEN_HEIGHT, scale);
+		InvalidateDispatchLists();
+	}
+}
+
+// The previous frame of the slot traced the other half only if it was rendered at the same size.
+// The parity flips every time the slot is used, so both outputs cover every pixel every two frames
+void UpdateFrameConstants(UINT outputIndex)
+{
+	const UINT32 renderSize = Base::Resources::DXR::OutputDispatchSize[outputIndex].load(std::memory_order_relaxed);
+
+	CheckerboardConstants constants = {};
+	const UINT32 slotFrames = Base::Resources::Checkerboard::FramesRendered[outputIndex]++;
+	constants.Checkerboard = CHECKERBOARD_RENDERING ? 1 : 0;
+	constants.CheckerboardParity = slotFrames & 1;
+	constants.FrameIndex = slotFrames * 2 + outputIndex; //the slots take turns
+	constants.RenderWidth = renderSize >> 16;
+	constants.RenderHeight = renderSize & 0xFFFF;
+	constants.HistoryValid = Base::Resources::Checkerboard::HistorySize[outputIndex] == renderSize ? 1 : 0;
+	Base::Resources::Checkerboard::HistorySize[outputIndex] = renderSize;
+
+	//The fence wait for the slot covers the last dispatch that read the buffer
+	*Base::Resources::Checkerboard::MappedFrameConstants[outputIndex] = constants;
+}
+
+HistogramSnapshot GetFrameStatistics(FrameMetric metric)
+{
+	return Base::FrameMetrics::Statistics.snapshot(metric);
+}
+
+void DispatchOutput(UINT outputIndex, UINT64 releaseFenceValue)
+{
+	PROFILE_SCOPE("DispatchOutput");
+	SwapReloadedPipeline();
+	UpdateBenchmark();
+	UpdateDynamicResolution(RecordFrameTime());
+	ReadRayStatistics(outputIndex);
+	ReadComputeTimestamps(outputIndex);
+
+	RecordUpdateList(Base::Queues::Compute::Dx12CommandAllocator[outputIndex],
+						Base::Queues::Compute::Dx12CommandList4[outputIndex],
+						CapturePixelStatistics(outputIndex),
+						outputIndex);
+
+	if (Base::Queues::Compute::DispatchLists.needsRecording(outputIndex))
+	{
+		RecordDispatchList(Base::Queues::Compute::Dx12DispatchCommandAllocator[outputIndex],
+							Base::Queues::Compute::Dx12DispatchCommandList4[outputIndex],
+							Base::Resources::DXR::Dx12RTDescriptorHeap[outputIndex],
+							Base::States::Pipeline,
+							outputIndex);
+		Base::Queues::Compute::DispatchLists.markRecorded(outputIndex);
+	}
+	UpdateFrameConstants(outputIndex);
+
+	//The slot's fence already covers the last dispatch that read its visibility buffer
+	if (Base::States::Pipeline->Permutation.HybridPrimary)
+	{
+		Base::Queues::Compute::Dx12Queue->Wait(Base::Synchronization::Visibility::Dx12Fence, RecordVisibilityList(outputIndex));
+	}
+
+	{
+		//Execute the command lists. The TLAS update ends in a UAV barrier, so the dispatch sees the new instances
+		ID3D12CommandList* listsToExecute[] = { Base::Queues::Compute::Dx12CommandList4[outputIndex], Base::Queues::Compute::Dx12DispatchCommandList4[outputIndex] };
+		Base::Queues::Compute::Dx12Queue->ExecuteCommandLists(ARRAYSIZE(listsToExecute), listsToExecute);
+	}
+	Base::Queues::Compute::Dx12Queue->Signal(Base::Synchronization::Dx12Fence[outputIndex], releaseFenceValue);
+}
+
 void ComputeLoop()
 {
+	Profiler::setThreadName("Compute loop");
 	UINT64 dispatch1FenceValue = 0;
 	UINT64 dispatch2FenceValue = 0;
 	while (true)
 	{
 		//First UAV
-		if (Base::Synchronization::Dx12Fence[0]->GetCompletedValue() < dispatch1FenceValue)
-		{
-			Base::Synchronization::Dx12Fence[0]->SetEventOnCompletion(dispatch1FenceValue, Base::Synchronization::ComputeLoop::EventHandle);
-			WaitForSingleObject(Base::Synchronization::ComputeLoop::EventHandle, EVENT_TIMEOUT_MILLISECONDS);
-		}
-		if (Base::Synchronization::terminate) break;
+		if (!WaitForFenceOrShutdown(Base::Synchronization::Dx12Fence[0], dispatch1FenceValue, Base::Synchronization::ComputeLoop::EventHandle)) break;
 
-		RecordDispatchList(Base::Queues::Compute::Dx12CommandAllocator[0], 
-							Base::Queues::Compute::Dx12CommandList4[0], 
-							Base::Resources::DXR::Dx12RTDescriptorHeap[0], 
-							&Base::Resources::DXR::Shaders::RayGenShaderTable[0]);
-		{
-			//Execute the command list.
-			ID3D12CommandList* listsToExecute[] = { Base::Queues::Compute::Dx12CommandList4[0]};
-			Base::Queues::Compute::Dx12Queue->ExecuteCommandLists(ARRAYSIZE(listsToExecute), listsToExecute);
-		}
-		Base::Queues::Compute::Dx12Queue->Signal(Base::Synchronization::Dx12Fence[0], dispatch1FenceValue + 1);
+		DispatchOutput(0, dispatch1FenceValue + 1);
 		dispatch1FenceValue += 2;
 		//
 
 		//Second UAV
-		if (Base::Synchronization::Dx12Fence[1]->GetCompletedValue() < dispatch2FenceValue)
+		if (!WaitForFenceOrShutdown(Base::Synchronization::Dx12Fence[1], dispatch2FenceValue, Base::Synchronization::ComputeLoop::EventHandle)) break;
+
+		DispatchOutput(1, dispatch2FenceValue + 1);
+		dispatch2FenceValue += 2;
+		//
+	}
+}
+
+// Returns the capture buffer for this frame if it is due for capture, or nullptr.
+// A due frame is skipped instead of waited for when the encoder still holds every buffer
+ID3D12Resource1* BeginCapture(UINT* pSlot)
+{
+	if (CAPTURE_FRAME_INTERVAL == 0 || Base::Capture::FramesPresented++ % CAPTURE_FRAME_INTERVAL != 0)
+	{
+		return nullptr;
+	}
+
+	UINT slot = Base::Capture::NextSlot;
+	if (Base::Capture::SlotBusy[slot].exchange(true, std::memory_order_acquire))
+	{
+		Base::Capture::FramesSkipped++;
+		return nullptr;
+	}
+	Base::Capture::NextSlot = (slot + 1) % CAPTURE_RING_SIZE;
+
+	*pSlot = slot;
+	return Base::Resources::Capture::Dx12ReadbackResource[slot];
+}
+
+// Hands the frame to the encoder thread, which waits for the copy to finish on its own
+void SubmitCapture(UINT slot, ID3D12Fence1* fence, UINT64 fenceValue)
+{
+	char fileName[64];
+	snprintf(fileName, sizeof(fileName), "%s_%06llu.%s", CAPTURE_OUTPUT, (unsigned long long)(Base::Capture::FramesPresented - 1), CAPTURE_PNG ? "png" : "ppm");
+
+	CaptureFrame frame;
+	frame.Width = SCREEN_WIDTH;
+	frame.Height = SCREEN_HEIGHT;
+	frame.RowPitch = Base::Resources::Capture::Footprint.Footprint.RowPitch;
+	frame.Format = CAPTURE_PNG ? CaptureFormat_Png : CaptureFormat_Ppm;
+	frame.FilePath = fileName;
+	frame.Acquire = [slot, fence, fenceValue]() -> const uint8_t*
+	{
+		if (fence->GetCompletedValue() < fenceValue)
 		{
-			Base::Synchronization::Dx12Fence[1]->SetEventOnCompletion(dispatch2FenceValue, Base::Synchronization::ComputeLoop::EventHandle);
-			WaitForSingleObject(Base::Synchronization::ComputeLoop::EventHandle, EVENT_TIMEOUT_MILLISECONDS);
+			fence->SetEventOnCompletion(fenceValue, Base::Capture::EventHandle);
+			WaitForSingleObject(Base::Capture::EventHandle, INFINITE);
 		}
-		if (Base::Synchronization::terminate) break;
+		return Base::Resources::Capture::MappedPixels[slot];
+	};
+	frame.Release = [slot]()
+	{
+		Base::Capture::SlotBusy[slot].store(false, std::memory_order_release);
+	};
+	Base::Capture::Encoder.submit(std::move(frame));
+}
+
+// Copies the output to the current backbuffer and presents it. Headless runs only hand the output back to the compute loop,
+// unless the frame is captured
+void PresentOutput(UINT outputIndex, UINT64 releaseFenceValue)
+{
+	PROFILE_SCOPE("PresentOutput");
+	UINT captureSlot = 0;
+	ID3D12Resource1* captureBuffer = BeginCapture(&captureSlot);
 
-		RecordDispatchList(Base::Queues::Compute::Dx12CommandAllocator[1],
-							Base::Queues::Compute::Dx12CommandList4[1],
-							Base::Resources::DXR::Dx12RTDescriptorHeap[1],
-							&Base::Resources::DXR::Shaders::RayGenShaderTable[1]);
+	if (!Base::Headless || captureBuffer != nullptr)
+	{
+		if (!Base::Headless)
+		{
+			ReadDirectTimestamps(outputIndex);
+		}
+		RecordPresentList(Base::Queues::Direct::Dx12CommandAllocator[outputIndex],
+							Base::Queues::Direct::Dx12CommandList4[outputIndex],
+							Base::Headless ? nullptr : Base::Resources::Backbuffers::Dx12RTVResources[Base::DxgiSwapChain4->GetCurrentBackBufferIndex()],
+							Base::Resources::DXR::Dx12OutputResource[outputIndex],
+							captureBuffer,
+							outputIndex);
 		{
 			//Execute the command list.
-			ID3D12CommandList* listsToExecute[] = { Base::Queues::Compute::Dx12CommandList4[1]};
-			Base::Queues::Compute::Dx12Queue->ExecuteCommandLists(ARRAYSIZE(listsToExecute), listsToExecute);
+			ID3D12CommandList* listsToExecute[] = { Base::Queues::Direct::Dx12CommandList4[outputIndex] };
+			Base::Queues::Direct::Dx12Queue->ExecuteCommandLists(ARRAYSIZE(listsToExecute), listsToExecute);
 		}
-		Base::Queues::Compute::Dx12Queue->Signal(Base::Synchronization::Dx12Fence[1], dispatch2FenceValue + 1);
-		dispatch2FenceValue += 2;
-		//
 	}
+	Base::Queues::Direct::Dx12Queue->Signal(Base::Synchronization::Dx12Fence[outputIndex], releaseFenceValue);
+
+	if (captureBuffer != nullptr)
+	{
+		SubmitCapture(captureSlot, Base::Synchronization::Dx12Fence[outputIndex], releaseFenceValue);
+	}
+
+	if (!Base::Headless)
+	{
+		//Present the frame.
+		DXGI_PRESENT_PARAMETERS pp = {};
+		Base::DxgiSwapChain4->Present1(0, DXGI_PRESENT_ALLOW_TEARING, &pp);
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (Base::FrameMetrics::FramesPresented++ > 0)
+	{
+		Base::FrameMetrics::Statistics.record(FrameMetric_PresentInterval, elapsedMicroseconds(Base::FrameMetrics::LastPresent, now));
+	}
+	Base::FrameMetrics::LastPresent = now;
 }
 
 void DirectLoop()
 {
+	Profiler::setThreadName("Direct loop");
 	UINT64 copy1FenceValue = 1;
 	UINT64 copy2FenceValue = 1;
+	UINT64 framesPresented = 0;
 	while (true)
 	{
 		//First UAV
-		if (Base::Synchronization::Dx12Fence[0]->GetCompletedValue() < copy1FenceValue)
+		if (!WaitForFenceOrShutdown(Base::Synchronization::Dx12Fence[0], copy1FenceValue, Base::Synchronization::DirectLoop::EventHandle)) break;
+
+		PresentOutput(0, copy1FenceValue + 1);
+		copy1FenceValue += 2;
+		framesPresented++;
+		//
+
+		//Second UAV
+		if (!WaitForFenceOrShutdown(Base::Synchronization::Dx12Fence[1], copy2FenceValue, Base::Synchronization::DirectLoop::EventHandle)) break;
+
+		PresentOutput(1, copy2FenceValue + 1);
+		copy2FenceValue += 2;
+		framesPresented++;
+		//
+
+		if (Base::Headless && !Base::Benchmark::Active && HEADLESS_FRAME_COUNT != 0 && framesPresented >= HEADLESS_FRAME_COUNT)
 		{
-			Base::Synchronization::Dx12Fence[0]->SetEventOnCompletion(copy1FenceValue, Base::Synchronization::DirectLoop::EventHandle);
-			WaitForSingleObject(Base::Synchronization::DirectLoop::EventHandle, EVENT_TIMEOUT_MILLISECONDS);
+			std::cout << "Headless run finished after " << framesPresented << " frames\n";
+			TerminateLoops();
 		}
-		if (Base::Synchronization::terminate) break;
+	}
+}
 
-		RecordPresentList(Base::Queues::Direct::Dx12CommandAllocator[0], 
-							Base::Queues::Direct::Dx12CommandList4[0], 
-							Base::DxgiSwapChain4->GetCurrentBackBufferIndex(), 
-							Base::Resources::DXR::Dx12OutputResource[0]);
+// Builds the pipeline variant on the calling thread and hands it to the compute loop.
+// On failure the running pipeline is kept
+int BuildPendingPipeline(const ShaderPermutationKey& permutation)
+{
+	PROFILE_SCOPE("BuildPendingPipeline");
+	IDxcBlob* pShaders = nullptr;
+	if (CompileRaytracingShaders(permutation, &pShaders) != 0)
+	{
+		return 1;
+	}
+
+	RaytracingPipeline* pipeline = new RaytracingPipeline();
+	pipeline->Permutation = permutation;
+	int result = CreateRaytracingPipelineState(pShaders, pipeline);
+	SafeRelease(&pShaders);
+	if (result != 0 || CreateShaderTables(pipeline) != 0)
+	{
+		delete pipeline;
+		return 1;
+	}
+
+	//A pipeline the compute loop has not picked up yet was never used by the GPU
+	delete Base::ShaderReload::Pending.exchange(pipeline);
+	return 0;
+}
+
+int SelectShaderPermutation(const ShaderPermutationKey& permutation)
+{
+	if (permutation.MaxRayDepth < 1 || permutation.MaxRayDepth > D3D12_RAYTRACING_MAX_DECLARABLE_TRACE_RECURSION_DEPTH)
+	{
+		std::cerr << "Error: Ray depth " << permutation.MaxRayDepth << " is outside 1 to " << D3D12_RAYTRACING_MAX_DECLARABLE_TRACE_RECURSION_DEPTH << "\n";
+		return 1;
+	}
+
+	if (permutation.FlatNormals && Base::Resources::Geometry::Dx12FaceNormalResources[0] == nullptr)
+	{
+		std::cerr << "Error: The flat normal permutation needs a flat shaded mirror\n";
+		return 1;
+	}
+
+	if (permutation.Instrumentation && Base::Resources::RayStatistics::Dx12PixelResource[0] == nullptr)
+	{
+		std::cerr << "Error: The instrumented permutation needs RAY_INSTRUMENTATION set at startup\n";
+		return 1;
+	}
+
+	if (permutation.HybridPrimary && Base::Resources::Visibility::Dx12PipelineState == nullptr)
+	{
+		std::cerr << "Error: The hybrid primary permutation needs HYBRID_PRIMARY_VISIBILITY set at startup, or a benchmark run\n";
+		return 1;
+	}
+
+	if (permutation.Termination > TerminationPolicy_RussianRoulette)
+	{
+		std::cerr << "Error: Unknown ray termination policy " << permutation.Termination << "\n";
+		return 1;
+	}
+
+	if (BuildPendingPipeline(permutation) != 0)
+	{
+		return 1;
+	}
+
+	std::lock_guard<std::mutex> lock(Base::ShaderPermutations::Mutex);
+	Base::ShaderPermutations::Current = permutation;
+	return 0;
+}
+
+void FrameStatisticsExportLoop()
+{
+	Profiler::setThreadName("Frame statistics export");
+	while (true)
+	{
 		{
-			//Execute the command list.
-			ID3D12CommandList* listsToExecute[] = { Base::Queues::Direct::Dx12CommandList4[0]};
-			Base::Queues::Direct::Dx12Queue->ExecuteCommandLists(ARRAYSIZE(listsToExecute), listsToExecute);
+			std::unique_lock<std::mutex> lock(Base::FrameMetrics::ExportMutex);
+			Base::FrameMetrics::ExportRequested.wait(lock, []() { return Base::FrameMetrics::ExportPending || ShutdownSignaled(); });
+			if (ShutdownSignaled())
+			{
+				return; //DX12Free writes the final numbers
+			}
+			Base::FrameMetrics::ExportPending = false;
 		}
-		Base::Queues::Direct::Dx12Queue->Signal(Base::Synchronization::Dx12Fence[0], copy1FenceValue + 1);
-		copy1FenceValue += 2;
+
+		//The histograms are snapshotted without stopping the recorders
+		PROFILE_SCOPE("Export frame statistics");
+		Base::FrameMetrics::Statistics.writeMetrics(FRAME_STATISTICS_OUTPUT);
+	}
+}
+
+void ShaderReloadLoop()
+{
+	Profiler::setThreadName("Shader reload");
+	FILETIME lastWriteTime = GetFileLastWriteTime(RAY_TRACING_SHADERS_FILEPATH);
+	while (WaitForFileChange(RAY_TRACING_SHADERS_FILEPATH, &lastWriteTime))
+	{
+		std::cout << RAY_TRACING_SHADERS_FILEPATH << " changed, recompiling\n";
+
+		//Every variant compiled so far is out of date
+		ShaderPermutationKey permutation;
 		{
-			//Present the frame.
-			DXGI_PRESENT_PARAMETERS pp = {};
-			Base::DxgiSwapChain4->Present1(0, DXGI_PRESENT_ALLOW_TEARING, &pp);
+			std::lock_guard<std::mutex> lock(Base::ShaderPermutations::Mutex);
+			for (std::pair<const ShaderPermutationKey, IDxcBlob*>& compiled : Base::ShaderPermutations::Compiled)
+			{
+				SafeRelease(&compiled.second);
+			}
+			Base::ShaderPermutations::Compiled.clear();
+			permutation = Base::ShaderPermutations::Current;
 		}
-		//
 
-		//Second UAV
-		if (Base::Synchronization::Dx12Fence[1]->GetCompletedValue() < copy2FenceValue)
+		//On failure the next save tries again
+		BuildPendingPipeline(permutation);
+	}
+}
+
+// Renders one point of the sweep and returns its frame times. Returns false if shutdown was signaled first
+bool RenderBenchmarkPoint(UINT width, UINT height, UINT32 warmupFrames, UINT32 frames, std::vector<double>* pFrameTimes)
+{
+	std::unique_lock<std::mutex> lock(Base::Benchmark::Mutex);
+	Base::Benchmark::Width = width;
+	Base::Benchmark::Height = height;
+	Base::Benchmark::WarmupFrames = warmupFrames;
+	Base::Benchmark::Frames = frames;
+	Base::Benchmark::PointRequested = true;
+
+	//TerminateLoops notifies PointDone as well
+	Base::Benchmark::PointDone.wait(lock, []() { return !(Base::Benchmark::PointRequested || Base::Benchmark::Recording) || ShutdownSignaled(); });
+	if (Base::Benchmark::PointRequested || Base::Benchmark::Recording)
+	{
+		return false;
+	}
+
+	*pFrameTimes = Base::Benchmark::FrameTimes;
+	return true;
+}
+
+int RunBenchmark(const BenchmarkConfig& config)
+{
+	for (const std::pair<uint32_t, uint32_t>& resolution : config.Resolutions)
+	{
+		if (resolution.first > SCREEN_WIDTH || resolution.second > SCREEN_HEIGHT)
 		{
-			Base::Synchronization::Dx12Fence[1]->SetEventOnCompletion(copy2FenceValue, Base::Synchronization::DirectLoop::EventHandle);
-			WaitForSingleObject(Base::Synchronization::DirectLoop::EventHandle, EVENT_TIMEOUT_MILLISECONDS);
+			std::cerr << "Error: Benchmark resolution " << resolution.first << "x" << resolution.second << " is larger than the " << SCREEN_WIDTH << "x" << SCREEN_HEIGHT << " outputs\n";
+			return 1;
 		}
-		if (Base::Synchronization::terminate) break;
+	}
+
+	ShaderPermutationKey permutation;
+	{
+		std::lock_guard<std::mutex> lock(Base::ShaderPermutations::Mutex);
+		permutation = Base::ShaderPermutations::Current;
+	}
 
-		RecordPresentList(Base::Queues::Direct::Dx12CommandAllocator[1],
-							Base::Queues::Direct::Dx12CommandList4[1],
-							Base::DxgiSwapChain4->GetCurrentBackBufferIndex(),
-							Base::Resources::DXR::Dx12OutputResource[1]);
+	//Every depth is swept with each way of finding the first hits
+	std::vector<std::pair<bool, uint32_t>> modes;
+	for (bool hybridPrimary : config.HybridPrimary)
+	{
+		for (uint32_t depth : config.Depths)
 		{
-			//Execute the command list.
-			ID3D12CommandList* listsToExecute[] = { Base::Queues::Direct::Dx12CommandList4[1] };
-			Base::Queues::Direct::Dx12Queue->ExecuteCommandLists(ARRAYSIZE(listsToExecute), listsToExecute);
+			modes.push_back({ hybridPrimary, depth });
 		}
-		Base::Queues::Direct::Dx12Queue->Signal(Base::Synchronization::Dx12Fence[1], copy2FenceValue + 1);
-		copy2FenceValue += 2;
+	}
+
+	std::vector<BenchmarkResult> results;
+	for (const std::pair<bool, uint32_t>& mode : modes)
+	{
+		const bool hybridPrimary = mode.first;
+		const uint32_t depth = mode.second;
+		permutation.HybridPrimary = hybridPrimary;
+		permutation.MaxRayDepth = depth;
+		if (SelectShaderPermutation(permutation) != 0)
 		{
-			//Present the frame.
-			DXGI_PRESENT_PARAMETERS pp = {};
-			Base::DxgiSwapChain4->Present1(0, DXGI_PRESENT_ALLOW_TEARING, &pp);
+			return 1;
+		}
+
+		//The points are only timed once the compute loop has switched to the new pipeline
+		{
+			std::unique_lock<std::mutex> lock(Base::ShaderReload::SwapMutex);
+			Base::ShaderReload::Swapped.wait(lock, []() { return Base::ShaderReload::Pending.load() == nullptr || ShutdownSignaled(); });
+			if (Base::ShaderReload::Pending.load() != nullptr)
+			{
+				return 1;
+			}
+		}
+
+		for (const std::pair<uint32_t, uint32_t>& resolution : config.Resolutions)
+		{
+			std::vector<double> frameTimes;
+			if (!RenderBenchmarkPoint(resolution.first, resolution.second, config.WarmupFrames, config.Frames, &frameTimes))
+			{
+				std::cerr << "Error: Benchmark interrupted\n";
+				return 1;
+			}
+
+			BenchmarkResult result;
+			result.Model = config.Model;
+			result.Width = resolution.first;
+			result.Height = resolution.second;
+			result.Depth = depth;
+			result.HybridPrimary = hybridPrimary;
+			result.Summary = SummarizeFrameTimes(frameTimes);
+			results.push_back(result);
+
+			std::cout << "Benchmark " << resolution.first << "x" << resolution.second << " depth " << depth << (hybridPrimary ? " hybrid" : "")
+				<< ": mean " << result.Summary.MeanMilliseconds << " ms, median " << result.Summary.MedianMilliseconds
+				<< " ms, p95 " << result.Summary.P95Milliseconds << " ms, p99 " << result.Summary.P99Milliseconds << " ms\n";
 		}
-		//
 	}
+
+	ReportHybridSavings(results, std::cout);
+	return WriteBenchmarkResults(results, config.OutputPath);
 }
 
 void TerminateLoops()
 {
-	Base::Synchronization::terminate = true;
+	SignalShutdown();
+
+	//Taking each mutex orders the signal before the waiter's next check of it, so the wake up can't be missed
+	{
+		std::lock_guard<std::mutex> lock(Base::FrameMetrics::ExportMutex);
+	}
+	Base::FrameMetrics::ExportRequested.notify_all();
+	{
+		std::lock_guard<std::mutex> lock(Base::Benchmark::Mutex);
+	}
+	Base::Benchmark::PointDone.notify_all();
+	{
+		std::lock_guard<std::mutex> lock(Base::ShaderReload::SwapMutex);
+	}
+	Base::ShaderReload::Swapped.notify_all();
 }
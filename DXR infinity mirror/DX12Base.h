@@ -1,10 +1,15 @@
 #pragma once
 #include <windows.h>
 
+#include "ShaderPermutation.h"
+#include "Benchmark.h"
+#include "FrameStatistics.h"
+
 void WaitForCompute();
 void WaitForDirect();
 
-int DX12Setup(HWND wndHandle);
+//Benchmark runs keep the render loops going until RunBenchmark is done instead of stopping after HEADLESS_FRAME_COUNT frames
+int DX12Setup(HWND wndHandle, const char* modelFilePath, bool benchmark);
 
 void DX12Free();
 
@@ -12,4 +17,20 @@ void ComputeLoop();
 
 void DirectLoop();
 
+//Compiles the pipeline variant for the key, or reuses it if it was compiled before, and hands it to the compute loop.
+//Safe to call from any thread once setup is done. Returns 0 on success
+int SelectShaderPermutation(const ShaderPermutationKey& permutation);
+
+//Rewrites FRAME_STATISTICS_OUTPUT whenever the compute loop asks for it, until shutdown
+void FrameStatisticsExportLoop();
+
+//Recompiles the ray tracing shaders whenever the file is saved and hands the new pipeline to the compute loop
+void ShaderReloadLoop();
+
+//Renders every point of the sweep with the loops running and writes the results. Called on the main thread
+int RunBenchmark(const BenchmarkConfig& config);
+
 void TerminateLoops();
+
+//Everything recorded since setup, in microseconds. Safe to call from any thread
+HistogramSnapshot GetFrameStatistics(FrameMetric metric);
@@ -0,0 +1,55 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+DynamicResolutionController::DynamicResolutionController(double targetMilliseconds, float minScale, float maxScale, float step, uint32_t settleFrames)
+{
+	targetMilliseconds_ = targetMilliseconds;
+	minScale_ = minScale;
+	maxScale_ = std::max(minScale, maxScale);
+	step_ = step > 0.0f ? step : 0.05f;
+	settleFrames_ = std::max(settleFrames, (uint32_t)1);
+	scale_ = maxScale_;
+}
+
+bool DynamicResolutionController::addFrame(double frameMilliseconds)
+{
+	if (frameMilliseconds <= 0.0 || targetMilliseconds_ <= 0.0)
+	{
+		return false;
+	}
+
+	//The average restarts after every change, so it only ever describes the current scale
+	smoothedMilliseconds_ = framesSinceChange_ == 0 ? frameMilliseconds : smoothedMilliseconds_ + (frameMilliseconds - smoothedMilliseconds_) * 0.1;
+	if (++framesSinceChange_ < settleFrames_)
+	{
+		return false;
+	}
+
+	float ideal = scale_ * (float)std::sqrt(targetMilliseconds_ / smoothedMilliseconds_);
+	float next = scale_;
+	if (ideal < scale_ - step_ * 0.5f)
+	{
+		next = std::floor(ideal / step_) * step_;
+	}
+	else if (ideal > scale_ + step_)
+	{
+		next = scale_ + step_;
+	}
+	next = std::min(std::max(next, minScale_), maxScale_);
+
+	if (std::fabs(next - scale_) < step_ * 0.01f)
+	{
+		return false;
+	}
+
+	scale_ = next;
+	framesSinceChange_ = 0;
+	return true;
+}
+
+uint32_t DynamicResolutionController::scaledSize(uint32_t fullSize, float scale)
+{
+	uint32_t size = ((uint32_t)((float)fullSize * scale) / 8) * 8;
+	return std::min(std::max(size, (uint32_t)8), fullSize);
+}
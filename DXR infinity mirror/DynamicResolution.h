@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+//Picks the render scale that holds a frame time target. The cost of a frame is close to proportional to the
+//number of rays, so the scale moves by the square root of target / measured. The scale is quantized to steps and
+//left alone for a number of frames after each change, so the dispatch lists are not re-recorded every frame.
+//Drops go straight to the needed step, rises go one step at a time. Only uses the standard library
+class DynamicResolutionController
+{
+	double targetMilliseconds_;
+	float minScale_;
+	float maxScale_;
+	float step_;
+	uint32_t settleFrames_;
+
+	float scale_;
+	double smoothedMilliseconds_ = 0.0;
+	uint32_t framesSinceChange_ = 0;
+
+public:
+	DynamicResolutionController(double targetMilliseconds, float minScale, float maxScale, float step, uint32_t settleFrames);
+
+	//Returns true when the scale changed
+	bool addFrame(double frameMilliseconds);
+
+	float scale() const { return scale_; }
+
+	//Side of the dispatch for a full size side, rounded down to a multiple of 8 and kept between 8 and the full size
+	static uint32_t scaledSize(uint32_t fullSize, float scale);
+};
@@ -0,0 +1,242 @@
+#include "FrameCapture.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(__SSSE3__) || defined(__AVX__) || (defined(_MSC_VER) && defined(_M_X64))
+//Every CPU that can drive a DXR device has SSSE3, MSVC does not define a macro for it
+#define CAPTURE_SSSE3 1
+#include <tmmintrin.h>
+#endif
+
+void ConvertRowRgbaToRgb(const uint8_t* rgba, uint8_t* rgb, uint32_t width)
+{
+	uint32_t x = 0;
+#ifdef CAPTURE_SSSE3
+	//Four pixels per shuffle, written as 12 bytes so the last pixels of the row never write past it
+	const __m128i dropAlpha = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; x + 4 <= width; x += 4)
+	{
+		__m128i pixels = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(rgba + x * 4)), dropAlpha);
+		_mm_storel_epi64((__m128i*)(rgb + x * 3), pixels);
+		int last = _mm_cvtsi128_si32(_mm_srli_si128(pixels, 8));
+		memcpy(rgb + x * 3 + 8, &last, 4);
+	}
+#endif
+	for (; x < width; x++)
+	{
+		rgb[x * 3 + 0] = rgba[x * 4 + 0];
+		rgb[x * 3 + 1] = rgba[x * 4 + 1];
+		rgb[x * 3 + 2] = rgba[x * 4 + 2];
+	}
+}
+
+int WritePpm(const std::string& filePath, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch)
+{
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cerr << "Error: Failed opening " << filePath << " for the capture\n";
+		return 1;
+	}
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<uint8_t> row(width * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		ConvertRowRgbaToRgb(pixels + (size_t)y * rowPitch, row.data(), width);
+		file.write((const char*)row.data(), row.size());
+	}
+	return file ? 0 : 1;
+}
+
+static uint32_t crcTable[256];
+
+static void initCrcTable()
+{
+	for (uint32_t n = 0; n < 256; n++)
+	{
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++)
+		{
+			c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		}
+		crcTable[n] = c;
+	}
+}
+
+static uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void appendBigEndian(std::vector<uint8_t>* data, uint32_t value)
+{
+	data->push_back((uint8_t)(value >> 24));
+	data->push_back((uint8_t)(value >> 16));
+	data->push_back((uint8_t)(value >> 8));
+	data->push_back((uint8_t)value);
+}
+
+static void writeChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data)
+{
+	std::vector<uint8_t> header;
+	appendBigEndian(&header, (uint32_t)data.size());
+	header.insert(header.end(), type, type + 4);
+	file.write((const char*)header.data(), header.size());
+	file.write((const char*)data.data(), data.size());
+
+	uint32_t crc = updateCrc(0xFFFFFFFFu, (const uint8_t*)type, 4);
+	crc = updateCrc(crc, data.data(), data.size()) ^ 0xFFFFFFFFu;
+	std::vector<uint8_t> footer;
+	appendBigEndian(&footer, crc);
+	file.write((const char*)footer.data(), footer.size());
+}
+
+int WritePng(const std::string& filePath, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch)
+{
+	static std::once_flag crcTableInitialized;
+	std::call_once(crcTableInitialized, initCrcTable);
+
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cerr << "Error: Failed opening " << filePath << " for the capture\n";
+		return 1;
+	}
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write((const char*)signature, sizeof(signature));
+
+	std::vector<uint8_t> header;
+	appendBigEndian(&header, width);
+	appendBigEndian(&header, height);
+	const uint8_t headerTail[5] = { 8, 2, 0, 0, 0 }; //8 bit RGB, deflate, adaptive filtering, no interlace
+	header.insert(header.end(), headerTail, headerTail + 5);
+	writeChunk(file, "IHDR", header);
+
+	//Every row is a filter type byte of 0 followed by the pixels
+	const size_t rowSize = (size_t)width * 3 + 1;
+	std::vector<uint8_t> raw(rowSize * height);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		raw[y * rowSize] = 0;
+		ConvertRowRgbaToRgb(pixels + (size_t)y * rowPitch, &raw[y * rowSize + 1], width);
+	}
+
+	//zlib stream of stored blocks, which hold up to 65535 bytes each
+	std::vector<uint8_t> compressed;
+	compressed.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	compressed.push_back(0x78);
+	compressed.push_back(0x01);
+	size_t offset = 0;
+	do
+	{
+		uint16_t blockSize = (uint16_t)std::min<size_t>(raw.size() - offset, 65535);
+		bool last = offset + blockSize == raw.size();
+		compressed.push_back(last ? 1 : 0);
+		compressed.push_back((uint8_t)blockSize);
+		compressed.push_back((uint8_t)(blockSize >> 8));
+		compressed.push_back((uint8_t)~blockSize);
+		compressed.push_back((uint8_t)(~blockSize >> 8));
+		compressed.insert(compressed.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+		offset += blockSize;
+	} while (offset < raw.size());
+
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < raw.size(); i++)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	appendBigEndian(&compressed, (b << 16) | a);
+
+	writeChunk(file, "IDAT", compressed);
+	writeChunk(file, "IEND", std::vector<uint8_t>());
+	return file ? 0 : 1;
+}
+
+CaptureEncoder::~CaptureEncoder()
+{
+	stop();
+}
+
+void CaptureEncoder::start()
+{
+	if (thread_.joinable())
+	{
+		return;
+	}
+
+	stopping_ = false;
+	thread_ = std::thread(&CaptureEncoder::run, this);
+}
+
+void CaptureEncoder::stop()
+{
+	if (!thread_.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_one();
+	thread_.join();
+}
+
+void CaptureEncoder::submit(CaptureFrame frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queue_.push_back(std::move(frame));
+	}
+	wake_.notify_one();
+}
+
+void CaptureEncoder::run()
+{
+	while (true)
+	{
+		CaptureFrame frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+			if (queue_.empty())
+			{
+				return;
+			}
+			frame = std::move(queue_.front());
+			queue_.pop_front();
+		}
+
+		const uint8_t* pixels = frame.Acquire ? frame.Acquire() : nullptr;
+		int result = 1;
+		if (pixels != nullptr)
+		{
+			result = frame.Format == CaptureFormat_Png ? WritePng(frame.FilePath, pixels, frame.Width, frame.Height, frame.RowPitch)
+				: WritePpm(frame.FilePath, pixels, frame.Width, frame.Height, frame.RowPitch);
+		}
+		if (frame.Release)
+		{
+			frame.Release();
+		}
+
+		if (result == 0)
+		{
+			written_++;
+		}
+		else
+		{
+			std::cerr << "Error: Failed writing the capture " << frame.FilePath << "\n";
+			failed_++;
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CaptureFormat
+{
+	CaptureFormat_Ppm = 0,
+	CaptureFormat_Png = 1 //uncompressed deflate blocks, so encoding is a copy and two checksums
+};
+
+//Drops the alpha channel of a row of RGBA8 pixels. Uses SSSE3 shuffles where available
+void ConvertRowRgbaToRgb(const uint8_t* rgba, uint8_t* rgb, uint32_t width);
+
+//Rows start rowPitch bytes apart in pixels. Return 0 on success
+int WritePpm(const std::string& filePath, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch);
+int WritePng(const std::string& filePath, const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t rowPitch);
+
+//A frame handed to the encoder. The pixels are only looked at on the encoder thread, so the producer never waits
+struct CaptureFrame
+{
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t RowPitch;
+	CaptureFormat Format;
+	std::string FilePath;
+
+	//Blocks until the pixels are ready and returns them, nullptr drops the frame.
+	//Frames that are already in memory can return them directly and skip any copy
+	std::function<const uint8_t*()> Acquire;
+	//Called once the frame is written or dropped, to hand the memory back to the producer
+	std::function<void()> Release;
+};
+
+//Writes captured frames on a background thread, in the order they were submitted. Only uses the standard library
+class CaptureEncoder
+{
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::deque<CaptureFrame> queue_;
+	bool stopping_ = false;
+
+	uint32_t written_ = 0;
+	uint32_t failed_ = 0;
+
+	void run();
+
+public:
+	~CaptureEncoder();
+
+	void start();
+	//Writes the frames that are still queued, then joins the thread
+	void stop();
+
+	void submit(CaptureFrame frame);
+
+	//Frames written and failed so far. Only meaningful once stopped
+	uint32_t written() const { return written_; }
+	uint32_t failed() const { return failed_; }
+};
@@ -0,0 +1,151 @@
+#include "FrameStatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+static uint32_t highestBit(uint64_t value)
+{
+	uint32_t bit = 0;
+	for (uint32_t shift = 32; shift > 0; shift /= 2)
+	{
+		if (value >> shift)
+		{
+			value >>= shift;
+			bit += shift;
+		}
+	}
+	return bit;
+}
+
+uint64_t HistogramSnapshot::percentile(double p) const
+{
+	uint64_t total = 0;
+	for (uint64_t count : Counts)
+	{
+		total += count;
+	}
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	//Multiplying first keeps exact ranks exact, 99.9 / 100 * 1000 would round up past 999
+	uint64_t rank = (uint64_t)std::ceil(p * (double)total / 100.0);
+	rank = std::min(std::max(rank, (uint64_t)1), total);
+
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < Counts.size(); i++)
+	{
+		seen += Counts[i];
+		if (seen >= rank)
+		{
+			return std::min(StreamingHistogram::bucketHighestValue(i), Max);
+		}
+	}
+	return Max;
+}
+
+uint32_t StreamingHistogram::bucketIndex(uint64_t value)
+{
+	if (value < SubBucketCount)
+	{
+		return (uint32_t)value;
+	}
+
+	//value >> shift lands in the upper half of the sub buckets
+	uint32_t shift = highestBit(value) - SubBucketBits + 1;
+	return SubBucketCount + (shift - 1) * (SubBucketCount / 2) + (uint32_t)(value >> shift) - SubBucketCount / 2;
+}
+
+uint64_t StreamingHistogram::bucketHighestValue(uint32_t index)
+{
+	if (index < SubBucketCount)
+	{
+		return index;
+	}
+
+	uint32_t shift = (index - SubBucketCount) / (SubBucketCount / 2) + 1;
+	uint64_t subBucket = (index - SubBucketCount) % (SubBucketCount / 2) + SubBucketCount / 2;
+	return (subBucket << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+StreamingHistogram::StreamingHistogram() : count_(0), sum_(0), min_(UINT64_MAX), max_(0)
+{
+	for (std::atomic<uint64_t>& count : counts_)
+	{
+		count.store(0, std::memory_order_relaxed);
+	}
+}
+
+void StreamingHistogram::record(uint64_t value)
+{
+	counts_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(value, std::memory_order_relaxed);
+
+	uint64_t min = min_.load(std::memory_order_relaxed);
+	while (value < min && !min_.compare_exchange_weak(min, value, std::memory_order_relaxed))
+	{
+	}
+	uint64_t max = max_.load(std::memory_order_relaxed);
+	while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+HistogramSnapshot StreamingHistogram::snapshot() const
+{
+	HistogramSnapshot snapshot;
+	snapshot.Counts.resize(BucketCount);
+	for (uint32_t i = 0; i < BucketCount; i++)
+	{
+		snapshot.Counts[i] = counts_[i].load(std::memory_order_relaxed);
+	}
+	snapshot.Count = count_.load(std::memory_order_relaxed);
+	snapshot.Sum = sum_.load(std::memory_order_relaxed);
+	snapshot.Max = max_.load(std::memory_order_relaxed);
+	snapshot.Min = snapshot.Count == 0 ? 0 : min_.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+const char* FrameStatistics::metricName(FrameMetric metric)
+{
+	static const char* names[FrameMetric_Count] = { "frame_time_us", "dispatch_time_us", "present_interval_us" };
+	return metric < FrameMetric_Count ? names[metric] : "unknown_us";
+}
+
+int FrameStatistics::writeMetrics(const std::string& filePath) const
+{
+	static const double quantiles[] = { 0.5, 0.9, 0.95, 0.99, 0.999 };
+
+	std::ofstream file(filePath, std::ios::trunc);
+	if (!file)
+	{
+		std::cerr << "Error: Failed opening " << filePath << " for the frame statistics\n";
+		return 1;
+	}
+
+	for (int i = 0; i < FrameMetric_Count; i++)
+	{
+		const char* name = metricName((FrameMetric)i);
+		HistogramSnapshot snapshot = histograms_[i].snapshot();
+
+		file << "# TYPE " << name << " summary\n";
+		for (double quantile : quantiles)
+		{
+			file << name << "{quantile=\"" << quantile << "\"} " << snapshot.percentile(quantile * 100.0) << "\n";
+		}
+		file << name << "_sum " << snapshot.Sum << "\n";
+		file << name << "_count " << snapshot.Count << "\n";
+		file << name << "_min " << snapshot.Min << "\n";
+		file << name << "_max " << snapshot.Max << "\n";
+	}
+
+	if (!file)
+	{
+		std::cerr << "Error: Failed writing the frame statistics to " << filePath << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Copy of a histogram at one point in time, safe to query from any thread
+struct HistogramSnapshot
+{
+	std::vector<uint64_t> Counts;
+	uint64_t Count = 0;
+	uint64_t Sum = 0;
+	uint64_t Min = 0;
+	uint64_t Max = 0;
+
+	double mean() const { return Count == 0 ? 0.0 : (double)Sum / (double)Count; }
+
+	//Nearest rank, reported as the highest value of the bucket it falls in, clamped to Max. 0 when empty
+	uint64_t percentile(double p) const;
+};
+
+//Log bucketed histogram in the style of HdrHistogram. Values below SubBucketCount get a bucket each,
+//every power of two above that is split into SubBucketCount / 2 linear buckets, so a bucket is never wider than
+//1 / 32 of its values. Memory is constant and recording is a few relaxed atomic operations without locks.
+//Only uses the standard library
+class StreamingHistogram
+{
+public:
+	static const uint32_t SubBucketBits = 6;
+	static const uint32_t SubBucketCount = 1u << SubBucketBits;
+	static const uint32_t BucketCount = SubBucketCount + (64 - SubBucketBits) * (SubBucketCount / 2);
+
+	static uint32_t bucketIndex(uint64_t value);
+	static uint64_t bucketHighestValue(uint32_t index);
+
+	StreamingHistogram();
+
+	void record(uint64_t value);
+
+	//Recorders may run concurrently, so the counts can be a few values apart from Count, Sum, Min and Max.
+	//Percentiles only use the counts
+	HistogramSnapshot snapshot() const;
+
+private:
+	std::atomic<uint64_t> counts_[BucketCount];
+	std::atomic<uint64_t> count_;
+	std::atomic<uint64_t> sum_;
+	std::atomic<uint64_t> min_;
+	std::atomic<uint64_t> max_;
+};
+
+enum FrameMetric
+{
+	FrameMetric_FrameTime = 0,			//interval between dispatches on the compute loop
+	FrameMetric_DispatchTime = 1,		//DispatchRays on the GPU, needs GPU_TIMESTAMPS
+	FrameMetric_PresentInterval = 2,	//interval between presents, or handing the output back in headless runs
+	FrameMetric_Count = 3
+};
+
+//One histogram of microseconds per metric, for the whole run
+class FrameStatistics
+{
+	StreamingHistogram histograms_[FrameMetric_Count];
+
+public:
+	static const char* metricName(FrameMetric metric);
+
+	void record(FrameMetric metric, uint64_t microseconds) { histograms_[metric].record(microseconds); }
+	HistogramSnapshot snapshot(FrameMetric metric) const { return histograms_[metric].snapshot(); }
+
+	//Overwrites the file with a summary per metric in the Prometheus text format. Returns 0 on success
+	int writeMetrics(const std::string& filePath) const;
+};
@@ -6,3 +6,4 @@
 #include <vector>
 #include <memory>
 #include <thread>
+#include <atomic>
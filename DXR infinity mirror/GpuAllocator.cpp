@@ -0,0 +1,168 @@
+#include "GpuAllocator.h"
+
+#include <iomanip>
+
+GpuAllocator::GpuAllocator()
+{
+
+}
+
+GpuAllocator::~GpuAllocator()
+{
+	release();
+}
+
+void GpuAllocator::init(ID3D12Device5* device, uint64_t heapSize)
+{
+	device_ = device;
+	heapSize_ = heapSize;
+}
+
+void GpuAllocator::release()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	//placed resources hold a reference to their heap, so anything still alive keeps its memory
+	for (HeapBlock& heapBlock : heaps_)
+	{
+		MemoryRegistry::untrackHeap(heapBlock.Heap);
+		heapBlock.Heap->Release();
+	}
+	heaps_.clear();
+	placements_.clear();
+}
+
+ID3D12Resource1* GpuAllocator::createBuffer(uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initState, D3D12_HEAP_TYPE heapType, MemoryCategory category)
+{
+	D3D12_RESOURCE_DESC bufDesc = {};
+	bufDesc.Alignment = 0;
+	bufDesc.DepthOrArraySize = 1;
+	bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	bufDesc.Flags = flags;
+	bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+	bufDesc.Height = 1;
+	bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	bufDesc.MipLevels = 1;
+	bufDesc.SampleDesc.Count = 1;
+	bufDesc.SampleDesc.Quality = 0;
+	bufDesc.Width = size;
+
+	//Buffers are placed at 64KB granularity, which also covers the 256 byte alignment of acceleration structures
+	D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = device_->GetResourceAllocationInfo(0, 1, &bufDesc);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	size_t heapIndex = 0;
+	uint64_t offset = BuddyAllocator::INVALID_OFFSET;
+	for (; heapIndex < heaps_.size(); heapIndex++)
+	{
+		if (heaps_[heapIndex].Type != heapType) continue;
+
+		offset = heaps_[heapIndex].Allocator.allocate(allocationInfo.SizeInBytes, allocationInfo.Alignment);
+		if (offset != BuddyAllocator::INVALID_OFFSET) break;
+	}
+
+	if (offset == BuddyAllocator::INVALID_OFFSET)
+	{
+		//No room in the existing heaps. Oversized buffers get a heap of their own rounded up to a power of two
+		uint64_t newHeapSize = heapSize_;
+		while (newHeapSize < allocationInfo.SizeInBytes)
+		{
+			newHeapSize *= 2;
+		}
+
+		D3D12_HEAP_DESC heapDesc = {};
+		heapDesc.SizeInBytes = newHeapSize;
+		heapDesc.Properties.Type = heapType;
+		heapDesc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+		heapDesc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+		heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+		heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+
+		ID3D12Heap* heap = nullptr;
+		if (FAILED(device_->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap))))
+		{
+			std::cerr << "Error: Failed creating buffer heap of " << newHeapSize << " bytes\n";
+			return nullptr;
+		}
+		heap->SetName(heapType == D3D12_HEAP_TYPE_UPLOAD ? L"Upload buffer heap" : heapType == D3D12_HEAP_TYPE_READBACK ? L"Readback buffer heap" : L"Default buffer heap");
+
+		heaps_.push_back({ heap, heapType, BuddyAllocator(newHeapSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT) });
+		MemoryRegistry::trackHeap(heap, newHeapSize);
+		heapIndex = heaps_.size() - 1;
+		offset = heaps_[heapIndex].Allocator.allocate(allocationInfo.SizeInBytes, allocationInfo.Alignment);
+	}
+
+	ID3D12Resource1* pBuffer = nullptr;
+	if (FAILED(device_->CreatePlacedResource(heaps_[heapIndex].Heap, offset, &bufDesc, initState, nullptr, IID_PPV_ARGS(&pBuffer))))
+	{
+		std::cerr << "Error: Failed placing buffer of " << size << " bytes\n";
+		heaps_[heapIndex].Allocator.free(offset);
+		return nullptr;
+	}
+
+	placements_[pBuffer] = { heapIndex, offset };
+	//The whole buddy block is taken, not just the size of the buffer
+	MemoryRegistry::track(pBuffer, category, heaps_[heapIndex].Allocator.blockSizeAt(offset));
+	return pBuffer;
+}
+
+void GpuAllocator::releaseBuffer(ID3D12Resource1** ppBuffer)
+{
+	if (*ppBuffer == nullptr) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto placement = placements_.find(*ppBuffer);
+		if (placement != placements_.end())
+		{
+			heaps_[placement->second.HeapIndex].Allocator.free(placement->second.Offset);
+			placements_.erase(placement);
+		}
+	}
+	MemoryRegistry::untrack(*ppBuffer);
+
+	(*ppBuffer)->Release();
+	(*ppBuffer) = nullptr;
+}
+
+uint64_t GpuAllocator::blockSize(ID3D12Resource* buffer)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto placement = placements_.find(buffer);
+	if (placement == placements_.end()) return 0;
+
+	return heaps_[placement->second.HeapIndex].Allocator.blockSizeAt(placement->second.Offset);
+}
+
+GpuAllocatorStats GpuAllocator::getStats(D3D12_HEAP_TYPE heapType)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	GpuAllocatorStats stats;
+	for (const HeapBlock& heapBlock : heaps_)
+	{
+		if (heapBlock.Type == heapType)
+		{
+			heapBlock.Allocator.addStats(&stats);
+		}
+	}
+	return stats;
+}
+
+void GpuAllocator::printStats()
+{
+	const D3D12_HEAP_TYPE types[] = { D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_TYPE_UPLOAD, D3D12_HEAP_TYPE_READBACK };
+	const char* names[] = { "Default", "Upload", "Readback" };
+
+	for (int i = 0; i < _countof(types); i++)
+	{
+		GpuAllocatorStats stats = getStats(types[i]);
+		if (stats.NumHeaps == 0) continue;
+
+		std::cout << names[i] << " buffer heaps: " << stats.NumHeaps << " heaps, " << stats.NumAllocations << " buffers, "
+			<< stats.RequestedBytes / 1024 << " KB requested, " << stats.AllocatedBytes / 1024 << " KB allocated of "
+			<< stats.HeapBytes / 1024 << " KB, largest free block " << stats.LargestFreeBlock / 1024 << " KB, fragmentation "
+			<< std::fixed << std::setprecision(2) << stats.Fragmentation() * 100.0f << std::defaultfloat << "%\n";
+	}
+}
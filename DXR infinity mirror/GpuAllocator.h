@@ -0,0 +1,49 @@
+#pragma once
+#include <d3d12.h>
+#include <unordered_map>
+#include <mutex>
+
+#include "GenericIncludes.h"
+#include "BuddyAllocator.h"
+#include "MemoryRegistry.h"
+
+//Places buffers in large heaps instead of creating a committed resource for each of them
+class GpuAllocator
+{
+	struct HeapBlock
+	{
+		ID3D12Heap* Heap;
+		D3D12_HEAP_TYPE Type;
+		BuddyAllocator Allocator;
+	};
+
+	struct Placement
+	{
+		size_t HeapIndex;
+		uint64_t Offset;
+	};
+
+	ID3D12Device5* device_ = nullptr;
+	uint64_t heapSize_ = 0;
+
+	std::vector<HeapBlock> heaps_;
+	std::unordered_map<ID3D12Resource*, Placement> placements_;
+	std::mutex mutex_;
+
+public:
+	GpuAllocator();
+	~GpuAllocator();
+
+	void init(ID3D12Device5* device, uint64_t heapSize);
+	void release();
+
+	//The placed size of the buffer is tracked in the MemoryRegistry under the category until it is released
+	ID3D12Resource1* createBuffer(uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initState, D3D12_HEAP_TYPE heapType, MemoryCategory category);
+	void releaseBuffer(ID3D12Resource1** ppBuffer);
+
+	//Bytes of heap the buffer occupies, its size rounded up to the block it was placed in. 0 for buffers from elsewhere
+	uint64_t blockSize(ID3D12Resource* buffer);
+
+	GpuAllocatorStats getStats(D3D12_HEAP_TYPE heapType);
+	void printStats();
+};
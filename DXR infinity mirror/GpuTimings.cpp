@@ -0,0 +1,54 @@
+#include "GpuTimings.h"
+#include <algorithm>
+
+double GpuTimingStatistics::ticksToMilliseconds(uint64_t beginTicks, uint64_t endTicks, uint64_t ticksPerSecond)
+{
+	if (ticksPerSecond == 0 || endTicks < beginTicks)
+	{
+		return -1.0;
+	}
+	return (double)(endTicks - beginTicks) * 1000.0 / (double)ticksPerSecond;
+}
+
+void GpuTimingStatistics::addSample(GpuPass pass, uint64_t beginTicks, uint64_t endTicks, uint64_t ticksPerSecond)
+{
+	double milliseconds = ticksToMilliseconds(beginTicks, endTicks, ticksPerSecond);
+	if (milliseconds < 0.0 || pass >= GpuPass_Count)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	PassTimings& timings = passes_[pass];
+	timings.MinMilliseconds = timings.Samples == 0 ? milliseconds : std::min(timings.MinMilliseconds, milliseconds);
+	timings.MaxMilliseconds = timings.Samples == 0 ? milliseconds : std::max(timings.MaxMilliseconds, milliseconds);
+	timings.SumMilliseconds += milliseconds;
+	timings.Samples++;
+}
+
+void GpuTimingStatistics::report(std::ostream& stream)
+{
+	static const char* passNames[GpuPass_Count] = { "TLAS build", "DispatchRays", "Upscale and copy to backbuffer" };
+
+	PassTimings passes[GpuPass_Count];
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (int i = 0; i < GpuPass_Count; i++)
+		{
+			passes[i] = passes_[i];
+			passes_[i] = PassTimings();
+		}
+	}
+
+	for (int i = 0; i < GpuPass_Count; i++)
+	{
+		if (passes[i].Samples == 0)
+		{
+			continue;
+		}
+
+		stream << "GPU " << passNames[i] << ": mean " << passes[i].SumMilliseconds / passes[i].Samples
+			<< " ms, min " << passes[i].MinMilliseconds << " ms, max " << passes[i].MaxMilliseconds
+			<< " ms over " << passes[i].Samples << " frames\n";
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+enum GpuPass
+{
+	GpuPass_TlasBuild = 0,
+	GpuPass_DispatchRays = 1, //and the checkerboard reconstruction when it is on
+	GpuPass_Copy = 2, //upscale when the dispatch was smaller and copy to the backbuffer, only in windowed runs
+	GpuPass_Count = 3
+};
+
+//Collects per pass GPU durations from pairs of raw timestamps until the next report.
+//Samples can come from any thread. Only uses the standard library, so it can be fed synthetic timestamps
+class GpuTimingStatistics
+{
+	struct PassTimings
+	{
+		double SumMilliseconds = 0.0;
+		double MinMilliseconds = 0.0;
+		double MaxMilliseconds = 0.0;
+		uint32_t Samples = 0;
+	};
+
+	std::mutex mutex_;
+	PassTimings passes_[GpuPass_Count];
+
+public:
+	//Returns a negative value if the timestamps can't be a duration, such as when the end was never written
+	static double ticksToMilliseconds(uint64_t beginTicks, uint64_t endTicks, uint64_t ticksPerSecond);
+
+	//Invalid timestamp pairs are dropped
+	void addSample(GpuPass pass, uint64_t beginTicks, uint64_t endTicks, uint64_t ticksPerSecond);
+
+	//Prints mean, min and max of every pass with samples, then starts over
+	void report(std::ostream& stream);
+};
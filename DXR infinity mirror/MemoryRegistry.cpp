@@ -0,0 +1,161 @@
+#include "MemoryRegistry.h"
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+	struct TrackedAllocation
+	{
+		MemoryCategory Category;
+		uint64_t Bytes;
+	};
+
+	std::mutex registryMutex;
+	std::unordered_map<const void*, TrackedAllocation> allocations;
+	std::unordered_map<const void*, uint64_t> heaps;
+	MemorySnapshot usage;
+
+	void add(MemoryCategory category, uint64_t bytes)
+	{
+		MemoryCategoryUsage& categoryUsage = usage.Categories[category];
+		categoryUsage.CurrentBytes += bytes;
+		categoryUsage.PeakBytes = std::max(categoryUsage.PeakBytes, categoryUsage.CurrentBytes);
+		categoryUsage.Allocations++;
+
+		if (MemoryRegistry::isCpuCategory(category))
+		{
+			usage.CpuCurrentBytes += bytes;
+			usage.CpuPeakBytes = std::max(usage.CpuPeakBytes, usage.CpuCurrentBytes);
+		}
+		else
+		{
+			usage.GpuCurrentBytes += bytes;
+			usage.GpuPeakBytes = std::max(usage.GpuPeakBytes, usage.GpuCurrentBytes);
+		}
+	}
+
+	void remove(const TrackedAllocation& allocation)
+	{
+		MemoryCategoryUsage& categoryUsage = usage.Categories[allocation.Category];
+		categoryUsage.CurrentBytes -= allocation.Bytes;
+		categoryUsage.Allocations--;
+		(MemoryRegistry::isCpuCategory(allocation.Category) ? usage.CpuCurrentBytes : usage.GpuCurrentBytes) -= allocation.Bytes;
+	}
+
+	double megabytes(uint64_t bytes)
+	{
+		return (double)bytes / (1024.0 * 1024.0);
+	}
+}
+
+namespace MemoryRegistry
+{
+	const char* categoryName(MemoryCategory category)
+	{
+		static const char* names[MemoryCategory_Count] =
+		{
+			"Geometry", "BLAS", "TLAS", "Scratch", "Shader tables", "Output textures", "Staging", "Readback", "Statistics", "Constants", "Mesh data"
+		};
+		return category < MemoryCategory_Count ? names[category] : "Unknown";
+	}
+
+	bool isCpuCategory(MemoryCategory category)
+	{
+		return category == MemoryCategory_MeshData;
+	}
+
+	void track(const void* allocation, MemoryCategory category, uint64_t bytes)
+	{
+		if (allocation == nullptr || category >= MemoryCategory_Count)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		auto tracked = allocations.find(allocation);
+		if (tracked != allocations.end())
+		{
+			remove(tracked->second);
+			allocations.erase(tracked);
+		}
+
+		allocations[allocation] = { category, bytes };
+		add(category, bytes);
+	}
+
+	void untrack(const void* allocation)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		auto tracked = allocations.find(allocation);
+		if (tracked != allocations.end())
+		{
+			remove(tracked->second);
+			allocations.erase(tracked);
+		}
+	}
+
+	void trackHeap(const void* heap, uint64_t bytes)
+	{
+		if (heap == nullptr)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		uint64_t& trackedBytes = heaps[heap];
+		usage.HeapCurrentBytes += bytes - trackedBytes;
+		usage.HeapPeakBytes = std::max(usage.HeapPeakBytes, usage.HeapCurrentBytes);
+		trackedBytes = bytes;
+	}
+
+	void untrackHeap(const void* heap)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		auto tracked = heaps.find(heap);
+		if (tracked != heaps.end())
+		{
+			usage.HeapCurrentBytes -= tracked->second;
+			heaps.erase(tracked);
+		}
+	}
+
+	MemorySnapshot snapshot()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		return usage;
+	}
+
+	void report(std::ostream& stream)
+	{
+		MemorySnapshot current = snapshot();
+
+		std::ios::fmtflags flags = stream.flags();
+		std::streamsize precision = stream.precision();
+		stream << std::fixed << std::setprecision(2);
+
+		stream << "Memory by category, current / peak:\n";
+		for (int i = 0; i < MemoryCategory_Count; i++)
+		{
+			const MemoryCategoryUsage& categoryUsage = current.Categories[i];
+			if (categoryUsage.PeakBytes == 0)
+			{
+				continue;
+			}
+
+			stream << "  " << categoryName((MemoryCategory)i) << (isCpuCategory((MemoryCategory)i) ? " (CPU)" : "") << ": "
+				<< megabytes(categoryUsage.CurrentBytes) << " MB in " << categoryUsage.Allocations << " allocations / "
+				<< megabytes(categoryUsage.PeakBytes) << " MB\n";
+		}
+		stream << "  GPU total: " << megabytes(current.GpuCurrentBytes) << " MB / " << megabytes(current.GpuPeakBytes) << " MB\n";
+		stream << "  CPU total: " << megabytes(current.CpuCurrentBytes) << " MB / " << megabytes(current.CpuPeakBytes) << " MB\n";
+		if (current.HeapPeakBytes > 0)
+		{
+			stream << "  Buffer heaps: " << megabytes(current.HeapCurrentBytes) << " MB / " << megabytes(current.HeapPeakBytes) << " MB\n";
+		}
+
+		stream.flags(flags);
+		stream.precision(precision);
+	}
+}
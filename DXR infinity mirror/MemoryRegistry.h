@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+
+enum MemoryCategory
+{
+	MemoryCategory_Geometry = 0,		//vertex, index and face normal buffers
+	MemoryCategory_Blas = 1,
+	MemoryCategory_Tlas = 2,			//result and instance descriptions
+	MemoryCategory_Scratch = 3,			//acceleration structure build scratch
+	MemoryCategory_ShaderTables = 4,
+	MemoryCategory_OutputTextures = 5,
+	MemoryCategory_Staging = 6,			//upload ring
+	MemoryCategory_Readback = 7,
+	MemoryCategory_Statistics = 8,		//ray counters and per pixel statistics
+	MemoryCategory_Constants = 9,		//per frame constant buffers
+	MemoryCategory_MeshData = 10,		//imported meshes in system memory, the only CPU category
+	MemoryCategory_Count = 11
+};
+
+struct MemoryCategoryUsage
+{
+	uint64_t CurrentBytes = 0;
+	uint64_t PeakBytes = 0;
+	uint32_t Allocations = 0;
+};
+
+struct MemorySnapshot
+{
+	MemoryCategoryUsage Categories[MemoryCategory_Count];
+	uint64_t GpuCurrentBytes = 0;
+	uint64_t GpuPeakBytes = 0;		//peak of the GPU total, not the sum of the category peaks
+	uint64_t CpuCurrentBytes = 0;
+	uint64_t CpuPeakBytes = 0;
+	uint64_t HeapCurrentBytes = 0;	//heaps the buffers are placed in, which the GPU total is carved out of
+	uint64_t HeapPeakBytes = 0;
+};
+
+//Tags allocations by category and keeps current and peak bytes per category and in total.
+//Buffers placed by GpuAllocator count the buddy block they take, not their resource size, so the GPU categories add up to what
+//the allocator hands out. The heaps holding those blocks are counted on their own.
+//Allocations are keyed by their address, so they can be untracked without knowing the category. Only uses the standard library
+namespace MemoryRegistry
+{
+	const char* categoryName(MemoryCategory category);
+	bool isCpuCategory(MemoryCategory category);
+
+	//Tracking an address again replaces the earlier entry
+	void track(const void* allocation, MemoryCategory category, uint64_t bytes);
+	//Addresses that were never tracked are ignored
+	void untrack(const void* allocation);
+
+	//Heaps are counted apart from the categories, since the allocations placed in them are tracked as well
+	void trackHeap(const void* heap, uint64_t bytes);
+	void untrackHeap(const void* heap);
+
+	MemorySnapshot snapshot();
+
+	//Prints every category that has been used, with the totals
+	void report(std::ostream& stream);
+}
@@ -0,0 +1,111 @@
+#include "PixelStatistics.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+static bool writePPM(const std::string& filePath, const std::vector<unsigned char>& rgb, uint32_t width, uint32_t height)
+{
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write((const char*)rgb.data(), rgb.size());
+	return (bool)file;
+}
+
+//Blue to green to red
+static void heatmapColor(float t, unsigned char* rgb)
+{
+	t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+	float r = t < 0.5f ? 0.0f : (t - 0.5f) * 2.0f;
+	float g = t < 0.5f ? t * 2.0f : (1.0f - t) * 2.0f;
+	float b = t < 0.5f ? 1.0f - t * 2.0f : 0.0f;
+	rgb[0] = (unsigned char)(r * 255.0f + 0.5f);
+	rgb[1] = (unsigned char)(g * 255.0f + 0.5f);
+	rgb[2] = (unsigned char)(b * 255.0f + 0.5f);
+}
+
+int WritePixelStatistics(const uint32_t* pixels, uint32_t width, uint32_t height, uint32_t maxDepth, const std::string& basePath)
+{
+	static const unsigned char hitColors[PixelHitType_Count][3] = { { 128, 128, 128 }, { 64, 64, 255 }, { 0, 0, 0 } };
+	static const char* hitNames[PixelHitType_Count] = { "mirror", "edges", "miss" };
+
+	const size_t numPixels = (size_t)width * height;
+	std::vector<unsigned char> depthImage(numPixels * 3);
+	std::vector<unsigned char> hitImage(numPixels * 3);
+
+	//Bounce counts go up to 255, the shaders never trace deeper than that
+	std::vector<uint64_t> histogram(256 * PixelHitType_Count, 0);
+	uint64_t bounceSum = 0;
+
+	for (size_t i = 0; i < numPixels; i++)
+	{
+		uint32_t bounces = PixelBounces(pixels[i]);
+		PixelHitType hit = PixelHit(pixels[i]);
+		if (hit >= PixelHitType_Count)
+		{
+			hit = PixelHitType_Mirror;
+		}
+
+		heatmapColor(maxDepth > 1 ? ((float)bounces - 1.0f) / (float)(maxDepth - 1) : 0.0f, &depthImage[i * 3]);
+		hitImage[i * 3 + 0] = hitColors[hit][0];
+		hitImage[i * 3 + 1] = hitColors[hit][1];
+		hitImage[i * 3 + 2] = hitColors[hit][2];
+
+		histogram[bounces * PixelHitType_Count + hit]++;
+		bounceSum += bounces;
+	}
+
+	if (!writePPM(basePath + "_depth.ppm", depthImage, width, height) || !writePPM(basePath + "_hit.ppm", hitImage, width, height))
+	{
+		std::cerr << "Error: Failed writing the pixel statistics images to " << basePath << "\n";
+		return 1;
+	}
+
+	std::ofstream csv(basePath + ".csv", std::ios::trunc);
+	if (!csv)
+	{
+		std::cerr << "Error: Failed writing " << basePath << ".csv\n";
+		return 1;
+	}
+
+	csv << "bounces";
+	for (int hit = 0; hit < PixelHitType_Count; hit++)
+	{
+		csv << "," << hitNames[hit];
+	}
+	csv << ",total\n";
+
+	uint64_t hitTotals[PixelHitType_Count] = {};
+	for (uint32_t bounces = 0; bounces < 256; bounces++)
+	{
+		uint64_t total = 0;
+		for (int hit = 0; hit < PixelHitType_Count; hit++)
+		{
+			total += histogram[bounces * PixelHitType_Count + hit];
+		}
+		if (total == 0)
+		{
+			continue;
+		}
+
+		csv << bounces;
+		for (int hit = 0; hit < PixelHitType_Count; hit++)
+		{
+			csv << "," << histogram[bounces * PixelHitType_Count + hit];
+			hitTotals[hit] += histogram[bounces * PixelHitType_Count + hit];
+		}
+		csv << "," << total << "\n";
+	}
+
+	std::cout << "Pixel statistics written to " << basePath << ": average " << (numPixels ? (double)bounceSum / numPixels : 0.0) << " bounces";
+	for (int hit = 0; hit < PixelHitType_Count; hit++)
+	{
+		std::cout << ", " << hitTotals[hit] << " " << hitNames[hit];
+	}
+	std::cout << "\n";
+	return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+//Per pixel record written by the instrumented shaders, see PixelStatistics in the shaders.
+//Bits 0 to 7 hold the bounce count and bits 8 to 9 what the last ray hit
+enum PixelHitType
+{
+	PixelHitType_Mirror = 0, //stopped on the mirror by the depth limit, cone or termination policy
+	PixelHitType_Edges = 1,
+	PixelHitType_Miss = 2,
+	PixelHitType_Count = 3
+};
+
+inline uint32_t PixelBounces(uint32_t pixel) { return pixel & 0xFF; }
+inline PixelHitType PixelHit(uint32_t pixel) { return (PixelHitType)((pixel >> 8) & 0x3); }
+
+//Writes <basePath>_depth.ppm (bounce count heatmap, blue is 1 bounce and red maxDepth),
+//<basePath>_hit.ppm (mirror grey, edges blue, miss black) and <basePath>.csv (pixels per bounce count and hit type).
+//Only uses the standard library so captures can be post processed anywhere. Returns 0 on success
+int WritePixelStatistics(const uint32_t* pixels, uint32_t width, uint32_t height, uint32_t maxDepth, const std::string& basePath);
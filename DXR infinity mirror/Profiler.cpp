@@ -0,0 +1,173 @@
+#include "Profiler.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace
+{
+	struct ProfileEvent
+	{
+		const char* Name;
+		uint64_t StartNanoseconds;
+		uint64_t EndNanoseconds;
+	};
+
+	//Written by its thread only. Count is published after the event, so the exporter never reads a half written one.
+	//The events are allocated by the first one recorded, so threads that only name themselves cost nothing
+	struct ThreadBuffer
+	{
+		uint32_t ThreadIndex;
+		std::string ThreadName;
+		std::vector<ProfileEvent> Events;
+		std::atomic<uint32_t> Count{ 0 };
+		std::atomic<uint32_t> Dropped{ 0 };
+	};
+
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers; //kept past the end of their threads for the export
+	std::set<std::string> internedNames;
+	uint32_t eventCapacity = 0;
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	thread_local ThreadBuffer* localBuffer = nullptr;
+
+	ThreadBuffer* getLocalBuffer()
+	{
+		if (localBuffer == nullptr)
+		{
+			std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffer->ThreadIndex = (uint32_t)threadBuffers.size();
+			localBuffer = buffer.get();
+			threadBuffers.push_back(std::move(buffer));
+		}
+		return localBuffer;
+	}
+
+	std::string jsonString(const std::string& value)
+	{
+		std::string result = "\"";
+		for (char c : value)
+		{
+			if (c == '"' || c == '\\')
+			{
+				result.push_back('\\');
+			}
+			result.push_back(c);
+		}
+		return result + "\"";
+	}
+}
+
+namespace Profiler
+{
+	std::atomic<bool> Enabled{ false };
+
+	void setEnabled(bool enabled, uint32_t eventsPerThread)
+	{
+		eventCapacity = eventsPerThread;
+		Enabled.store(enabled && eventsPerThread > 0, std::memory_order_relaxed);
+	}
+
+	void setThreadName(const char* name)
+	{
+		if (!enabled())
+		{
+			return;
+		}
+
+		ThreadBuffer* buffer = getLocalBuffer();
+		std::lock_guard<std::mutex> lock(registryMutex);
+		buffer->ThreadName = name;
+	}
+
+	const char* internName(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		return internedNames.insert(name).first->c_str();
+	}
+
+	uint64_t nowNanoseconds()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	void recordEvent(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds)
+	{
+		ThreadBuffer* buffer = getLocalBuffer();
+		if (buffer->Events.empty())
+		{
+			//The exporter only reads the events once Count is published, which happens after this
+			buffer->Events.resize(eventCapacity);
+		}
+
+		uint32_t count = buffer->Count.load(std::memory_order_relaxed);
+		if (count >= buffer->Events.size())
+		{
+			buffer->Dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		buffer->Events[count] = { name, startNanoseconds, endNanoseconds };
+		buffer->Count.store(count + 1, std::memory_order_release);
+	}
+
+	int writeChromeTrace(const std::string& filePath)
+	{
+		std::ofstream file(filePath, std::ios::trunc);
+		if (!file)
+		{
+			std::cerr << "Error: Failed opening " << filePath << " for the profile\n";
+			return 1;
+		}
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+
+		//Chrome traces are in microseconds
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		uint64_t totalEvents = 0;
+		uint64_t totalDropped = 0;
+		for (const std::unique_ptr<ThreadBuffer>& buffer : threadBuffers)
+		{
+			std::string threadName = buffer->ThreadName.empty() ? "Thread " + std::to_string(buffer->ThreadIndex) : buffer->ThreadName;
+			file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->ThreadIndex
+				<< ",\"args\":{\"name\":" << jsonString(threadName) << "}}";
+			first = false;
+
+			uint32_t count = buffer->Count.load(std::memory_order_acquire);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const ProfileEvent& event = buffer->Events[i];
+				file << ",\n{\"name\":" << jsonString(event.Name) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->ThreadIndex
+					<< ",\"ts\":" << event.StartNanoseconds / 1000.0 << ",\"dur\":" << (event.EndNanoseconds - event.StartNanoseconds) / 1000.0 << "}";
+			}
+
+			totalEvents += count;
+			totalDropped += buffer->Dropped.load(std::memory_order_relaxed);
+		}
+		file << "\n]}\n";
+
+		if (!file)
+		{
+			std::cerr << "Error: Failed writing the profile to " << filePath << "\n";
+			return 1;
+		}
+
+		std::cout << "Profile of " << totalEvents << " events written to " << filePath;
+		if (totalDropped > 0)
+		{
+			std::cout << ", " << totalDropped << " events did not fit the per thread buffers";
+		}
+		std::cout << "\n";
+		return 0;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <atomic>
+
+//Scoped CPU timers recorded into per thread buffers and exported as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+//Each thread only appends to its own buffer, so recording takes no locks. When profiling is off a scope costs one relaxed load.
+//Only uses the standard library
+namespace Profiler
+{
+	//Must be called before the threads that record start. Events past the capacity of a thread are dropped and counted
+	void setEnabled(bool enabled, uint32_t eventsPerThread);
+
+	extern std::atomic<bool> Enabled;
+	inline bool enabled() { return Enabled.load(std::memory_order_relaxed); }
+
+	//Shown as the name of the calling thread's row in the trace
+	void setThreadName(const char* name);
+
+	//Returns a pointer that stays valid until exit, for scope names that are built at runtime
+	const char* internName(const std::string& name);
+
+	uint64_t nowNanoseconds();
+
+	//name has to outlive the export, string literals or internName
+	void recordEvent(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds);
+
+	//Writes everything recorded so far. Returns 0 on success
+	int writeChromeTrace(const std::string& filePath);
+}
+
+class ProfileScope
+{
+	const char* name_;
+	uint64_t start_;
+
+public:
+	explicit ProfileScope(const char* name) : name_(Profiler::enabled() ? name : nullptr), start_(name_ ? Profiler::nowNanoseconds() : 0) {}
+	~ProfileScope()
+	{
+		if (name_ != nullptr)
+		{
+			Profiler::recordEvent(name_, start_, Profiler::nowNanoseconds());
+		}
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+//Times the rest of the enclosing scope
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+//Remembers which frame slots hold a recording of the static dispatch commands that still matches the renderer state.
+//A slot is recorded the first time it is used after an invalidation and re-executed as it is after that.
+//Only uses the standard library
+class RecordedListCache
+{
+	static const uint32_t NumSlots = 2;
+	bool recorded_[NumSlots] = { false, false };
+
+public:
+	bool needsRecording(uint32_t slot) const { return !recorded_[slot]; }
+	void markRecorded(uint32_t slot) { recorded_[slot] = true; }
+
+	//For when anything the recordings reference is replaced, every slot is recorded again on its next use
+	void invalidate()
+	{
+		for (uint32_t i = 0; i < NumSlots; i++)
+		{
+			recorded_[i] = false;
+		}
+	}
+};
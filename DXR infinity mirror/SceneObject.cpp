@@ -4,8 +4,14 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <cmath>
+
+#include "Profiler.h"
+
 SceneObject LoadSceneObjectFile(std::string file, Scene_Object_Data dataToLoad)
 {
+    PROFILE_SCOPE("LoadSceneObjectFile");
+
     Assimp::Importer importer;
 
     SceneObject output;
@@ -68,6 +74,19 @@ SceneObject LoadSceneObjectFile(std::string file, Scene_Object_Data dataToLoad)
                 subGeometry.indecies.get()[j * 3 + 2] = mesh->mFaces[j].mIndices[2];
             }
 
+            //The normal is constant over each triangle, so the hit shader can read one packed normal instead of three vertices
+            if (HasFlatNormals(subGeometry))
+            {
+                subGeometry.numFaceNormals = mesh->mNumFaces;
+                subGeometry.faceNormals = std::shared_ptr<uint32_t>(new uint32_t[subGeometry.numFaceNormals], std::default_delete<uint32_t[]>());
+
+                for (uint32_t j = 0; j < mesh->mNumFaces; j++)
+                {
+                    const Vertex& vertex = subGeometry.vertecies.get()[subGeometry.indecies.get()[j * 3]];
+                    subGeometry.faceNormals.get()[j] = PackNormalOctahedral(vertex.norm[0], vertex.norm[1], vertex.norm[2]);
+                }
+            }
+
             output.meshGeometries.push_back(subGeometry);
             output.sceneObjectData |= Scene_Object_Data_Meshes;
         }
@@ -75,3 +94,71 @@ SceneObject LoadSceneObjectFile(std::string file, Scene_Object_Data dataToLoad)
     
     return output;
 }
+
+uint32_t PackNormalOctahedral(float x, float y, float z)
+{
+    //project onto the octahedron, then fold the lower half over the upper one
+    float length = std::abs(x) + std::abs(y) + std::abs(z);
+    x /= length;
+    y /= length;
+
+    if (z < 0.0f)
+    {
+        float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    int16_t packedX = (int16_t)std::round(std::fmin(std::fmax(x, -1.0f), 1.0f) * 32767.0f);
+    int16_t packedY = (int16_t)std::round(std::fmin(std::fmax(y, -1.0f), 1.0f) * 32767.0f);
+    return (uint32_t)(uint16_t)packedX | ((uint32_t)(uint16_t)packedY << 16);
+}
+
+bool HasFlatNormals(const MeshGeometry& mesh)
+{
+    const float epsilon = 1e-4f;
+
+    for (uint32_t i = 0; i + 2 < mesh.numIndecies; i += 3)
+    {
+        const Vertex& v0 = mesh.vertecies.get()[mesh.indecies.get()[i + 0]];
+        const Vertex& v1 = mesh.vertecies.get()[mesh.indecies.get()[i + 1]];
+        const Vertex& v2 = mesh.vertecies.get()[mesh.indecies.get()[i + 2]];
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (std::abs(v0.norm[axis] - v1.norm[axis]) > epsilon || std::abs(v0.norm[axis] - v2.norm[axis]) > epsilon)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+float SmallestExtent(const MeshGeometry& mesh)
+{
+    if (mesh.numVertecies == 0)
+    {
+        return 0.0f;
+    }
+
+    float minimum[3];
+    float maximum[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        minimum[axis] = maximum[axis] = mesh.vertecies.get()[0].pos[axis];
+    }
+
+    for (uint32_t i = 1; i < mesh.numVertecies; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            minimum[axis] = std::fmin(minimum[axis], mesh.vertecies.get()[i].pos[axis]);
+            maximum[axis] = std::fmax(maximum[axis], mesh.vertecies.get()[i].pos[axis]);
+        }
+    }
+
+    return std::fmin(maximum[0] - minimum[0], std::fmin(maximum[1] - minimum[1], maximum[2] - minimum[2]));
+}
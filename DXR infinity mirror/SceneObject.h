@@ -37,6 +37,10 @@ struct MeshGeometry
 
 	uint32_t numIndecies;
 	std::shared_ptr<uint32_t> indecies;
+
+	//Only generated for flat shaded meshes, one octahedral encoded normal per triangle in two 16 bit snorms
+	uint32_t numFaceNormals = 0;
+	std::shared_ptr<uint32_t> faceNormals;
 };
 
 struct SceneObject
@@ -48,3 +52,12 @@ struct SceneObject
 };
 
 SceneObject LoadSceneObjectFile(std::string file, Scene_Object_Data dataToLoad = Scene_Object_Data_All);
+
+//Packs a unit vector into two 16 bit snorms, x in the low half. Decoded by decodeOctahedral in the shaders
+uint32_t PackNormalOctahedral(float x, float y, float z);
+
+//True when the three vertices of every triangle share one normal, as exported for flat shaded models
+bool HasFlatNormals(const MeshGeometry& mesh);
+
+//Smallest side of the mesh's axis aligned bounding box, in object space
+float SmallestExtent(const MeshGeometry& mesh);
@@ -11,13 +11,73 @@ const unsigned int SCREEN_HEIGHT = 1080;	//Height of application.
 // DX config
 const D3D_FEATURE_LEVEL MINIMUM_FEATURE_LEVEL = D3D_FEATURE_LEVEL_12_1;
 const unsigned int NUM_SWAP_BUFFERS = 2;
+const UINT64 GPU_HEAP_SIZE = 64 * 1024 * 1024; //Size of the heaps buffers are placed in. Bigger buffers get a heap of their own
+const UINT64 UPLOAD_RING_SIZE = 16 * 1024 * 1024; //Size of the staging ring geometry is copied to the GPU through
+const UINT64 BLAS_SCRATCH_BUDGET = 32 * 1024 * 1024; //Upper bound of the scratch pool shared by the BLAS builds. Builds that don't fit go in a later batch
+const bool BLAS_COMPACTION = true; //Copies each BLAS into a buffer of its compacted size after the build instead of keeping the conservative worst case size
+const unsigned int STARTUP_WORKER_THREADS = 3; //Threads that run setup tasks next to the main thread, so scene import and shader compilation overlap device creation
+#define SHADER_CACHE_DIRECTORY "ShaderCache" //Compiled DXIL is kept here between launches, delete it to force a recompile
+#define RAY_TRACING_SHADERS_FILEPATH "RayTracingShaders.hlsl"
+const bool SHADER_HOT_RELOAD = true; //Watches the ray tracing shaders and swaps in a recompiled pipeline when they are saved
 
 const unsigned int MAX_RAY_DEPTH = 31; //the depth of the infinity mirror. between 1 and 31.
 
 const float REFLECTON_BIAS = 0.00001f; //Required for more complicated geometries, such as the mirrorTestSmooth model.
 										//it displaces the reflected ray's positions along the surface normal to ensure they don't miss the surface due to floating point errors
 
-const DWORD EVENT_TIMEOUT_MILLISECONDS = 1000; //one second
+const float CONE_FOOTPRINT_LIMIT = 0.0f; //Reflections stop once a pixel's ray cone is wider than this fraction of the thinnest extent of the edges, 0.25 is a good start. Changes the image. 0 traces every bounce
+const unsigned int RAY_TERMINATION_POLICY = 0; //0 traces every ray to MAX_RAY_DEPTH, 1 stops rays below RAY_TERMINATION_THRESHOLD, 2 plays russian roulette with them
+const float RAY_TERMINATION_THRESHOLD = 4.0f; //Bounces of absorption left in the ray color below which the termination policy kicks in
+const unsigned int RAY_STATISTICS_REPORT_FRAMES = 1000; //Frames between the ray statistics and GPU timings printed to the console. 0 turns the report off
+const bool GPU_TIMESTAMPS = true; //Times the TLAS build, DispatchRays and the copy to the backbuffer on the GPU
+const bool RAY_INSTRUMENTATION = false; //Records the bounce count and last hit of every pixel and dumps them once as images and histograms
+const unsigned int RAY_INSTRUMENTATION_CAPTURE_FRAME = 100; //Frame whose pixel statistics are dumped
+#define RAY_INSTRUMENTATION_OUTPUT "PixelStatistics" //Base path of the dumped images and histogram
+
+// Headless mode
+#define HEADLESS_ARGUMENT L"-headless" //Command line argument that runs the render loops without a window or swap chain
+const unsigned int HEADLESS_FRAME_COUNT = 1000; //Number of frames rendered before a headless run exits. 0 runs until the console is closed
+
+// Benchmark mode
+#define BENCHMARK_ARGUMENT L"-benchmark" //Runs headless through a sweep of -depths, -resolutions and -frames, see Benchmark.h for the options
+const unsigned int BENCHMARK_FRAMES = 1000; //Timed frames per sweep point unless -frames is given
+const unsigned int BENCHMARK_WARMUP_FRAMES = 100; //Untimed frames at the start of every sweep point unless -warmup is given
+#define BENCHMARK_OUTPUT "Benchmark" //Results are appended to <output>.csv and written to <output>.json unless -output is given
+
+// Dynamic resolution
+const bool DYNAMIC_RESOLUTION = false; //Shrinks the dispatch to hold DYNAMIC_RESOLUTION_TARGET_MS and upscales the output to the window. Benchmark runs keep their own sizes
+const float DYNAMIC_RESOLUTION_TARGET_MS = 16.6f; //Frame time the dispatch size is picked for
+const float DYNAMIC_RESOLUTION_MIN_SCALE = 0.5f; //Smallest fraction of SCREEN_WIDTH and SCREEN_HEIGHT that is rendered
+const float DYNAMIC_RESOLUTION_STEP = 0.05f; //The scale changes in steps of this size
+const unsigned int DYNAMIC_RESOLUTION_SETTLE_FRAMES = 30; //Frames measured at a scale before it can change again
+#define UPSCALE_SHADER_FILEPATH "Upscale.hlsl" //Edge aware upscale of smaller dispatches to the output size
+
+// Checkerboard rendering
+const bool CHECKERBOARD_RENDERING = false; //Traces half the pixels of every frame in checkerboard order and fills the rest from the output's previous frame. Pixel statistics of the other half are one frame old
+#define CHECKERBOARD_SHADER_FILEPATH "Checkerboard.hlsl" //Reconstruction of the pixels that were not traced
+
+// Hybrid primary visibility
+const bool HYBRID_PRIMARY_VISIBILITY = false; //Rasterises the first hit of every pixel and starts the rays at the first reflection. Benchmark runs can compare both with -primary traced,hybrid
+#define VISIBILITY_SHADER_FILEPATH "Visibility.hlsl" //Vertex and pixel shader of the visibility buffer
+
+// Frame capture
+const unsigned int CAPTURE_FRAME_INTERVAL = 0; //Writes every Nth presented frame to disk on a background thread, headless runs included. 0 turns capture off
+const unsigned int CAPTURE_RING_SIZE = 4; //Readback buffers in flight. A due frame is skipped rather than waited for when all of them are busy
+const bool CAPTURE_PNG = true; //PNG, or PPM when false
+#define CAPTURE_OUTPUT "Capture" //Frames are written to <output>_<frame>.png
+
+// CPU profiling
+#define PROFILE_ARGUMENT L"-profile" //Command line argument that turns the CPU profiler on without changing CPU_PROFILING
+const bool CPU_PROFILING = false; //Records scoped timers on every thread and writes them as a Chrome trace on exit
+const unsigned int CPU_PROFILE_EVENTS_PER_THREAD = 1 << 14; //Events each thread can hold, later ones are dropped. 24 bytes each, allocated by a thread's first event
+#define CPU_PROFILE_OUTPUT "Profile.json" //Open in chrome://tracing or ui.perfetto.dev
+
+#define FRAME_STATISTICS_OUTPUT "FrameStatistics.txt" //Frame time, dispatch time and present interval percentiles over the whole run
+const unsigned int FRAME_STATISTICS_EXPORT_FRAMES = 1000; //Frames between rewrites of FRAME_STATISTICS_OUTPUT. 0 only writes it at shutdown
+
+const unsigned int MEMORY_REPORT_KEY = 'M'; //Prints current and peak memory per category. The report is also printed at shutdown
+
+const float ANIMATION_ROTATION_PER_FRAME = 0.001f; //Radians the model turns each frame. Tied to the frame index so every benchmark point renders the same frames
 
 //Shader Names
 #define RAY_GEN_SHADER_NAME L"rayGen";
@@ -35,3 +95,5 @@ const DWORD EVENT_TIMEOUT_MILLISECONDS = 1000; //one second
 //#define MODEL_FILEPATH "mirrorTestSmooth.fbx"
 
 #define MODEL_PARTS 2 //do not modify, current geometry loading is unfinished and assumes value 2
+#define MIRROR_PART 0 //Mesh, instance and hit group record of the mirror
+#define EDGES_PART 1 //Mesh, instance and hit group record of the edges, Instance in Visibility.hlsl
@@ -0,0 +1,321 @@
+#include "ShaderCache.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <direct.h>
+#define makeDirectory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define makeDirectory(path) mkdir(path, 0755)
+#endif
+
+static const uint32_t CACHE_MAGIC = 0x43495844; //"DXIC"
+static const uint32_t CACHE_FORMAT_VERSION = 1;
+
+struct ShaderCacheHeader
+{
+	uint32_t Magic;
+	uint32_t FormatVersion;
+	uint64_t Key;
+	uint64_t Size;
+	uint64_t Checksum;
+};
+
+//64 bit FNV-1a
+static const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+static const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+static void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+}
+
+//The length goes in first so that neighbouring fields can't run into each other
+static void hashString(uint64_t& hash, const std::string& value)
+{
+	uint64_t length = value.size();
+	hashBytes(hash, &length, sizeof(length));
+	hashBytes(hash, value.data(), value.size());
+}
+
+static void hashString(uint64_t& hash, const std::wstring& value)
+{
+	uint64_t length = value.size();
+	hashBytes(hash, &length, sizeof(length));
+	for (wchar_t c : value)
+	{
+		uint32_t character = (uint32_t)c; //wchar_t is 2 bytes on windows and 4 elsewhere
+		hashBytes(hash, &character, sizeof(character));
+	}
+}
+
+static bool readFile(const std::string& filePath, std::string& content)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::stringstream stream;
+	stream << file.rdbuf();
+	content = stream.str();
+	return true;
+}
+
+static std::string directoryOf(const std::string& filePath)
+{
+	size_t separator = filePath.find_last_of("/\\");
+	return separator == std::string::npos ? std::string() : filePath.substr(0, separator + 1);
+}
+
+//Collects the names of every #include "name" and #include <name> in the source.
+//Includes inside comments or disabled blocks are picked up as well, which at worst misses the cache more often
+static std::vector<std::string> findIncludes(const std::string& source)
+{
+	std::vector<std::string> includes;
+
+	std::istringstream lines(source);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		size_t i = line.find_first_not_of(" \t");
+		if (i == std::string::npos || line[i] != '#')
+		{
+			continue;
+		}
+
+		i = line.find_first_not_of(" \t", i + 1);
+		if (i == std::string::npos || line.compare(i, 7, "include") != 0)
+		{
+			continue;
+		}
+
+		i = line.find_first_not_of(" \t", i + 7);
+		if (i == std::string::npos || (line[i] != '"' && line[i] != '<'))
+		{
+			continue;
+		}
+
+		char terminator = line[i] == '"' ? '"' : '>';
+		size_t end = line.find(terminator, i + 1);
+		if (end != std::string::npos)
+		{
+			includes.push_back(line.substr(i + 1, end - i - 1));
+		}
+	}
+
+	return includes;
+}
+
+bool ShaderCache::init(const std::string& directory)
+{
+	directory_ = directory;
+	enabled_ = makeDirectory(directory_.c_str()) == 0 || errno == EEXIST;
+
+	if (!enabled_)
+	{
+		std::cerr << "Error: Failed creating shader cache directory " << directory_ << ", shaders will be compiled every launch\n";
+	}
+
+	return enabled_;
+}
+
+std::string ShaderCache::blobPath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.dxil", (unsigned long long)key);
+	return directory_ + "/" + name;
+}
+
+bool ShaderCache::hashSource(const std::string& filePath, std::vector<std::string>& visited, uint64_t& hash) const
+{
+	for (const std::string& path : visited)
+	{
+		if (path == filePath)
+		{
+			return true;
+		}
+	}
+	visited.push_back(filePath);
+
+	std::string source;
+	if (!readFile(filePath, source))
+	{
+		return false;
+	}
+
+	hashString(hash, filePath);
+	hashString(hash, source);
+
+	//Includes are resolved relative to the including file first and the root file second
+	for (const std::string& include : findIncludes(source))
+	{
+		std::string candidates[2] = { directoryOf(filePath) + include, directoryOf(visited.front()) + include };
+
+		bool resolved = false;
+		for (const std::string& candidate : candidates)
+		{
+			std::ifstream probe(candidate);
+			if (probe)
+			{
+				probe.close();
+				if (!hashSource(candidate, visited, hash))
+				{
+					return false;
+				}
+				resolved = true;
+				break;
+			}
+		}
+
+		//Unresolved names still count, the key changes once the file shows up
+		if (!resolved)
+		{
+			hashString(hash, include);
+		}
+	}
+
+	return true;
+}
+
+bool ShaderCache::computeKey(const ShaderCacheKeyDesc& desc, uint64_t* pKey) const
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	hashBytes(hash, &CACHE_FORMAT_VERSION, sizeof(CACHE_FORMAT_VERSION));
+	hashBytes(hash, &desc.CompilerVersion, sizeof(desc.CompilerVersion));
+
+	std::vector<std::string> visited;
+	if (!hashSource(desc.FilePath, visited, hash))
+	{
+		return false;
+	}
+
+	hashString(hash, desc.EntryPoint);
+	hashString(hash, desc.TargetProfile);
+
+	uint64_t count = desc.CompileArguments.size();
+	hashBytes(hash, &count, sizeof(count));
+	for (const std::wstring& argument : desc.CompileArguments)
+	{
+		hashString(hash, argument);
+	}
+
+	count = desc.Defines.size();
+	hashBytes(hash, &count, sizeof(count));
+	for (const std::pair<std::wstring, std::wstring>& define : desc.Defines)
+	{
+		hashString(hash, define.first);
+		hashString(hash, define.second);
+	}
+
+	*pKey = hash;
+	return true;
+}
+
+bool ShaderCache::load(uint64_t key, std::vector<char>& dxil) const
+{
+	if (!enabled_)
+	{
+		return false;
+	}
+
+	std::ifstream file(blobPath(key), std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	ShaderCacheHeader header = {};
+	if (!file.read((char*)&header, sizeof(header)) ||
+		header.Magic != CACHE_MAGIC ||
+		header.FormatVersion != CACHE_FORMAT_VERSION ||
+		header.Key != key)
+	{
+		return false;
+	}
+
+	dxil.resize((size_t)header.Size);
+	if (!file.read(dxil.data(), dxil.size()))
+	{
+		return false;
+	}
+
+	//catches files cut short by a crash during store
+	uint64_t checksum = FNV_OFFSET_BASIS;
+	hashBytes(checksum, dxil.data(), dxil.size());
+	return checksum == header.Checksum;
+}
+
+bool ShaderCache::store(uint64_t key, const std::vector<char>& dxil) const
+{
+	if (!enabled_)
+	{
+		return false;
+	}
+
+	ShaderCacheHeader header = {};
+	header.Magic = CACHE_MAGIC;
+	header.FormatVersion = CACHE_FORMAT_VERSION;
+	header.Key = key;
+	header.Size = dxil.size();
+	header.Checksum = FNV_OFFSET_BASIS;
+	hashBytes(header.Checksum, dxil.data(), dxil.size());
+
+	//Written next to the final name and renamed so a reader never sees a partial blob
+	std::string path = blobPath(key);
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.write((const char*)&header, sizeof(header)) || !file.write(dxil.data(), dxil.size()))
+		{
+			file.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool ShaderCache::getOrCompile(const ShaderCacheKeyDesc& desc, const CompileFunction& compile, std::vector<char>& dxil)
+{
+	uint64_t key = 0;
+	bool hasKey = computeKey(desc, &key);
+
+	if (hasKey && load(key, dxil))
+	{
+		hits_++;
+		std::cout << "Shader cache hit for " << desc.FilePath << "\n";
+		return true;
+	}
+
+	misses_++;
+	if (!compile(dxil))
+	{
+		return false;
+	}
+
+	if (hasKey && !store(key, dxil))
+	{
+		std::cerr << "Error: Failed writing " << desc.FilePath << " to the shader cache\n";
+	}
+
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+
+//Everything that decides the DXIL a compilation produces
+struct ShaderCacheKeyDesc
+{
+	std::string FilePath;
+	std::wstring EntryPoint;
+	std::wstring TargetProfile;
+	std::vector<std::wstring> CompileArguments;
+	std::vector<std::pair<std::wstring, std::wstring>> Defines; //name, value
+	uint64_t CompilerVersion = 0; //so blobs from an older compiler are not reused
+};
+
+//Content addressed store of compiled shader blobs on disk.
+//The key hashes the source text and every include it resolves, so editing any of them misses the cache.
+//Only uses the standard library so it can be exercised with a stub compiler on any platform
+class ShaderCache
+{
+	std::string directory_;
+	bool enabled_ = false;
+
+	uint32_t hits_ = 0;
+	uint32_t misses_ = 0;
+
+	std::string blobPath(uint64_t key) const;
+	bool hashSource(const std::string& filePath, std::vector<std::string>& visited, uint64_t& hash) const;
+
+public:
+	typedef std::function<bool(std::vector<char>& dxil)> CompileFunction;
+
+	//Creates the directory if needed. The cache is disabled and every lookup misses if that fails
+	bool init(const std::string& directory);
+
+	//Fails if the source or one of its includes can't be read
+	bool computeKey(const ShaderCacheKeyDesc& desc, uint64_t* pKey) const;
+
+	bool load(uint64_t key, std::vector<char>& dxil) const;
+	bool store(uint64_t key, const std::vector<char>& dxil) const;
+
+	//Loads the blob for desc, or calls compile and stores its result on a miss
+	bool getOrCompile(const ShaderCacheKeyDesc& desc, const CompileFunction& compile, std::vector<char>& dxil);
+
+	uint32_t hits() const { return hits_; }
+	uint32_t misses() const { return misses_; }
+};
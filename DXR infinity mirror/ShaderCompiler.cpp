@@ -32,7 +32,15 @@ HRESULT ShaderCompiler::init()
 			{
 				if (SUCCEEDED(hr = pfnDxcCreateInstance(CLSID_DxcLinker, IID_PPV_ARGS(&linker_))))
 				{
-
+					//a different compiler may produce different DXIL for the same source
+					IDxcVersionInfo* versionInfo = nullptr;
+					if (SUCCEEDED(compiler_->QueryInterface(IID_PPV_ARGS(&versionInfo))))
+					{
+						UINT32 major = 0, minor = 0;
+						versionInfo->GetVersion(&major, &minor);
+						compilerVersion_ = ((uint64_t)major << 32) | minor;
+						SafeRelease(versionInfo);
+					}
 				}
 			}
 		}
@@ -41,7 +49,76 @@ HRESULT ShaderCompiler::init()
 	return hr;
 }
 
+void ShaderCompiler::setCache(ShaderCache* cache)
+{
+	cache_ = cache;
+}
+
+static std::string narrowString(LPCWSTR string)
+{
+	int size = WideCharToMultiByte(CP_ACP, 0, string, -1, nullptr, 0, nullptr, nullptr);
+	if (size <= 1)
+	{
+		return std::string();
+	}
+
+	std::string result(size - 1, '\0');
+	WideCharToMultiByte(CP_ACP, 0, string, -1, &result[0], size, nullptr, nullptr);
+	return result;
+}
+
 HRESULT ShaderCompiler::compileFromFile(ShaderCompilationDesc* desc, IDxcBlob** ppResult)
+{
+	if (cache_ == nullptr || desc == nullptr || ppResult == nullptr)
+	{
+		return compile(desc, ppResult);
+	}
+
+	ShaderCacheKeyDesc keyDesc;
+	keyDesc.FilePath = narrowString(desc->FilePath);
+	keyDesc.EntryPoint = desc->EntryPoint;
+	keyDesc.TargetProfile = desc->TargetProfile;
+	keyDesc.CompilerVersion = compilerVersion_;
+	for (LPCWSTR argument : desc->CompileArguments)
+	{
+		keyDesc.CompileArguments.push_back(argument);
+	}
+	for (const DxcDefine& define : desc->Defines)
+	{
+		keyDesc.Defines.push_back(std::make_pair(std::wstring(define.Name), std::wstring(define.Value ? define.Value : L"")));
+	}
+
+	HRESULT hr = E_FAIL;
+	std::vector<char> dxil;
+	bool found = cache_->getOrCompile(keyDesc, [&](std::vector<char>& compiled)
+	{
+		IDxcBlob* pBlob = nullptr;
+		if (FAILED(hr = compile(desc, &pBlob)))
+		{
+			return false;
+		}
+
+		const char* data = (const char*)pBlob->GetBufferPointer();
+		compiled.assign(data, data + pBlob->GetBufferSize());
+		SafeRelease(pBlob);
+		return true;
+	}, dxil);
+
+	if (!found)
+	{
+		return hr;
+	}
+
+	IDxcBlobEncoding* pBlob = nullptr;
+	if (SUCCEEDED(hr = library_->CreateBlobWithEncodingOnHeapCopy(dxil.data(), (UINT32)dxil.size(), 0, &pBlob)))
+	{
+		*ppResult = pBlob;
+	}
+
+	return hr;
+}
+
+HRESULT ShaderCompiler::compile(ShaderCompilationDesc* desc, IDxcBlob** ppResult)
 {
 	HRESULT hr = E_FAIL;
 
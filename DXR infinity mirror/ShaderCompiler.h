@@ -2,6 +2,7 @@
 
 #include "stdafx.h"
 #include <dxcapi.h>
+#include "ShaderCache.h"
 
 struct ShaderCompilationDesc
 {
@@ -19,11 +20,19 @@ class ShaderCompiler
 	IDxcLinker* linker_ = nullptr;
 	IDxcIncludeHandler* includeHandler_ = nullptr;
 
+	ShaderCache* cache_ = nullptr;
+	uint64_t compilerVersion_ = 0;
+
+	HRESULT compile(ShaderCompilationDesc* desc, IDxcBlob** ppResult);
+
 public:
 	ShaderCompiler();
 	~ShaderCompiler();
 
 	HRESULT init();
 
+	//Compiled blobs are looked up in and written to cache, nullptr compiles every time
+	void setCache(ShaderCache* cache);
+
 	HRESULT compileFromFile(ShaderCompilationDesc* desc, IDxcBlob** ppResult);
 };
\ No newline at end of file
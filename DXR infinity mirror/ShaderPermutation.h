@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+//How a mirror ray whose throughput has dropped below the termination threshold is handled.
+//The values match the TERMINATION_POLICY_ defines in the shaders
+enum TerminationPolicy
+{
+	TerminationPolicy_None = 0, //always trace to the maximum depth
+	TerminationPolicy_Threshold = 1, //stop the ray
+	TerminationPolicy_RussianRoulette = 2 //stop the ray at random and weight the survivors, which keeps the image unbiased
+};
+
+//The values the ray tracing shaders are specialised on. Each distinct key is compiled into its own pipeline variant,
+//with the values folded into the DXIL as constants instead of being read from root constants
+struct ShaderPermutationKey
+{
+	uint32_t MaxRayDepth = 1;
+	bool FlatNormals = false; //every triangle of the mirror has one normal, so nothing needs interpolating
+	float ReflectionBias = 0.0f;
+	TerminationPolicy Termination = TerminationPolicy_None;
+	bool Instrumentation = false; //writes the bounce count and last hit of every pixel to the pixel statistics buffer
+	bool HybridPrimary = false; //the first hit of every pixel is read from the rasterised visibility buffer instead of traced
+
+	//Compared bitwise so that the key is exact and usable in ordered containers
+	uint32_t reflectionBiasBits() const
+	{
+		uint32_t bits;
+		memcpy(&bits, &ReflectionBias, sizeof(bits));
+		return bits;
+	}
+
+	bool operator<(const ShaderPermutationKey& other) const
+	{
+		if (MaxRayDepth != other.MaxRayDepth) return MaxRayDepth < other.MaxRayDepth;
+		if (FlatNormals != other.FlatNormals) return FlatNormals < other.FlatNormals;
+		if (Termination != other.Termination) return Termination < other.Termination;
+		if (Instrumentation != other.Instrumentation) return Instrumentation < other.Instrumentation;
+		if (HybridPrimary != other.HybridPrimary) return HybridPrimary < other.HybridPrimary;
+		return reflectionBiasBits() < other.reflectionBiasBits();
+	}
+
+	bool operator==(const ShaderPermutationKey& other) const
+	{
+		return !(*this < other) && !(other < *this);
+	}
+
+	//name, value pairs for the DXC defines the shaders check for
+	std::vector<std::pair<std::wstring, std::wstring>> defines() const
+	{
+		wchar_t biasBits[16];
+		swprintf(biasBits, 16, L"0x%08X", reflectionBiasBits());
+
+		std::vector<std::pair<std::wstring, std::wstring>> result;
+		result.push_back(std::make_pair(std::wstring(L"MAX_RAY_DEPTH"), std::to_wstring(MaxRayDepth)));
+		result.push_back(std::make_pair(std::wstring(L"FLAT_NORMALS"), std::wstring(FlatNormals ? L"1" : L"0")));
+		result.push_back(std::make_pair(std::wstring(L"REFLECTION_BIAS_BITS"), std::wstring(biasBits)));
+		result.push_back(std::make_pair(std::wstring(L"TERMINATION_POLICY"), std::to_wstring((uint32_t)Termination)));
+		result.push_back(std::make_pair(std::wstring(L"RAY_INSTRUMENTATION"), std::wstring(Instrumentation ? L"1" : L"0")));
+		result.push_back(std::make_pair(std::wstring(L"HYBRID_PRIMARY"), std::wstring(HybridPrimary ? L"1" : L"0")));
+		return result;
+	}
+
+	std::string name() const
+	{
+		static const char* terminationNames[] = { "no termination", "threshold termination", "russian roulette" };
+		return "depth " + std::to_string(MaxRayDepth) + (FlatNormals ? ", flat normals" : ", smooth normals") + ", bias " + std::to_string(ReflectionBias) + ", " + terminationNames[Termination] + (Instrumentation ? ", instrumented" : "") + (HybridPrimary ? ", hybrid primary" : "");
+	}
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <d3d12.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+//Writes shader records into a table in memory, usually a persistently mapped upload buffer.
+//Each type in RecordArguments is the local root argument layout of one kind of record in the table.
+//The stride is the biggest record rounded up to the record alignment and is known at compile time
+template<typename... RecordArguments>
+class ShaderTableBuilder
+{
+	template<typename T, typename... Ts>
+	struct IsOneOf { static constexpr bool value = false; };
+
+	template<typename T, typename First, typename... Rest>
+	struct IsOneOf<T, First, Rest...> { static constexpr bool value = std::is_same<T, First>::value || IsOneOf<T, Rest...>::value; };
+
+	static constexpr UINT64 alignUp(UINT64 value, UINT64 alignment) { return ((value + alignment - 1) / alignment) * alignment; }
+
+	uint8_t* table_;
+	UINT32 numRecords_;
+
+	uint8_t* record(UINT32 index) const { return table_ + (UINT64)StrideInBytes * index; }
+
+public:
+	static constexpr UINT32 LargestRecord = (UINT32)(std::max)({ (size_t)D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, (D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES + sizeof(RecordArguments))... });
+	static constexpr UINT32 StrideInBytes = (UINT32)alignUp(LargestRecord, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
+
+	static_assert(StrideInBytes <= D3D12_RAYTRACING_MAX_SHADER_RECORD_STRIDE, "Shader record is bigger than the maximum stride");
+
+	static constexpr UINT64 SizeInBytes(UINT32 numRecords) { return (UINT64)StrideInBytes * numRecords; }
+
+	//table has to be at least SizeInBytes(numRecords) big and start on D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT on the GPU
+	ShaderTableBuilder(void* table, UINT32 numRecords)
+	{
+		table_ = (uint8_t*)table;
+		numRecords_ = numRecords;
+	}
+
+	UINT32 numRecords() const { return numRecords_; }
+
+	//Record without local root arguments
+	void write(UINT32 index, const void* shaderIdentifier)
+	{
+		memcpy(record(index), shaderIdentifier, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+		memset(record(index) + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, 0, StrideInBytes - D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+	}
+
+	template<typename Arguments>
+	void write(UINT32 index, const void* shaderIdentifier, const Arguments& arguments)
+	{
+		static_assert(IsOneOf<Arguments, RecordArguments...>::value, "Record type is not part of this shader table");
+
+		write(index, shaderIdentifier);
+		patchArguments(index, arguments);
+	}
+
+	//Swaps the shader of a record in place, for example after the pipeline has been recompiled
+	void patchIdentifier(UINT32 index, const void* shaderIdentifier)
+	{
+		memcpy(record(index), shaderIdentifier, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+	}
+
+	template<typename Arguments>
+	void patchArguments(UINT32 index, const Arguments& arguments)
+	{
+		static_assert(IsOneOf<Arguments, RecordArguments...>::value, "Record type is not part of this shader table");
+
+		memcpy(record(index) + D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES, &arguments, sizeof(Arguments));
+	}
+};
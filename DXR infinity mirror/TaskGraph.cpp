@@ -0,0 +1,220 @@
+#include "TaskGraph.h"
+#include "Profiler.h"
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+TaskGraph::TaskId TaskGraph::addTask(const std::string& name, const TaskFunction& function, const std::vector<TaskId>& dependencies, TaskAffinity affinity)
+{
+	TaskId id = (TaskId)tasks_.size();
+
+	Task task;
+	task.Name = name;
+	task.Function = function;
+	task.Affinity = affinity;
+	task.RemainingDependencies = 0;
+	task.DependencyFailed = false;
+	task.State = TaskState_Waiting;
+	task.StartMilliseconds = 0.0;
+	task.DurationMilliseconds = 0.0;
+	task.ThreadIndex = 0;
+
+	for (TaskId dependency : dependencies)
+	{
+		if (dependency >= id)
+		{
+			std::cerr << "Error: Task " << name << " depends on a task that was not added before it\n";
+			task.DependencyFailed = true;
+			continue;
+		}
+
+		tasks_[dependency].Dependents.push_back(id);
+		task.RemainingDependencies++;
+	}
+
+	tasks_.push_back(task);
+	return id;
+}
+
+void TaskGraph::makeReady(TaskId id)
+{
+	tasks_[id].State = TaskState_Ready;
+	if (tasks_[id].Affinity == TaskAffinity_MainThread)
+	{
+		readyMainThread_.push_back(id);
+	}
+	else
+	{
+		ready_.push_back(id);
+	}
+}
+
+void TaskGraph::finish(TaskId id, TaskState state)
+{
+	tasks_[id].State = state;
+	unfinished_--;
+
+	for (TaskId dependent : tasks_[id].Dependents)
+	{
+		Task& task = tasks_[dependent];
+		task.DependencyFailed |= (state != TaskState_Succeeded);
+
+		if (--task.RemainingDependencies == 0)
+		{
+			if (task.DependencyFailed)
+			{
+				finish(dependent, TaskState_Skipped);
+			}
+			else
+			{
+				makeReady(dependent);
+			}
+		}
+	}
+}
+
+bool TaskGraph::takeTask(bool mainThread, TaskId* pId)
+{
+	std::vector<TaskId>* queue = nullptr;
+	if (mainThread && !readyMainThread_.empty())
+	{
+		queue = &readyMainThread_;
+	}
+	else if (!ready_.empty())
+	{
+		queue = &ready_;
+	}
+	else
+	{
+		return false;
+	}
+
+	//first in first out, so tasks start roughly in the order they were added
+	*pId = queue->front();
+	queue->erase(queue->begin());
+	tasks_[*pId].State = TaskState_Running;
+	return true;
+}
+
+void TaskGraph::execute(TaskId id, uint32_t threadIndex)
+{
+	Task& task = tasks_[id];
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int result;
+	{
+		PROFILE_SCOPE(Profiler::enabled() ? Profiler::internName(task.Name) : nullptr);
+		result = task.Function();
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	task.StartMilliseconds = std::chrono::duration<double, std::milli>(start - runStart_).count();
+	task.DurationMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+	task.ThreadIndex = threadIndex;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	finish(id, result == 0 ? TaskState_Succeeded : TaskState_Failed);
+	wakeUp_.notify_all();
+}
+
+void TaskGraph::workerLoop(uint32_t threadIndex)
+{
+	const bool mainThread = (threadIndex == 0);
+
+	while (true)
+	{
+		TaskId id;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			wakeUp_.wait(lock, [&]()
+			{
+				return unfinished_ == 0 || !ready_.empty() || (mainThread && !readyMainThread_.empty());
+			});
+
+			if (!takeTask(mainThread, &id))
+			{
+				return; //everything is done
+			}
+		}
+
+		execute(id, threadIndex);
+	}
+}
+
+int TaskGraph::run(uint32_t numWorkers)
+{
+	runStart_ = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		unfinished_ = (uint32_t)tasks_.size();
+		for (TaskId id = 0; id < (TaskId)tasks_.size(); id++)
+		{
+			if (tasks_[id].State == TaskState_Waiting && tasks_[id].RemainingDependencies == 0)
+			{
+				if (tasks_[id].DependencyFailed)
+				{
+					finish(id, TaskState_Skipped);
+				}
+				else
+				{
+					makeReady(id);
+				}
+			}
+		}
+	}
+
+	std::vector<std::thread> workers;
+	for (uint32_t i = 0; i < numWorkers; i++)
+	{
+		workers.emplace_back([this, i]()
+		{
+			Profiler::setThreadName(Profiler::internName("Task graph worker " + std::to_string(i + 1)));
+			workerLoop(i + 1);
+		});
+	}
+
+	workerLoop(0);
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	runMilliseconds_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart_).count();
+
+	for (const Task& task : tasks_)
+	{
+		if (task.State != TaskState_Succeeded)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void TaskGraph::printTimings() const
+{
+	static const char* stateNames[] = { "waiting", "ready", "running", "done", "failed", "skipped" };
+
+	size_t nameWidth = 4;
+	for (const Task& task : tasks_)
+	{
+		nameWidth = std::max(nameWidth, task.Name.size());
+	}
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(nameWidth) << "Task" << std::right << std::setw(12) << "start ms" << std::setw(12) << "took ms" << std::setw(8) << "thread" << "  state\n";
+	for (const Task& task : tasks_)
+	{
+		std::cout << std::left << std::setw(nameWidth) << task.Name << std::right
+			<< std::setw(12) << task.StartMilliseconds
+			<< std::setw(12) << task.DurationMilliseconds
+			<< std::setw(8) << task.ThreadIndex
+			<< "  " << stateNames[task.State] << "\n";
+	}
+	std::cout << "Total " << runMilliseconds_ << " ms\n";
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout << std::setprecision(6);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+//Runs tasks on worker threads as soon as everything they depend on has finished.
+//Tasks return 0 on success like the setup functions do. A failed task skips everything that depends on it.
+//Only uses the standard library so any task can be swapped for a stub when exercising the scheduler
+class TaskGraph
+{
+public:
+	typedef uint32_t TaskId;
+	typedef std::function<int()> TaskFunction;
+
+	enum TaskAffinity
+	{
+		TaskAffinity_Any = 0,
+		TaskAffinity_MainThread = 1 //for work that has to happen on the thread that owns the window, such as creating the swap chain
+	};
+
+private:
+	enum TaskState
+	{
+		TaskState_Waiting = 0,
+		TaskState_Ready = 1,
+		TaskState_Running = 2,
+		TaskState_Succeeded = 3,
+		TaskState_Failed = 4,
+		TaskState_Skipped = 5
+	};
+
+	struct Task
+	{
+		std::string Name;
+		TaskFunction Function;
+		TaskAffinity Affinity;
+		std::vector<TaskId> Dependents;
+		uint32_t RemainingDependencies;
+		bool DependencyFailed;
+		TaskState State;
+
+		double StartMilliseconds;
+		double DurationMilliseconds;
+		uint32_t ThreadIndex; //0 is the thread that called run
+	};
+
+	std::vector<Task> tasks_;
+
+	std::mutex mutex_;
+	std::condition_variable wakeUp_;
+	std::vector<TaskId> ready_;
+	std::vector<TaskId> readyMainThread_;
+	uint32_t unfinished_ = 0;
+
+	std::chrono::steady_clock::time_point runStart_;
+	double runMilliseconds_ = 0.0;
+
+	void makeReady(TaskId id);
+	void finish(TaskId id, TaskState state);
+	bool takeTask(bool mainThread, TaskId* pId);
+	void execute(TaskId id, uint32_t threadIndex);
+	void workerLoop(uint32_t threadIndex);
+
+public:
+	//Dependencies have to be added before the tasks that depend on them, which keeps the graph free of cycles
+	TaskId addTask(const std::string& name, const TaskFunction& function, const std::vector<TaskId>& dependencies = {}, TaskAffinity affinity = TaskAffinity_Any);
+
+	//Blocks until every task has succeeded, failed or been skipped. The calling thread takes part and runs the main thread tasks.
+	//Returns 0 if every task succeeded
+	int run(uint32_t numWorkers);
+
+	//Per task start and duration relative to the start of run, in the order the tasks were added
+	void printTimings() const;
+};
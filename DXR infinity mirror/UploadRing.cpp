@@ -0,0 +1,59 @@
+#include "UploadRing.h"
+
+void UploadRing::init(uint64_t capacity)
+{
+	capacity_ = capacity;
+	head_ = 0;
+	used_ = 0;
+	pendingSize_ = 0;
+	submissions_.clear();
+}
+
+uint64_t UploadRing::allocate(uint64_t size, uint64_t alignment)
+{
+	//Nothing is queued or in flight, so the whole ring is free from the beginning
+	if (used_ == 0)
+	{
+		head_ = 0;
+	}
+
+	uint64_t offset = ((head_ + alignment - 1) / alignment) * alignment;
+	uint64_t padding = offset - head_;
+
+	//Allocations never straddle the end, the remainder is skipped and the allocation starts over at the beginning
+	if (offset + size > capacity_)
+	{
+		padding = capacity_ - head_;
+		offset = 0;
+	}
+
+	if (used_ + padding + size > capacity_) return INVALID_OFFSET;
+
+	head_ = offset + size;
+	used_ += padding + size;
+	pendingSize_ += padding + size;
+
+	return offset;
+}
+
+void UploadRing::submit(uint64_t fenceValue)
+{
+	if (pendingSize_ == 0) return;
+
+	submissions_.push_back({ fenceValue, pendingSize_ });
+	pendingSize_ = 0;
+}
+
+void UploadRing::reclaim(uint64_t completedFenceValue)
+{
+	while (!submissions_.empty() && submissions_.front().FenceValue <= completedFenceValue)
+	{
+		used_ -= submissions_.front().Size;
+		submissions_.pop_front();
+	}
+
+	if (used_ == 0)
+	{
+		head_ = 0;
+	}
+}
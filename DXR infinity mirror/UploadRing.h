@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+
+//Pure bookkeeping for a circular staging buffer, does not touch the device.
+//Allocations are grouped into submissions tagged with a fence value and are reclaimed in order once that fence has passed.
+//Only uses the standard library
+class UploadRing
+{
+	struct Submission
+	{
+		uint64_t FenceValue;
+		uint64_t Size;
+	};
+
+	uint64_t capacity_ = 0;
+	uint64_t head_ = 0;
+	uint64_t used_ = 0;
+	uint64_t pendingSize_ = 0; //bytes allocated since the last submit, including wrap and alignment padding
+
+	std::deque<Submission> submissions_;
+
+public:
+	static const uint64_t INVALID_OFFSET = UINT64_MAX;
+
+	void init(uint64_t capacity);
+
+	uint64_t allocate(uint64_t size, uint64_t alignment);
+	void submit(uint64_t fenceValue);
+	void reclaim(uint64_t completedFenceValue);
+
+	bool hasPending() const { return pendingSize_ > 0; }
+	uint64_t capacity() const { return capacity_; }
+	uint64_t used() const { return used_; }
+};
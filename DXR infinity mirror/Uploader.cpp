@@ -0,0 +1,199 @@
+#include "Uploader.h"
+
+Uploader::Uploader()
+{
+
+}
+
+Uploader::~Uploader()
+{
+	release();
+}
+
+int Uploader::init(ID3D12Device5* device, GpuAllocator* bufferAllocator, uint64_t ringSize)
+{
+	device_ = device;
+	bufferAllocator_ = bufferAllocator;
+
+	D3D12_COMMAND_QUEUE_DESC cqd = {};
+	cqd.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	if (FAILED(device_->CreateCommandQueue(&cqd, IID_PPV_ARGS(&queue_))))
+	{
+		std::cerr << "Error: Upload copy queue creation failed\n";
+		return 1;
+	}
+	queue_->SetName(L"Upload copy queue");
+
+	if (FAILED(device_->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence_))))
+	{
+		std::cerr << "Error: Upload fence creation failed\n";
+		return 1;
+	}
+	fence_->SetName(L"Upload fence");
+	eventHandle_ = CreateEvent(0, false, false, 0);
+
+	staging_ = bufferAllocator_->createBuffer(ringSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_HEAP_TYPE_UPLOAD, MemoryCategory_Staging);
+	if (staging_ == nullptr || FAILED(staging_->Map(0, nullptr, (void**)&mappedStaging_)))
+	{
+		std::cerr << "Error: Upload staging ring creation failed\n";
+		return 1;
+	}
+	staging_->SetName(L"Upload staging ring");
+	ring_.init(ringSize);
+
+	return 0;
+}
+
+void Uploader::release()
+{
+	if (fence_ != nullptr)
+	{
+		wait(nextFenceValue_ - 1);
+	}
+
+	if (staging_ != nullptr)
+	{
+		staging_->Unmap(0, nullptr);
+		mappedStaging_ = nullptr;
+		bufferAllocator_->releaseBuffer(&staging_);
+	}
+
+	for (CommandAllocatorEntry& entry : commandAllocators_)
+	{
+		SafeRelease(entry.Allocator);
+	}
+	commandAllocators_.clear();
+	recordingAllocator_ = nullptr;
+
+	SafeRelease(commandList_);
+	SafeRelease(fence_);
+	SafeRelease(queue_);
+
+	if (eventHandle_ != nullptr)
+	{
+		CloseHandle(eventHandle_);
+		eventHandle_ = nullptr;
+	}
+}
+
+int Uploader::beginRecording()
+{
+	if (recordingAllocator_ != nullptr) return 0;
+
+	//Reuse the first allocator whose commands the GPU is done with
+	UINT64 completedValue = fence_->GetCompletedValue();
+	for (CommandAllocatorEntry& entry : commandAllocators_)
+	{
+		if (entry.FenceValue <= completedValue)
+		{
+			recordingAllocator_ = entry.Allocator;
+			break;
+		}
+	}
+
+	if (recordingAllocator_ == nullptr)
+	{
+		if (FAILED(device_->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&recordingAllocator_))))
+		{
+			std::cerr << "Error: Upload command allocator creation failed\n";
+			return 1;
+		}
+		commandAllocators_.push_back({ recordingAllocator_, 0 });
+	}
+
+	recordingAllocator_->Reset();
+	if (commandList_ == nullptr)
+	{
+		if (FAILED(device_->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, recordingAllocator_, nullptr, IID_PPV_ARGS(&commandList_))))
+		{
+			std::cerr << "Error: Upload command list creation failed\n";
+			return 1;
+		}
+		commandList_->SetName(L"Upload command list");
+	}
+	else
+	{
+		commandList_->Reset(recordingAllocator_, nullptr);
+	}
+
+	return 0;
+}
+
+int Uploader::uploadBuffer(ID3D12Resource* destination, uint64_t destinationOffset, const void* data, uint64_t size)
+{
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+	const uint8_t* source = (const uint8_t*)data;
+
+	//Uploads bigger than the ring go through in ring sized chunks
+	while (size > 0)
+	{
+		uint64_t chunkSize = (std::min)(size, ring_.capacity());
+
+		ring_.reclaim(fence_->GetCompletedValue());
+		uint64_t offset = ring_.allocate(chunkSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+		if (offset == UploadRing::INVALID_OFFSET)
+		{
+			//The ring is full of queued or in flight data, submit it and wait for room
+			wait(flush());
+			ring_.reclaim(fence_->GetCompletedValue());
+			offset = ring_.allocate(chunkSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+			if (offset == UploadRing::INVALID_OFFSET)
+			{
+				std::cerr << "Error: Upload staging ring exhausted\n";
+				return 1;
+			}
+		}
+
+		if (beginRecording() != 0) return 1;
+
+		memcpy(mappedStaging_ + offset, source, chunkSize);
+		commandList_->CopyBufferRegion(destination, destinationOffset, staging_, offset, chunkSize);
+
+		source += chunkSize;
+		destinationOffset += chunkSize;
+		size -= chunkSize;
+	}
+
+	return 0;
+}
+
+UINT64 Uploader::flush()
+{
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+	if (recordingAllocator_ == nullptr) return nextFenceValue_ - 1;
+
+	const UINT64 fenceValue = nextFenceValue_++;
+
+	commandList_->Close();
+	ID3D12CommandList* listsToExec[] = { commandList_ };
+	queue_->ExecuteCommandLists(_countof(listsToExec), listsToExec);
+	queue_->Signal(fence_, fenceValue);
+
+	for (CommandAllocatorEntry& entry : commandAllocators_)
+	{
+		if (entry.Allocator == recordingAllocator_)
+		{
+			entry.FenceValue = fenceValue;
+		}
+	}
+	recordingAllocator_ = nullptr;
+	ring_.submit(fenceValue);
+
+	return fenceValue;
+}
+
+void Uploader::queueWait(ID3D12CommandQueue* queue, UINT64 fenceValue)
+{
+	queue->Wait(fence_, fenceValue);
+}
+
+void Uploader::wait(UINT64 fenceValue)
+{
+	if (fence_->GetCompletedValue() < fenceValue)
+	{
+		fence_->SetEventOnCompletion(fenceValue, eventHandle_);
+		WaitForSingleObject(eventHandle_, INFINITE);
+	}
+}
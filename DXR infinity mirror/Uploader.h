@@ -0,0 +1,58 @@
+#pragma once
+#include "stdafx.h"
+#include <mutex>
+
+#include "GenericIncludes.h"
+#include "GpuAllocator.h"
+#include "UploadRing.h"
+
+//Copies data into default heap buffers through a persistently mapped staging ring on its own copy queue.
+//Any number of uploads are batched into a single command list until flush is called.
+//Uploads and flushes may come from several threads
+class Uploader
+{
+	struct CommandAllocatorEntry
+	{
+		ID3D12CommandAllocator* Allocator;
+		UINT64 FenceValue;
+	};
+
+	GpuAllocator* bufferAllocator_ = nullptr;
+	std::recursive_mutex mutex_; //recursive since uploadBuffer flushes when the ring is full
+
+	ID3D12CommandQueue* queue_ = nullptr;
+	ID3D12GraphicsCommandList* commandList_ = nullptr;
+	std::vector<CommandAllocatorEntry> commandAllocators_;
+	ID3D12CommandAllocator* recordingAllocator_ = nullptr;
+
+	ID3D12Fence* fence_ = nullptr;
+	UINT64 nextFenceValue_ = 1;
+	HANDLE eventHandle_ = nullptr;
+
+	ID3D12Resource1* staging_ = nullptr;
+	uint8_t* mappedStaging_ = nullptr;
+	UploadRing ring_;
+
+	ID3D12Device5* device_ = nullptr;
+
+	int beginRecording();
+
+public:
+	Uploader();
+	~Uploader();
+
+	int init(ID3D12Device5* device, GpuAllocator* bufferAllocator, uint64_t ringSize);
+	void release();
+
+	//Queues a copy of size bytes into the destination buffer. The source data can be freed as soon as this returns
+	int uploadBuffer(ID3D12Resource* destination, uint64_t destinationOffset, const void* data, uint64_t size);
+
+	//Submits everything queued since the last flush. Returns the fence value that marks its completion
+	UINT64 flush();
+
+	//Makes another queue wait on the GPU for the uploads up to fenceValue
+	void queueWait(ID3D12CommandQueue* queue, UINT64 fenceValue);
+
+	//Blocks the calling thread until the uploads up to fenceValue are done
+	void wait(UINT64 fenceValue);
+};
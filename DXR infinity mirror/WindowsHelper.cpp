@@ -1,6 +1,7 @@
 #include "WindowsHelper.h"
 
 #include "Settings.h"
+#include "MemoryRegistry.h"
 
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -9,6 +10,12 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 	case WM_DESTROY:
 		PostQuitMessage(0);
 		break;
+	case WM_KEYDOWN:
+		if (wParam == MEMORY_REPORT_KEY)
+		{
+			MemoryRegistry::report(std::cout);
+		}
+		break;
 	}
 
 	return DefWindowProc(hWnd, message, wParam, lParam);
@@ -68,3 +75,128 @@ HWND InitWindow(HINSTANCE hInstance)
 
 	return hwnd;
 }
+
+namespace Shutdown
+{
+	HANDLE EventHandle = nullptr;
+	std::atomic<bool> Signaled = false;
+}
+
+void InitShutdownSignal()
+{
+	//Manual reset so that every thread waiting on it is released
+	Shutdown::EventHandle = CreateEvent(0, true, false, 0);
+	Shutdown::Signaled = false;
+}
+
+void FreeShutdownSignal()
+{
+	CloseHandle(Shutdown::EventHandle);
+	Shutdown::EventHandle = nullptr;
+}
+
+void SignalShutdown()
+{
+	Shutdown::Signaled = true;
+	SetEvent(Shutdown::EventHandle);
+}
+
+bool ShutdownSignaled()
+{
+	return Shutdown::Signaled;
+}
+
+HANDLE ShutdownSignalHandle()
+{
+	return Shutdown::EventHandle;
+}
+
+int RunMessageLoop()
+{
+	MSG msg = { 0 };
+	while (true)
+	{
+		//Sleep until there is either input for this thread or a shutdown request
+		DWORD result = MsgWaitForMultipleObjectsEx(1, &Shutdown::EventHandle, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+		if (result == WAIT_OBJECT_0)
+		{
+			return 0;
+		}
+
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+		{
+			if (msg.message == WM_QUIT)
+			{
+				return (int)msg.wParam;
+			}
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+	}
+}
+
+BOOL WINAPI ConsoleHandler(DWORD ctrlType)
+{
+	SignalShutdown();
+	return TRUE;
+}
+
+void RunHeadless()
+{
+	SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+	WaitForSingleObject(Shutdown::EventHandle, INFINITE);
+	SetConsoleCtrlHandler(ConsoleHandler, FALSE);
+}
+
+FILETIME GetFileLastWriteTime(const char* filePath)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+	GetFileAttributesExA(filePath, GetFileExInfoStandard, &attributes);
+	return attributes.ftLastWriteTime;
+}
+
+bool WaitForFileChange(const char* filePath, FILETIME* pLastWriteTime)
+{
+	std::string directory = filePath;
+	size_t separator = directory.find_last_of("/\\");
+	directory = (separator == std::string::npos) ? "." : directory.substr(0, separator);
+
+	//Editors often save by writing a new file and renaming it, so renames count as well
+	HANDLE changeHandle = FindFirstChangeNotificationA(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (changeHandle == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "Error: Failed watching " << directory << " for changes\n";
+		return false;
+	}
+
+	HANDLE handles[] = { Shutdown::EventHandle, changeHandle };
+	bool changed = false;
+	while (true)
+	{
+		//Also catches a change made between the previous call and creating the notification
+		FILETIME writeTime = GetFileLastWriteTime(filePath);
+		if (CompareFileTime(&writeTime, pLastWriteTime) != 0)
+		{
+			changed = true;
+			break;
+		}
+
+		if (WaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+		{
+			break;
+		}
+		FindNextChangeNotification(changeHandle);
+	}
+	FindCloseChangeNotification(changeHandle);
+
+	if (changed)
+	{
+		//Give the editor a moment to finish writing before the file is read
+		if (WaitForSingleObject(Shutdown::EventHandle, 100) == WAIT_OBJECT_0)
+		{
+			return false;
+		}
+		*pLastWriteTime = GetFileLastWriteTime(filePath);
+	}
+	return changed;
+}
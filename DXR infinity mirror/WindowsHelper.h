@@ -4,3 +4,22 @@
 #include "GenericIncludes.h"
 
 HWND InitWindow(HINSTANCE hInstance);
+
+//Shutdown signal shared by the main thread and the render loops
+void InitShutdownSignal();
+void FreeShutdownSignal();
+void SignalShutdown();
+bool ShutdownSignaled();
+HANDLE ShutdownSignalHandle();
+
+//Blocks on window messages and the shutdown signal. Returns the exit code of WM_QUIT
+int RunMessageLoop();
+
+//Blocks on the shutdown signal only, raised by the render loops or by closing the console
+void RunHeadless();
+
+FILETIME GetFileLastWriteTime(const char* filePath);
+
+//Blocks until the last write time of the file differs from *pLastWriteTime, then updates it.
+//Returns false if shutdown was signaled first
+bool WaitForFileChange(const char* filePath, FILETIME* pLastWriteTime);
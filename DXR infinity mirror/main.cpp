@@ -6,6 +6,7 @@
 #include "WindowsHelper.h"
 #include "DX12Base.h"
 #include "SceneObject.h"
+#include "Profiler.h"
 
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
@@ -22,14 +23,47 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	printf("Debugging Window:\n");
 #endif
 
-	MSG msg = { 0 };
-	HWND wndHandle = InitWindow(hInstance);
+	int exitCode = 0;
+	bool benchmark = (lpCmdLine != nullptr) && (wcsstr(lpCmdLine, BENCHMARK_ARGUMENT) != nullptr);
+	bool headless = benchmark || ((lpCmdLine != nullptr) && (wcsstr(lpCmdLine, HEADLESS_ARGUMENT) != nullptr));
+
+	BenchmarkConfig benchmarkConfig;
+	benchmarkConfig.Depths = { MAX_RAY_DEPTH };
+	benchmarkConfig.HybridPrimary = { HYBRID_PRIMARY_VISIBILITY };
+	benchmarkConfig.Resolutions = { { SCREEN_WIDTH, SCREEN_HEIGHT } };
+	benchmarkConfig.WarmupFrames = BENCHMARK_WARMUP_FRAMES;
+	benchmarkConfig.Frames = BENCHMARK_FRAMES;
+	benchmarkConfig.Model = MODEL_FILEPATH;
+	benchmarkConfig.OutputPath = BENCHMARK_OUTPUT;
+
+#ifndef _DEBUG
+	if (headless && AttachConsole(ATTACH_PARENT_PROCESS))
+	{
+		//Headless runs report to the console they were launched from
+		FILE* pCout;
+		FILE* pCerr;
+		freopen_s(&pCout, "conout$", "w", stdout);
+		freopen_s(&pCerr, "conout$", "w", stderr);
+	}
+#endif
+
+	if (benchmark && !ParseBenchmarkArguments(lpCmdLine, &benchmarkConfig))
+	{
+		return 1;
+	}
+
+	bool profiling = CPU_PROFILING || ((lpCmdLine != nullptr) && (wcsstr(lpCmdLine, PROFILE_ARGUMENT) != nullptr));
+	Profiler::setEnabled(profiling, CPU_PROFILE_EVENTS_PER_THREAD);
+	Profiler::setThreadName("Main thread");
+
+	InitShutdownSignal();
+	HWND wndHandle = headless ? nullptr : InitWindow(hInstance);
 
 	do
 	{
-		if (wndHandle)
+		if (wndHandle || headless)
 		{
-			if (DX12Setup(wndHandle) != 0)
+			if (DX12Setup(wndHandle, benchmarkConfig.Model.c_str(), benchmark) != 0)
 			{
 				std::cerr << "Failed DX12 and raytracing setup, exiting application\n";
 				break;
@@ -38,23 +72,51 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 			WaitForCompute();
 			WaitForDirect();
 
-			ShowWindow(wndHandle, nCmdShow);
+			if (!headless)
+			{
+				ShowWindow(wndHandle, nCmdShow);
+			}
 
 			//Launching the two threads that make up the rendering loop
 			std::thread computeLoop(ComputeLoop);
 			std::thread directLoop(DirectLoop);
-			while (WM_QUIT != msg.message)
+			std::thread exportLoop;
+			if (FRAME_STATISTICS_EXPORT_FRAMES != 0)
+			{
+				exportLoop = std::thread(FrameStatisticsExportLoop);
+			}
+			//An edit during a sweep would swap the permutation being measured, so benchmarks don't reload
+			std::thread shaderReloadLoop;
+			if (SHADER_HOT_RELOAD && !benchmark)
+			{
+				shaderReloadLoop = std::thread(ShaderReloadLoop);
+			}
+
+			//The main thread sleeps until there are window messages to handle or the loops are told to stop
+			if (benchmark)
+			{
+				exitCode = RunBenchmark(benchmarkConfig);
+			}
+			else if (headless)
 			{
-				if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
-				{
-					TranslateMessage(&msg);
-					DispatchMessage(&msg);
-				}
+				RunHeadless();
+			}
+			else
+			{
+				exitCode = RunMessageLoop();
 			}
 
 			TerminateLoops();
 			computeLoop.join();
 			directLoop.join();
+			if (exportLoop.joinable())
+			{
+				exportLoop.join();
+			}
+			if (shaderReloadLoop.joinable())
+			{
+				shaderReloadLoop.join();
+			}
 		}
 	} while (false);
 
@@ -63,11 +125,20 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	WaitForDirect();
 
 	DX12Free();
+	FreeShutdownSignal();
+
+	if (profiling)
+	{
+		Profiler::writeChromeTrace(CPU_PROFILE_OUTPUT);
+	}
 
 #ifdef _DEBUG
-	system("pause");
+	if (!headless)
+	{
+		system("pause");
+	}
 #endif
 
-	return (int)msg.wParam;
+	return exitCode;
 }
 
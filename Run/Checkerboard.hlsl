@@ -0,0 +1,54 @@
+//Fills the pixels a checkerboard frame did not trace, in place in the output.
+//Each of them still holds the output's previous frame, which traced the other half. The camera is fixed and the scene
+//turns slowly, so that value is kept, clamped to the range of the four traced neighbours so changed pixels don't ghost.
+//Without a usable previous frame the neighbours are interpolated along the direction they differ least
+
+RWTexture2D<float4> Output : register(u0);
+
+//Same layout as CB_Frame in RayTracingShaders.hlsl
+cbuffer CB_Frame : register(b0, space0)
+{
+    uint Checkerboard;
+    uint CheckerboardParity;
+    uint2 RenderSize;
+    uint HistoryValid;
+    uint FrameIndex;
+}
+
+float luma(float3 color)
+{
+    return dot(color, float3(0.299f, 0.587f, 0.114f));
+}
+
+//One thread per pixel that was not traced, laid out like the half width dispatch of the rays
+[numthreads(8, 8, 1)]
+void reconstruct(uint3 id : SV_DispatchThreadID)
+{
+    uint2 pixel = uint2(id.x * 2 + ((id.y + CheckerboardParity + 1) & 1), id.y);
+    if (any(pixel >= RenderSize))
+        return;
+
+    //The neighbours all have the traced parity. At the borders the neighbour on the other side is used twice
+    uint left = pixel.x > 0 ? pixel.x - 1 : pixel.x + 1;
+    uint right = pixel.x + 1 < RenderSize.x ? pixel.x + 1 : pixel.x - 1;
+    uint up = pixel.y > 0 ? pixel.y - 1 : pixel.y + 1;
+    uint down = pixel.y + 1 < RenderSize.y ? pixel.y + 1 : pixel.y - 1;
+
+    float3 l = Output[uint2(left, pixel.y)].rgb;
+    float3 r = Output[uint2(right, pixel.y)].rgb;
+    float3 u = Output[uint2(pixel.x, up)].rgb;
+    float3 d = Output[uint2(pixel.x, down)].rgb;
+
+    float3 color;
+    if (HistoryValid)
+    {
+        float3 lowest = min(min(l, r), min(u, d));
+        float3 highest = max(max(l, r), max(u, d));
+        color = clamp(Output[pixel].rgb, lowest, highest);
+    }
+    else
+    {
+        color = abs(luma(l) - luma(r)) <= abs(luma(u) - luma(d)) ? (l + r) * 0.5f : (u + d) * 0.5f;
+    }
+    Output[pixel] = float4(color, 1.0f);
+}
@@ -3,10 +3,96 @@ RWTexture2D<float4> gOutput : register(u0);
 
 cbuffer CB_Global : register(b0, space0)
 {
-    uint MaxRecursion;
-    float ReflectionBias;
+    uint CB_MaxRecursion;
+    float CB_ReflectionBias;
+    float CB_ConeFootprintLimit; //world space cone width past which reflections stop, 0 disables it
+    float CB_TerminationThreshold; //bounces of absorption left in the ray color below which the termination policy applies
 }
 
+//Written by the application for every frame, matches CheckerboardConstants on the CPU
+cbuffer CB_Frame : register(b1, space0)
+{
+    uint CB_Checkerboard; //only pixels whose x + y parity matches CB_CheckerboardParity are traced, in a half width dispatch
+    uint CB_CheckerboardParity;
+    uint2 CB_RenderSize; //top left part of the output that is rendered
+    uint CB_HistoryValid; //read by the reconstruction pass
+    uint CB_FrameIndex; //seeds the russian roulette
+}
+
+//Output pixel of the ray being traced
+uint2 tracedPixel()
+{
+    uint2 launchIndex = DispatchRaysIndex().xy;
+    if (CB_Checkerboard)
+        launchIndex.x = launchIndex.x * 2 + ((launchIndex.y + CB_CheckerboardParity) & 1);
+    return launchIndex;
+}
+
+//Running totals read back once per frame, laid out like RayStatisticsTotals on the CPU
+RWByteAddressBuffer RayStatistics : register(u1);
+#define STATISTICS_CONE_BOUNCES_SAVED 0
+#define STATISTICS_RAY_DEPTH_SUM 4
+#define STATISTICS_THROUGHPUT_TERMINATIONS 8
+
+//one atomic per wave instead of per ray
+void addStatistic(uint offset, uint value)
+{
+    uint waveValue = WaveActiveSum(value);
+    if (WaveIsFirstLane())
+        RayStatistics.InterlockedAdd(offset, waveValue);
+}
+
+//The application compiles one variant per permutation key and passes the values as defines,
+//so the depth test and absorption fold into constants. Without the defines they are read from the root constants
+#ifdef MAX_RAY_DEPTH
+static const uint MaxRecursion = MAX_RAY_DEPTH;
+#else
+#define MaxRecursion CB_MaxRecursion
+#endif
+
+#ifdef REFLECTION_BIAS_BITS
+static const float ReflectionBias = asfloat(REFLECTION_BIAS_BITS);
+#else
+#define ReflectionBias CB_ReflectionBias
+#endif
+
+//What happens to a mirror ray whose color has dropped below CB_TerminationThreshold, matches TerminationPolicy on the CPU
+#define TERMINATION_POLICY_NONE 0
+#define TERMINATION_POLICY_THRESHOLD 1
+#define TERMINATION_POLICY_RUSSIAN_ROULETTE 2
+#ifndef TERMINATION_POLICY
+#define TERMINATION_POLICY TERMINATION_POLICY_NONE
+#endif
+
+//Writes the bounce count and last hit of every pixel, packed like PixelStatistics.h on the CPU.
+//DXR doesn't expose traversal steps, so those are not recorded
+#ifndef RAY_INSTRUMENTATION
+#define RAY_INSTRUMENTATION 0
+#endif
+#define HIT_TYPE_MIRROR 0
+#define HIT_TYPE_EDGES 1
+#define HIT_TYPE_MISS 2
+
+#if RAY_INSTRUMENTATION
+RWStructuredBuffer<uint> PixelStatistics : register(u2);
+#endif
+
+//The first hit of every pixel is read from the rasterised visibility buffer, so tracing starts at the first reflection
+#ifndef HYBRID_PRIMARY
+#define HYBRID_PRIMARY 0
+#endif
+
+#if HYBRID_PRIMARY
+//xyz is the world normal of a mirror hit or the color of an edges hit, w the distance along the camera ray.
+//w is negative for edges and 0 where nothing was hit, written by Visibility.hlsl
+Texture2D<float4> VisibilityBuffer : register(t4);
+#endif
+
+//Flat meshes have one normal per triangle, which the loader packs into its own buffer
+#ifndef FLAT_NORMALS
+#define FLAT_NORMALS 0
+#endif
+
 //Mirror Resources
 struct Vertex
 {
@@ -15,8 +101,12 @@ struct Vertex
     float2 uv;
 };
 
+#if FLAT_NORMALS
+StructuredBuffer<uint> FaceNormals : register(t3);
+#else
 StructuredBuffer<Vertex> Vertecies : register(t1);
 StructuredBuffer<uint> Indecies : register(t2);
+#endif
 //
 
 //Edges Resources
@@ -26,20 +116,129 @@ cbuffer CB_EdgesShaderTableLocal : register(b0, space2)
 }
 //
 
+//The ray cone of the pixel. Planar mirrors keep the spread angle, so the width only grows with the distance travelled
 struct RayPayload
 {
 	float3 color;
     uint depth;
+    float coneWidth;
+    float coneSpreadAngle;
+#if RAY_INSTRUMENTATION
+    uint hitType; //of the last ray, set by whichever shader ends the path
+#endif
 };
 
+//Inverse of PackNormalOctahedral, x in the low 16 bits and y in the high 16 bits as snorms
+float3 decodeOctahedral(uint packed)
+{
+    float2 e = float2(int2(packed << 16, packed) >> 16) / 32767.0f;
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy -= (step(0.0f, n.xy) * 2.0f - 1.0f) * t;
+    return normalize(n);
+}
+
+//Hash of the pixel, the bounce and the frame, so a pixel's roulette differs from frame to frame and averages out over time
+float randomFloat(uint2 pixel, uint depth, uint frame)
+{
+    uint h = pixel.x * 0x8da6b343u ^ pixel.y * 0xd8163841u ^ depth * 0xcb1ab31fu ^ frame * 0x9e3779b9u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return float(h >> 8) * (1.0f / 16777216.0f);
+}
+
+//The hit and miss shading is shared between the shaders and the rasterised first hit of the hybrid raygen
+
+void shadeMiss(inout RayPayload payload)
+{
+	payload.color = float3(0.0f, 0.0f, 0.0f);
+#if RAY_INSTRUMENTATION
+    payload.hitType = HIT_TYPE_MISS;
+#endif
+}
+
+void shadeEdges(inout RayPayload payload, float3 color)
+{
+    payload.color *= color;
+#if RAY_INSTRUMENTATION
+    payload.hitType = HIT_TYPE_EDGES;
+#endif
+}
+
+//Absorption, depth limit, cone footprint and termination policy of a mirror hit. Returns false when the path ends there
+bool mirrorPathContinues(inout RayPayload payload, float hitDistance, out float survival)
+{
+    survival = 1.0f;
+    float absorption = 1.0f / float(MaxRecursion);
+    payload.color -= float3(absorption, absorption, absorption);
+    
+    if (payload.depth >= MaxRecursion)
+        return false;
+    
+    //Once the cone covers more than the edges the deeper reflections only darken the same spot,
+    //so their absorption is applied at once instead of tracing them
+    payload.coneWidth += payload.coneSpreadAngle * hitDistance;
+    if (CB_ConeFootprintLimit > 0.0f && payload.coneWidth > CB_ConeFootprintLimit)
+    {
+        uint skipped = MaxRecursion - payload.depth;
+        payload.color -= absorption * float(skipped);
+        addStatistic(STATISTICS_CONE_BOUNCES_SAVED, skipped);
+        return false;
+    }
+    
+#if TERMINATION_POLICY != TERMINATION_POLICY_NONE
+    //Every hit absorbs the same amount, so the threshold counts hits: with a threshold of 4 the policy applies once
+    //fewer than 4 hits are left before the color runs out, whatever the maximum depth.
+    //The roulette survivors are weighted by the inverse of their survival chance, so the expected color is unchanged
+    float throughput = max(payload.color.r, max(payload.color.g, payload.color.b));
+    float threshold = CB_TerminationThreshold * absorption;
+    if (throughput < threshold)
+    {
+#if TERMINATION_POLICY == TERMINATION_POLICY_RUSSIAN_ROULETTE
+        survival = throughput / threshold;
+#else
+        survival = 0.0f;
+#endif
+        if (randomFloat(tracedPixel(), payload.depth, CB_FrameIndex) >= survival)
+        {
+            payload.color = float3(0.0f, 0.0f, 0.0f);
+            addStatistic(STATISTICS_THROUGHPUT_TERMINATIONS, 1);
+            return false;
+        }
+    }
+#endif
+    
+    payload.depth++;
+    return true;
+}
+
+void traceReflection(inout RayPayload payload, float3 hitPosition, float3 worldNormal, float3 rayDirection, float survival)
+{
+    RayDesc ray;
+    ray.Origin = hitPosition + worldNormal * ReflectionBias;
+    ray.Direction = normalize(reflect(rayDirection, worldNormal));
+    
+    ray.TMin = 0;
+    ray.TMax = 100000;
+ 
+    TraceRay(gRtScene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES /*rayFlags*/, 0xFF, 0 /* ray index*/, 0, 0, ray, payload);
+#if TERMINATION_POLICY == TERMINATION_POLICY_RUSSIAN_ROULETTE
+    payload.color /= survival;
+#endif
+}
+
 [shader("raygeneration")]
 void rayGen()
 {
-	uint3 launchIndex = DispatchRaysIndex();
-	uint3 launchDim = DispatchRaysDimensions();
+	uint2 pixel = tracedPixel();
+	if (pixel.x >= CB_RenderSize.x)
+		return; //the last checkerboard column of an odd width
 
-	float2 crd = float2(launchIndex.xy);
-	float2 dims = float2(launchDim.xy);
+	float2 crd = float2(pixel);
+	float2 dims = float2(CB_RenderSize);
 
 	float2 d = ((crd / dims) * 2.f - 1.f);
 	float aspectRatio = dims.x / dims.y;
@@ -51,15 +250,47 @@ void rayGen()
 	ray.TMin = 0;
 	ray.TMax = 100000;
 
-    RayPayload payload = { float3(1.0f, 1.0f, 1.0f), 1 };
+    RayPayload payload;
+    payload.color = float3(1.0f, 1.0f, 1.0f);
+    payload.depth = 1;
+    payload.coneWidth = 0.0f;
+    payload.coneSpreadAngle = atan(2.0f / dims.y); //the image plane is 2 units tall at distance 1
+#if RAY_INSTRUMENTATION
+    payload.hitType = HIT_TYPE_MIRROR;
+#endif
+#if HYBRID_PRIMARY
+    //What the hit and miss shaders would have done with the camera ray
+    float4 visibility = VisibilityBuffer[pixel];
+    if (visibility.w == 0.0f)
+    {
+        shadeMiss(payload);
+    }
+    else if (visibility.w < 0.0f)
+    {
+        shadeEdges(payload, visibility.rgb);
+    }
+    else
+    {
+        float survival;
+        if (mirrorPathContinues(payload, visibility.w, survival))
+            traceReflection(payload, ray.Origin + ray.Direction * visibility.w, visibility.xyz, ray.Direction, survival);
+    }
+#else
     TraceRay(gRtScene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES /*rayFlags*/, 0xFF, 0 /* ray index*/, 0, 0, ray, payload);
-	gOutput[launchIndex.xy] = float4(payload.color, 1);
+#endif
+	gOutput[pixel] = float4(payload.color, 1);
+
+#if RAY_INSTRUMENTATION
+    PixelStatistics[pixel.y * CB_RenderSize.x + pixel.x] = min(payload.depth, 0xFFu) | (payload.hitType << 8);
+#endif
+
+    addStatistic(STATISTICS_RAY_DEPTH_SUM, payload.depth);
 }
 
 [shader("miss")]
 void miss(inout RayPayload payload)
 {
-	payload.color = float3(0.0f, 0.0f, 0.0f);
+    shadeMiss(payload);
 }
 
 [shader("closesthit")]
@@ -70,14 +301,15 @@ void closestHit_mirror(inout RayPayload payload, in BuiltInTriangleIntersectionA
     uint instanceID = InstanceID();
     uint primitiveID = PrimitiveIndex();
     
-    float absorption = 1.0f / float(MaxRecursion);
-    payload.color -= float3(absorption, absorption, absorption);
-    
-    if (payload.depth >= MaxRecursion)
+    float survival;
+    if (!mirrorPathContinues(payload, RayTCurrent(), survival))
         return;
-    
-    payload.depth++;
 	
+#if FLAT_NORMALS
+    //4 bytes per hit instead of three indices and three vertices
+    float3 worldRayOrigin = WorldRayOrigin() + RayTCurrent() * WorldRayDirection();
+    float3 worldNormal = normalize(mul(decodeOctahedral(FaceNormals[primitiveID]), (float3x3) ObjectToWorld4x3()));
+#else
     Vertex vtx0 = Vertecies[Indecies[primitiveID * 3 + 0]];
     Vertex vtx1 = Vertecies[Indecies[primitiveID * 3 + 1]];
     Vertex vtx2 = Vertecies[Indecies[primitiveID * 3 + 2]];
@@ -87,16 +319,8 @@ void closestHit_mirror(inout RayPayload payload, in BuiltInTriangleIntersectionA
     
     float3 worldRayOrigin = mul(float4(interPos, 1.0f), ObjectToWorld4x3());
     float3 worldNormal = normalize(mul(interNorm, (float3x3) ObjectToWorld4x3()));
-    worldRayOrigin += worldNormal * ReflectionBias;
-    
-    RayDesc ray;
-    ray.Origin = worldRayOrigin;
-    ray.Direction = normalize(reflect(WorldRayDirection(), worldNormal));
-    
-    ray.TMin = 0;
-    ray.TMax = 100000;
- 
-    TraceRay(gRtScene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES /*rayFlags*/, 0xFF, 0 /* ray index*/, 0, 0, ray, payload);
+#endif
+    traceReflection(payload, worldRayOrigin, worldNormal, WorldRayDirection(), survival);
 }
 
 [shader("closesthit")]
@@ -107,5 +331,5 @@ void closestHit_edges(inout RayPayload payload, in BuiltInTriangleIntersectionAt
     //uint instanceID = InstanceID();
     //uint primitiveID = PrimitiveIndex();
 
-    payload.color *= ShaderTableColor;
+    shadeEdges(payload, ShaderTableColor);
 }
@@ -0,0 +1,52 @@
+//Scales the part of the ray tracing output the last dispatch rendered up to the full output size.
+//Each pixel blends the four nearest source texels with bilinear weights, scaled down for texels whose luma is far from the
+//nearest texel's. Flat regions get plain bilinear filtering, while the dark mirror edges stay sharp instead of bleeding
+
+Texture2D<float4> Source : register(t0);
+RWTexture2D<float4> Destination : register(u0);
+
+cbuffer CB_Upscale : register(b0, space0)
+{
+    uint2 SourceSize;
+    uint2 DestinationSize;
+}
+
+static const float EdgeSharpness = 8.0f;
+
+float luma(float3 color)
+{
+    return dot(color, float3(0.299f, 0.587f, 0.114f));
+}
+
+[numthreads(8, 8, 1)]
+void upscale(uint3 id : SV_DispatchThreadID)
+{
+    if (any(id.xy >= DestinationSize))
+        return;
+
+    float2 position = (float2(id.xy) + 0.5f) * float2(SourceSize) / float2(DestinationSize) - 0.5f;
+    int2 base = int2(floor(position));
+    float2 f = position - float2(base);
+
+    int2 maxTexel = int2(SourceSize) - 1;
+    float3 c00 = Source[clamp(base, 0, maxTexel)].rgb;
+    float3 c10 = Source[clamp(base + int2(1, 0), 0, maxTexel)].rgb;
+    float3 c01 = Source[clamp(base + int2(0, 1), 0, maxTexel)].rgb;
+    float3 c11 = Source[clamp(base + int2(1, 1), 0, maxTexel)].rgb;
+
+    float4 weights = float4((1.0f - f.x) * (1.0f - f.y), f.x * (1.0f - f.y), (1.0f - f.x) * f.y, f.x * f.y);
+
+    //the nearest texel has the largest bilinear weight
+    float3 nearest = c00;
+    float nearestWeight = weights.x;
+    if (weights.y > nearestWeight) { nearest = c10; nearestWeight = weights.y; }
+    if (weights.z > nearestWeight) { nearest = c01; nearestWeight = weights.z; }
+    if (weights.w > nearestWeight) { nearest = c11; }
+
+    float nearestLuma = luma(nearest);
+    float4 lumaDistance = abs(float4(luma(c00), luma(c10), luma(c01), luma(c11)) - nearestLuma);
+    weights *= exp(-EdgeSharpness * lumaDistance);
+
+    float3 color = (c00 * weights.x + c10 * weights.y + c01 * weights.z + c11 * weights.w) / max(dot(weights, 1.0f), 1e-5f);
+    Destination[id.xy] = float4(color, 1.0f);
+}
@@ -0,0 +1,67 @@
+//Rasterises the first hit of every pixel for the hybrid raygen, from the same vertex and index buffers the BLASes are built from.
+//The projection reproduces the camera rays of rayGen, so each pixel sees what its primary ray would have hit
+
+cbuffer CB_Visibility : register(b0, space0)
+{
+    row_major float3x4 ObjectToWorld; //the instance transform of the TLAS
+    float2 PixelOffset; //moves the pixel centers the rasteriser samples onto the pixel corners rayGen aims at
+    float AspectRatio;
+    uint Instance; //MIRROR_PART or EDGES_PART
+    float3 EdgesColor;
+    uint FlatNormals;
+}
+
+//Same as in Settings.h
+#define MIRROR_PART 0
+
+StructuredBuffer<uint> FaceNormals : register(t0);
+
+static const float3 CameraOrigin = float3(0.0f, 0.0f, -1.5f);
+static const float NearPlane = 0.01f;
+static const float FarPlane = 1000.0f;
+
+struct VertexIn
+{
+    float3 position : POSITION;
+    float3 normal : NORMAL;
+};
+
+struct VertexOut
+{
+    float4 position : SV_Position;
+    float3 worldPosition : POSITION;
+    float3 worldNormal : NORMAL;
+};
+
+//Inverse of PackNormalOctahedral, x in the low 16 bits and y in the high 16 bits as snorms
+float3 decodeOctahedral(uint packed)
+{
+    float2 e = float2(int2(packed << 16, packed) >> 16) / 32767.0f;
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy -= (step(0.0f, n.xy) * 2.0f - 1.0f) * t;
+    return normalize(n);
+}
+
+VertexOut visibilityVS(VertexIn input)
+{
+    VertexOut output;
+    output.worldPosition = mul(ObjectToWorld, float4(input.position, 1.0f));
+    output.worldNormal = mul((float3x3) ObjectToWorld, input.normal);
+
+    //rayGen aims the ray of pixel corner d at (d.x * aspect, -d.y, 1) in these coordinates
+    float3 view = output.worldPosition - CameraOrigin;
+    output.position = float4(view.x / AspectRatio + PixelOffset.x * view.z, view.y + PixelOffset.y * view.z,
+        (view.z - NearPlane) * FarPlane / (FarPlane - NearPlane), view.z);
+    return output;
+}
+
+float4 visibilityPS(VertexOut input, uint primitiveID : SV_PrimitiveID) : SV_Target
+{
+    float distance = length(input.worldPosition - CameraOrigin);
+    if (Instance != MIRROR_PART)
+        return float4(EdgesColor, -distance);
+
+    float3 normal = FlatNormals ? mul((float3x3) ObjectToWorld, decodeOctahedral(FaceNormals[primitiveID])) : input.worldNormal;
+    return float4(normalize(normal), distance);
+}
@@ -0,0 +1,67 @@
+//The heap bookkeeping of GpuAllocator, with heap offsets standing in for the placed buffers
+#include "BuddyAllocator.h"
+#include "TestCheck.h"
+
+static const uint64_t KB = 1024;
+
+int main()
+{
+	//A 1MB heap of 64KB blocks, like the 64MB heaps of 64KB placement alignment in miniature
+	BuddyAllocator allocator(1024 * KB, 64 * KB);
+
+	//Small buffers take a whole minimum block
+	uint64_t a = allocator.allocate(1 * KB, 64 * KB);
+	uint64_t b = allocator.allocate(100 * KB, 64 * KB);
+	CHECK(a == 0);
+	CHECK(b == 128 * KB); //a 128KB block, aligned to its size
+	CHECK(b % (128 * KB) == 0);
+
+	GpuAllocatorStats stats;
+	allocator.addStats(&stats);
+	CHECK(stats.HeapBytes == 1024 * KB);
+	CHECK(stats.AllocatedBytes == 192 * KB);
+	CHECK(stats.RequestedBytes == 101 * KB);
+	CHECK(stats.NumAllocations == 2);
+	CHECK(stats.LargestFreeBlock == 512 * KB);
+	CHECK(stats.Fragmentation() > 0.0f);
+
+	//A bigger alignment asks for a bigger block
+	uint64_t c = allocator.allocate(64 * KB, 256 * KB);
+	CHECK(c != BuddyAllocator::INVALID_OFFSET && c % (256 * KB) == 0);
+
+	//Does not fit in what is left
+	CHECK(allocator.allocate(1024 * KB, 64 * KB) == BuddyAllocator::INVALID_OFFSET);
+	CHECK(allocator.allocate(2048 * KB, 64 * KB) == BuddyAllocator::INVALID_OFFSET);
+
+	//Freeing everything merges the buddies back into one block
+	allocator.free(a);
+	allocator.free(b);
+	allocator.free(c);
+	CHECK(allocator.empty());
+	GpuAllocatorStats freed;
+	allocator.addStats(&freed);
+	CHECK(freed.AllocatedBytes == 0 && freed.RequestedBytes == 0);
+	CHECK(freed.LargestFreeBlock == 1024 * KB);
+	CHECK(freed.Fragmentation() == 0.0f);
+	CHECK(allocator.allocate(1024 * KB, 64 * KB) == 0);
+
+	//Filling the heap with minimum blocks and freeing every other one leaves it fully fragmented
+	BuddyAllocator small(256 * KB, 64 * KB);
+	uint64_t blocks[4];
+	for (int i = 0; i < 4; i++)
+	{
+		blocks[i] = small.allocate(64 * KB, 64 * KB);
+		CHECK(blocks[i] == (uint64_t)i * 64 * KB);
+	}
+	CHECK(small.allocate(64 * KB, 64 * KB) == BuddyAllocator::INVALID_OFFSET);
+	small.free(blocks[0]);
+	small.free(blocks[2]);
+	GpuAllocatorStats split;
+	small.addStats(&split);
+	CHECK(split.FreeBytes() == 128 * KB);
+	CHECK(split.LargestFreeBlock == 64 * KB);
+	CHECK(split.Fragmentation() == 0.5f);
+	CHECK(small.allocate(128 * KB, 64 * KB) == BuddyAllocator::INVALID_OFFSET);
+
+	return failedChecks;
+}
@@ -0,0 +1,66 @@
+//BLAS compaction without a GPU. A deterministic sizing model stands in for the prebuild info and the compacted size
+//queries, and a BuddyAllocator with the 64KB blocks of the buffer heaps stands in for GpuAllocator
+#include "CompactionLedger.h"
+#include "BuddyAllocator.h"
+#include "TestCheck.h"
+#include <sstream>
+
+static const uint64_t KB = 1024;
+
+//Worst case and compacted sizes growing with the triangle count, roughly as drivers report them
+static uint64_t prebuildBytes(uint64_t triangles) { return 4 * KB + triangles * 128; }
+static uint64_t compactedBytes(uint64_t triangles) { return 2 * KB + triangles * 48; }
+
+int main()
+{
+	BuddyAllocator heap(16 * 1024 * KB, 64 * KB);
+	const uint64_t meshTriangles[] = { 12, 1500, 6000 };
+	const uint32_t numMeshes = 3;
+
+	uint64_t originals[numMeshes];
+	uint64_t compacted[numMeshes];
+	for (uint32_t i = 0; i < numMeshes; i++)
+	{
+		originals[i] = heap.allocate(prebuildBytes(meshTriangles[i]), 64 * KB);
+		CHECK(originals[i] != BuddyAllocator::INVALID_OFFSET);
+	}
+
+	//Offsets stand in for the buffers, shifted so that offset 0 is not a null handle
+	CompactionLedger ledger;
+	for (uint32_t i = 0; i < numMeshes; i++)
+	{
+		compacted[i] = heap.allocate(compactedBytes(meshTriangles[i]), 64 * KB);
+		CHECK(compacted[i] != BuddyAllocator::INVALID_OFFSET);
+		ledger.addCompaction(i, prebuildBytes(meshTriangles[i]), compactedBytes(meshTriangles[i]),
+			heap.blockSizeAt(originals[i]), heap.blockSizeAt(compacted[i]), (void*)(uintptr_t)(originals[i] + 1));
+	}
+
+	//12 triangles fit the minimum block either way, 1500 go from 256KB to 128KB, 6000 from 1MB to 512KB
+	CHECK(ledger.blockBytesBefore() == (64 + 256 + 1024) * KB);
+	CHECK(ledger.blockBytesAfter() == (64 + 128 + 512) * KB);
+
+	//Until the copies are done both the originals and the compacted buffers are allocated
+	GpuAllocatorStats during;
+	heap.addStats(&during);
+	CHECK(during.AllocatedBytes == ledger.blockBytesBefore() + ledger.blockBytesAfter());
+
+	std::vector<void*> released = ledger.takeOriginals();
+	CHECK(released.size() == numMeshes);
+	CHECK(ledger.takeOriginals().empty()); //handed over once
+	for (void* original : released)
+	{
+		heap.free((uint64_t)(uintptr_t)original - 1);
+	}
+
+	//What is left is exactly the compacted blocks the report counts
+	GpuAllocatorStats after;
+	heap.addStats(&after);
+	CHECK(after.AllocatedBytes == ledger.blockBytesAfter());
+	CHECK(after.NumAllocations == numMeshes);
+
+	std::ostringstream report;
+	ledger.report(report);
+	CHECK(report.str().find("1344 KB -> 704 KB of heap blocks, freeing 640 KB") != std::string::npos);
+
+	return failedChecks;
+}
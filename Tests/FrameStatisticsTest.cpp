@@ -0,0 +1,85 @@
+//Bucket layout and percentiles of StreamingHistogram
+#include "FrameStatistics.h"
+#include "TestCheck.h"
+#include <cstdint>
+
+//Every value has to land in the bucket whose range holds it
+static bool inItsBucket(uint64_t value)
+{
+	uint32_t index = StreamingHistogram::bucketIndex(value);
+	bool belowTop = value <= StreamingHistogram::bucketHighestValue(index);
+	bool aboveBottom = index == 0 || value > StreamingHistogram::bucketHighestValue(index - 1);
+	return index < StreamingHistogram::BucketCount && belowTop && aboveBottom;
+}
+
+int main()
+{
+	//Exact up to 63, then pairs from 64 to 127 and fours from 128
+	CHECK(StreamingHistogram::bucketIndex(63) == 63);
+	CHECK(StreamingHistogram::bucketHighestValue(63) == 63);
+	CHECK(StreamingHistogram::bucketIndex(64) == 64);
+	CHECK(StreamingHistogram::bucketIndex(65) == 64);
+	CHECK(StreamingHistogram::bucketHighestValue(64) == 65);
+	CHECK(StreamingHistogram::bucketIndex(127) == 95);
+	CHECK(StreamingHistogram::bucketHighestValue(95) == 127);
+	CHECK(StreamingHistogram::bucketIndex(128) == 96);
+	CHECK(StreamingHistogram::bucketIndex(131) == 96);
+	CHECK(StreamingHistogram::bucketIndex(132) == 97);
+	CHECK(StreamingHistogram::bucketHighestValue(96) == 131);
+
+	//The top power of two fills the last buckets exactly
+	const uint64_t top = 1ull << 63;
+	CHECK(StreamingHistogram::bucketIndex(top) == StreamingHistogram::BucketCount - 32);
+	CHECK(StreamingHistogram::bucketHighestValue(StreamingHistogram::BucketCount - 33) == top - 1);
+	CHECK(StreamingHistogram::bucketIndex(UINT64_MAX) == StreamingHistogram::BucketCount - 1);
+	CHECK(StreamingHistogram::bucketHighestValue(StreamingHistogram::BucketCount - 1) == UINT64_MAX);
+
+	//Around every power of two, and no bucket wider than 1 / 32 of its values
+	for (uint32_t bit = 0; bit < 64; bit++)
+	{
+		uint64_t power = 1ull << bit;
+		CHECK(inItsBucket(power - 1));
+		CHECK(inItsBucket(power));
+		CHECK(inItsBucket(power + 1));
+		CHECK(inItsBucket(power + power / 2));
+	}
+	for (uint32_t index = 1; index < StreamingHistogram::BucketCount; index++)
+	{
+		uint64_t lowest = StreamingHistogram::bucketHighestValue(index - 1) + 1;
+		uint64_t width = StreamingHistogram::bucketHighestValue(index) - lowest + 1;
+		CHECK(width == 1 || width <= lowest / 32);
+	}
+
+	//Nearest rank over 1 to 100, where values past 63 report the top of their pair of values
+	StreamingHistogram histogram;
+	CHECK(histogram.snapshot().percentile(50.0) == 0); //empty
+	for (uint64_t value = 1; value <= 100; value++)
+	{
+		histogram.record(value);
+	}
+
+	HistogramSnapshot snapshot = histogram.snapshot();
+	CHECK(snapshot.Count == 100);
+	CHECK(snapshot.Min == 1 && snapshot.Max == 100);
+	CHECK(snapshot.mean() == 50.5);
+	CHECK(snapshot.percentile(0.0) == 1); //rank 1
+	CHECK(snapshot.percentile(1.0) == 1);
+	CHECK(snapshot.percentile(50.0) == 50);
+	CHECK(snapshot.percentile(50.5) == 51); //rank 51, rounded up
+	CHECK(snapshot.percentile(90.0) == 91); //90 and 91 share a bucket
+	CHECK(snapshot.percentile(99.0) == 99);
+	CHECK(snapshot.percentile(100.0) == 100); //the 100 and 101 bucket, clamped to Max
+
+	//A single slow frame among fast ones only shows from the percentile that reaches it
+	StreamingHistogram frames;
+	for (int i = 0; i < 999; i++)
+	{
+		frames.record(16000);
+	}
+	frames.record(250000);
+	HistogramSnapshot frameSnapshot = frames.snapshot();
+	CHECK(frameSnapshot.percentile(99.9) < 16000 + 16000 / 32);
+	CHECK(frameSnapshot.percentile(99.95) == 250000);
+
+	return failedChecks;
+}
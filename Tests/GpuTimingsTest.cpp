@@ -0,0 +1,116 @@
+//GPU pass timings fed by a simulated timestamp backend instead of query heaps. The backend advances a tick counter at a
+//chosen frequency and resolves the queries of a frame slot the way ResolveQueryData fills the readback buffer
+#include "GpuTimings.h"
+#include "TestCheck.h"
+#include <cmath>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	//Query indices of one slot, laid out like ComputeTimestamp in DX12Base.cpp
+	enum SimulatedQuery
+	{
+		SimulatedQuery_TlasBegin = 0,
+		SimulatedQuery_TlasEnd = 1,
+		SimulatedQuery_DispatchBegin = 2,
+		SimulatedQuery_DispatchEnd = 3,
+		SimulatedQuery_Count = 4
+	};
+
+	class SimulatedTimestamps
+	{
+		uint64_t ticksPerSecond_;
+		uint64_t now_;
+		std::vector<uint64_t> readback_; //both slots back to back
+
+	public:
+		SimulatedTimestamps(uint64_t ticksPerSecond, uint64_t start) : ticksPerSecond_(ticksPerSecond), now_(start), readback_(2 * SimulatedQuery_Count, 0) {}
+
+		uint64_t frequency() const { return ticksPerSecond_; }
+
+		void runFor(double milliseconds) { now_ += (uint64_t)(milliseconds * ticksPerSecond_ / 1000.0); }
+		void endQuery(int slot, SimulatedQuery query) { readback_[slot * SimulatedQuery_Count + query] = now_; }
+		void clear(int slot, SimulatedQuery query) { readback_[slot * SimulatedQuery_Count + query] = 0; }
+		uint64_t read(int slot, SimulatedQuery query) const { return readback_[slot * SimulatedQuery_Count + query]; }
+
+		//One frame: an idle gap, the TLAS build and the rays
+		void frame(int slot, double tlasMilliseconds, double dispatchMilliseconds)
+		{
+			runFor(0.5);
+			endQuery(slot, SimulatedQuery_TlasBegin);
+			runFor(tlasMilliseconds);
+			endQuery(slot, SimulatedQuery_TlasEnd);
+			endQuery(slot, SimulatedQuery_DispatchBegin);
+			runFor(dispatchMilliseconds);
+			endQuery(slot, SimulatedQuery_DispatchEnd);
+		}
+
+		void addSamples(int slot, GpuTimingStatistics* statistics) const
+		{
+			statistics->addSample(GpuPass_TlasBuild, read(slot, SimulatedQuery_TlasBegin), read(slot, SimulatedQuery_TlasEnd), ticksPerSecond_);
+			statistics->addSample(GpuPass_DispatchRays, read(slot, SimulatedQuery_DispatchBegin), read(slot, SimulatedQuery_DispatchEnd), ticksPerSecond_);
+		}
+	};
+
+	bool near(double a, double b) { return std::fabs(a - b) < 1e-6; }
+}
+
+int main()
+{
+	CHECK(near(GpuTimingStatistics::ticksToMilliseconds(1000, 11000, 10000000), 1.0));
+	CHECK(GpuTimingStatistics::ticksToMilliseconds(11000, 1000, 10000000) < 0.0); //end before begin
+	CHECK(GpuTimingStatistics::ticksToMilliseconds(0, 1000, 0) < 0.0); //no frequency
+
+	//A 10MHz timestamp clock that starts at a large value, as real ones do
+	SimulatedTimestamps gpu(10000000, 1ull << 40);
+	GpuTimingStatistics statistics;
+
+	const double dispatchMilliseconds[] = { 4.0, 6.0, 5.0, 5.0 };
+	for (int frame = 0; frame < 4; frame++)
+	{
+		int slot = frame & 1;
+		gpu.frame(slot, 0.25, dispatchMilliseconds[frame]);
+		gpu.addSamples(slot, &statistics);
+	}
+
+	//A frame whose dispatch end was never written, which resolves as 0 and is dropped
+	gpu.frame(0, 0.25, 100.0);
+	gpu.clear(0, SimulatedQuery_DispatchEnd);
+	gpu.addSamples(0, &statistics);
+
+	std::ostringstream report;
+	statistics.report(report);
+	CHECK(report.str() ==
+		"GPU TLAS build: mean 0.25 ms, min 0.25 ms, max 0.25 ms over 5 frames\n"
+		"GPU DispatchRays: mean 5 ms, min 4 ms, max 6 ms over 4 frames\n");
+
+	//The report starts over and passes without samples are left out
+	std::ostringstream empty;
+	statistics.report(empty);
+	CHECK(empty.str().empty());
+
+	//Samples from several threads all count
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&statistics]()
+		{
+			for (int i = 0; i < 100; i++)
+			{
+				statistics.addSample(GpuPass_Copy, 0, 20000, 10000000);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::ostringstream copies;
+	statistics.report(copies);
+	CHECK(copies.str() == "GPU Upscale and copy to backbuffer: mean 2 ms, min 2 ms, max 2 ms over 400 frames\n");
+
+	return failedChecks;
+}
@@ -0,0 +1,39 @@
+//The per slot flags that decide when DispatchOutput records the dispatch list of a frame slot again.
+//They are only tested as flags, the command lists themselves need a device
+#include "RecordedListCache.h"
+#include "TestCheck.h"
+
+int main()
+{
+	RecordedListCache cache;
+
+	//Nothing is recorded at startup
+	CHECK(cache.needsRecording(0) && cache.needsRecording(1));
+
+	//Slots are independent, the first frame of one slot doesn't record the other
+	cache.markRecorded(0);
+	CHECK(!cache.needsRecording(0));
+	CHECK(cache.needsRecording(1));
+	cache.markRecorded(1);
+	CHECK(!cache.needsRecording(0) && !cache.needsRecording(1));
+
+	//Recorded slots stay recorded frame after frame
+	for (int frame = 0; frame < 10; frame++)
+	{
+		CHECK(!cache.needsRecording(frame % 2));
+	}
+
+	//An invalidation records both slots again, even the one that is not used next
+	cache.invalidate();
+	CHECK(cache.needsRecording(0) && cache.needsRecording(1));
+	cache.markRecorded(1);
+	CHECK(cache.needsRecording(0) && !cache.needsRecording(1));
+
+	//Invalidating twice before a slot comes back is the same as once
+	cache.invalidate();
+	cache.invalidate();
+	cache.markRecorded(0);
+	CHECK(!cache.needsRecording(0) && cache.needsRecording(1));
+
+	return failedChecks;
+}
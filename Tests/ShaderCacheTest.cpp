@@ -0,0 +1,149 @@
+//ShaderCache with a stub compiler that counts its calls, so hits and misses show without dxcompiler.
+//Sources and blobs live in a directory next to the test executable
+#include "ShaderCache.h"
+#include "TestCheck.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const std::string directory = "ShaderCacheTest.files";
+	const std::string cacheDirectory = directory + "/cache";
+
+	void writeFile(const std::string& path, const std::string& content)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << content;
+	}
+
+	std::string readFile(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	//Same naming as ShaderCache::blobPath
+	std::string blobPath(uint64_t key)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.dxil", (unsigned long long)key);
+		return cacheDirectory + "/" + name;
+	}
+
+	//Stands in for dxc, the output only has to differ between sources
+	struct StubCompiler
+	{
+		uint32_t Calls = 0;
+		bool Fails = false;
+
+		ShaderCache::CompileFunction function()
+		{
+			return [this](std::vector<char>& dxil)
+			{
+				Calls++;
+				std::string output = "DXIL " + std::to_string(Calls);
+				dxil.assign(output.begin(), output.end());
+				return !Fails;
+			};
+		}
+	};
+
+	//Compiles desc through the cache and returns whether the stub compiler ran
+	bool compiles(ShaderCache& cache, StubCompiler& compiler, const ShaderCacheKeyDesc& desc)
+	{
+		uint32_t calls = compiler.Calls;
+		std::vector<char> dxil;
+		CHECK(cache.getOrCompile(desc, compiler.function(), dxil));
+		CHECK(!dxil.empty());
+		return compiler.Calls != calls;
+	}
+
+	uint64_t keyOf(const ShaderCache& cache, const ShaderCacheKeyDesc& desc)
+	{
+		uint64_t key = 0;
+		CHECK(cache.computeKey(desc, &key));
+		return key;
+	}
+}
+
+int main()
+{
+	ShaderCache cache;
+	//The first call only creates the directory the sources go in
+	CHECK(cache.init(directory));
+	CHECK(cache.init(cacheDirectory));
+
+	writeFile(directory + "/Common.hlsli", "#define BOUNCE_COLOR float3(1, 1, 1)\n");
+	writeFile(directory + "/Shaders.hlsl", "#include \"Common.hlsli\"\n[shader(\"raygeneration\")] void rayGen() {}\n");
+
+	ShaderCacheKeyDesc desc;
+	desc.FilePath = directory + "/Shaders.hlsl";
+	desc.TargetProfile = L"lib_6_3";
+	desc.CompileArguments = { L"-O3" };
+	desc.Defines = { { L"MAX_RAY_DEPTH", L"8" } };
+	desc.CompilerVersion = 1;
+
+	//Blobs left by an earlier run would turn the cold miss into a hit
+	std::remove(blobPath(keyOf(cache, desc)).c_str());
+
+	StubCompiler compiler;
+	CHECK(compiles(cache, compiler, desc)); //cold
+	CHECK(!compiles(cache, compiler, desc)); //warm
+	CHECK(cache.hits() == 1 && cache.misses() == 1);
+
+	//Editing the include changes the key
+	writeFile(directory + "/Common.hlsli", "#define BOUNCE_COLOR float3(1, 0, 0)\n");
+	std::remove(blobPath(keyOf(cache, desc)).c_str());
+	CHECK(compiles(cache, compiler, desc));
+	CHECK(!compiles(cache, compiler, desc));
+
+	//So do the defines and the arguments
+	ShaderCacheKeyDesc deeper = desc;
+	deeper.Defines[0].second = L"16";
+	CHECK(keyOf(cache, deeper) != keyOf(cache, desc));
+	std::remove(blobPath(keyOf(cache, deeper)).c_str());
+	CHECK(compiles(cache, compiler, deeper));
+
+	ShaderCacheKeyDesc debug = desc;
+	debug.CompileArguments.push_back(L"-Zi");
+	CHECK(keyOf(cache, debug) != keyOf(cache, desc));
+	std::remove(blobPath(keyOf(cache, debug)).c_str());
+	CHECK(compiles(cache, compiler, debug));
+
+	//None of those evicted the original
+	CHECK(!compiles(cache, compiler, desc));
+
+	//A blob cut short, as by a crash while storing, is compiled again and replaced
+	std::string blob = readFile(blobPath(keyOf(cache, desc)));
+	CHECK(blob.size() > 4);
+	writeFile(blobPath(keyOf(cache, desc)), blob.substr(0, blob.size() - 4));
+	CHECK(compiles(cache, compiler, desc));
+	CHECK(!compiles(cache, compiler, desc));
+
+	//As is one whose contents no longer match the checksum
+	blob = readFile(blobPath(keyOf(cache, desc)));
+	blob[blob.size() - 1] ^= 0x5A;
+	writeFile(blobPath(keyOf(cache, desc)), blob);
+	CHECK(compiles(cache, compiler, desc));
+	CHECK(!compiles(cache, compiler, desc));
+
+	//Without a readable source there is no key. The compiler still runs, its error is what gets reported
+	ShaderCacheKeyDesc missing = desc;
+	missing.FilePath = directory + "/Missing.hlsl";
+	uint64_t key = 0;
+	CHECK(!cache.computeKey(missing, &key));
+	CHECK(compiles(cache, compiler, missing));
+	CHECK(compiles(cache, compiler, missing)); //nothing was stored
+
+	//A failed compilation stores nothing either
+	std::remove(blobPath(keyOf(cache, deeper)).c_str());
+	compiler.Fails = true;
+	std::vector<char> dxil;
+	CHECK(!cache.getOrCompile(deeper, compiler.function(), dxil));
+	compiler.Fails = false;
+	CHECK(compiles(cache, compiler, deeper));
+
+	return failedChecks;
+}
@@ -0,0 +1,98 @@
+//Shader record layout of ShaderTableBuilder, checked byte by byte in a plain buffer instead of an upload heap.
+//The record types mirror ShaderRecords in DX12Base.cpp
+#include "ShaderTable.h"
+#include "TestCheck.h"
+#include <vector>
+
+namespace
+{
+	struct RayGen
+	{
+		UINT64 DescriptorTable;
+	};
+
+	struct MirrorHitGroup
+	{
+		UINT64 Scene;
+		UINT64 Vertecies;
+		UINT64 Indecies;
+	};
+
+	struct EdgesHitGroup
+	{
+		float ShaderTableColor[3];
+	};
+
+	typedef ShaderTableBuilder<MirrorHitGroup, EdgesHitGroup> HitGroupTable;
+
+	void fillIdentifier(uint8_t* identifier, uint8_t value)
+	{
+		memset(identifier, value, D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+	}
+
+	bool allBytesAre(const uint8_t* bytes, size_t count, uint8_t value)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (bytes[i] != value)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	//Identifier only, 32 bytes, and identifier plus 8 bytes rounded up to 64
+	CHECK(ShaderTableBuilder<>::StrideInBytes == 32);
+	CHECK(ShaderTableBuilder<RayGen>::StrideInBytes == 64);
+
+	//The biggest record sets the stride: 32 + 24 bytes of MirrorHitGroup rounds up to 64
+	CHECK(HitGroupTable::LargestRecord == 56);
+	CHECK(HitGroupTable::StrideInBytes == 64);
+	CHECK(HitGroupTable::SizeInBytes(3) == 192);
+
+	std::vector<uint8_t> memory(HitGroupTable::SizeInBytes(3), 0xCD);
+	HitGroupTable table(memory.data(), 3);
+	CHECK(table.numRecords() == 3);
+
+	uint8_t mirrorIdentifier[D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES];
+	uint8_t edgesIdentifier[D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES];
+	fillIdentifier(mirrorIdentifier, 0x11);
+	fillIdentifier(edgesIdentifier, 0x22);
+
+	MirrorHitGroup mirror = { 0x1000, 0x2000, 0x3000 };
+	EdgesHitGroup edges = { { 1.0f, 0.5f, 0.25f } };
+	table.write(0, mirrorIdentifier, mirror);
+	table.write(1, mirrorIdentifier, mirror);
+	table.write(2, edgesIdentifier, edges);
+
+	//Identifier first, arguments straight after it and the rest of the stride zeroed
+	const uint8_t* record0 = memory.data();
+	CHECK(allBytesAre(record0, 32, 0x11));
+	CHECK(memcmp(record0 + 32, &mirror, sizeof(mirror)) == 0);
+	CHECK(allBytesAre(record0 + 32 + sizeof(mirror), 64 - 32 - sizeof(mirror), 0));
+
+	const uint8_t* record2 = memory.data() + 2 * HitGroupTable::StrideInBytes;
+	CHECK(allBytesAre(record2, 32, 0x22));
+	CHECK(memcmp(record2 + 32, &edges, sizeof(edges)) == 0);
+	CHECK(allBytesAre(record2 + 32 + sizeof(edges), 64 - 32 - sizeof(edges), 0));
+
+	//Patching touches only its own part of its own record
+	uint8_t recompiledIdentifier[D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES];
+	fillIdentifier(recompiledIdentifier, 0x33);
+	table.patchIdentifier(1, recompiledIdentifier);
+	MirrorHitGroup moved = { 0x4000, 0x5000, 0x6000 };
+	table.patchArguments(0, moved);
+
+	const uint8_t* record1 = memory.data() + HitGroupTable::StrideInBytes;
+	CHECK(allBytesAre(record1, 32, 0x33));
+	CHECK(memcmp(record1 + 32, &mirror, sizeof(mirror)) == 0);
+	CHECK(allBytesAre(record0, 32, 0x11));
+	CHECK(memcmp(record0 + 32, &moved, sizeof(moved)) == 0);
+	CHECK(allBytesAre(record2, 32, 0x22));
+
+	return failedChecks;
+}
@@ -0,0 +1,12 @@
+#pragma once
+//The few d3d12.h types and constants ShaderTable.h uses, with the values of the Windows SDK, so the record layout can be tested without Windows
+#include <cstdint>
+
+typedef uint32_t UINT;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+
+#define D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES 32
+#define D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT 32
+#define D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT 64
+#define D3D12_RAYTRACING_MAX_SHADER_RECORD_STRIDE 4096
@@ -0,0 +1,124 @@
+//The startup scheduler with stub tasks in place of the setup stages
+#include "TaskGraph.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	//Start and end of every task on one clock, so the order across threads can be compared afterwards
+	struct StubTask
+	{
+		std::atomic<uint32_t> Runs{ 0 };
+		uint32_t Start = 0;
+		uint32_t End = 0;
+		std::thread::id Thread;
+	};
+
+	std::atomic<uint32_t> ticks{ 0 };
+
+	TaskGraph::TaskFunction stub(StubTask* task, int result = 0)
+	{
+		return [task, result]()
+		{
+			task->Runs++;
+			task->Thread = std::this_thread::get_id();
+			task->Start = ++ticks;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1)); //gives the other workers time to jump ahead if they could
+			task->End = ++ticks;
+			return result;
+		};
+	}
+}
+
+int main()
+{
+	//A diamond with a tail, run a few times since the interleaving differs every run
+	for (int run = 0; run < 10; run++)
+	{
+		StubTask device, scene, queues, shaders, pipeline, tables;
+
+		TaskGraph graph;
+		TaskGraph::TaskId deviceId = graph.addTask("Device", stub(&device));
+		TaskGraph::TaskId sceneId = graph.addTask("Scene", stub(&scene));
+		TaskGraph::TaskId queuesId = graph.addTask("Queues", stub(&queues), { deviceId });
+		TaskGraph::TaskId shadersId = graph.addTask("Shaders", stub(&shaders), { sceneId });
+		TaskGraph::TaskId pipelineId = graph.addTask("Pipeline", stub(&pipeline), { queuesId, shadersId });
+		graph.addTask("Tables", stub(&tables), { pipelineId });
+
+		CHECK(graph.run(4) == 0);
+		CHECK(queues.Start > device.End);
+		CHECK(shaders.Start > scene.End);
+		CHECK(pipeline.Start > queues.End && pipeline.Start > shaders.End);
+		CHECK(tables.Start > pipeline.End);
+		CHECK(device.Runs == 1 && tables.Runs == 1);
+	}
+
+	//A failure skips everything downstream of it, and only that
+	{
+		StubTask device, queues, swapChain, renderTargets, scene;
+
+		TaskGraph graph;
+		TaskGraph::TaskId deviceId = graph.addTask("Device", stub(&device));
+		TaskGraph::TaskId queuesId = graph.addTask("Queues", stub(&queues), { deviceId });
+		TaskGraph::TaskId swapChainId = graph.addTask("Swap chain", stub(&swapChain, 1), { queuesId });
+		graph.addTask("Render targets", stub(&renderTargets), { swapChainId });
+		graph.addTask("Scene", stub(&scene));
+
+		CHECK(graph.run(2) == 1);
+		CHECK(device.Runs == 1 && queues.Runs == 1 && swapChain.Runs == 1);
+		CHECK(renderTargets.Runs == 0);
+		CHECK(scene.Runs == 1);
+	}
+
+	//Main thread tasks run on the thread that called run, whatever the number of workers
+	{
+		StubTask device, swapChains[8];
+
+		TaskGraph graph;
+		TaskGraph::TaskId deviceId = graph.addTask("Device", stub(&device));
+		for (StubTask& swapChain : swapChains)
+		{
+			graph.addTask("Swap chain", stub(&swapChain), { deviceId }, TaskGraph::TaskAffinity_MainThread);
+		}
+
+		CHECK(graph.run(4) == 0);
+		for (StubTask& swapChain : swapChains)
+		{
+			CHECK(swapChain.Runs == 1);
+			CHECK(swapChain.Thread == std::this_thread::get_id());
+		}
+	}
+
+	//A dependency on a task added later, or on itself, is rejected and the task never runs
+	{
+		StubTask first, forward, self;
+
+		TaskGraph graph;
+		TaskGraph::TaskId firstId = graph.addTask("First", stub(&first), { 1 });
+		graph.addTask("Forward", stub(&forward), { firstId });
+		graph.addTask("Self", stub(&self), { 2 });
+
+		CHECK(graph.run(1) == 1);
+		CHECK(first.Runs == 0);
+		CHECK(forward.Runs == 0);
+		CHECK(self.Runs == 0);
+	}
+
+	//No workers at all, the calling thread runs everything
+	{
+		StubTask a, b;
+
+		TaskGraph graph;
+		TaskGraph::TaskId aId = graph.addTask("A", stub(&a));
+		graph.addTask("B", stub(&b), { aId });
+
+		CHECK(graph.run(0) == 0);
+		CHECK(b.Start > a.End);
+		CHECK(a.Thread == std::this_thread::get_id() && b.Thread == std::this_thread::get_id());
+	}
+
+	return failedChecks;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <iostream>
+
+//Every test executable returns the number of failed checks from main
+static int failedChecks = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+			failedChecks++; \
+		} \
+	} while (false)
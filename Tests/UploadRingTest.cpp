@@ -0,0 +1,122 @@
+//The staging ring of the Uploader, with a stand-in for the copy queue that completes submissions when told to
+#include "UploadRing.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <vector>
+
+static const uint64_t Alignment = 512; //D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT
+
+//Fence values are signaled in submission order and complete whenever the test says so
+struct StandInQueue
+{
+	uint64_t NextFenceValue = 1;
+	uint64_t CompletedValue = 0;
+
+	uint64_t submit(UploadRing* ring)
+	{
+		ring->submit(NextFenceValue);
+		return NextFenceValue++;
+	}
+	void completeUpTo(uint64_t fenceValue) { CompletedValue = std::max(CompletedValue, fenceValue); }
+};
+
+//Mirrors the chunk loop of Uploader::uploadBuffer. Returns the number of chunks, or -1 when the ring ran out
+static int upload(UploadRing* ring, StandInQueue* queue, uint64_t size)
+{
+	int chunks = 0;
+	while (size > 0)
+	{
+		uint64_t chunkSize = std::min(size, ring->capacity());
+
+		ring->reclaim(queue->CompletedValue);
+		uint64_t offset = ring->allocate(chunkSize, Alignment);
+		if (offset == UploadRing::INVALID_OFFSET)
+		{
+			//flush and wait
+			queue->completeUpTo(queue->submit(ring));
+			ring->reclaim(queue->CompletedValue);
+			offset = ring->allocate(chunkSize, Alignment);
+			if (offset == UploadRing::INVALID_OFFSET)
+			{
+				return -1;
+			}
+		}
+		CHECK(offset % Alignment == 0);
+		CHECK(offset + chunkSize <= ring->capacity());
+
+		size -= chunkSize;
+		chunks++;
+	}
+	return chunks;
+}
+
+int main()
+{
+	{
+		//Allocations are aligned and charged their padding until their submission is reclaimed
+		UploadRing ring;
+		ring.init(4096);
+		StandInQueue queue;
+		CHECK(ring.allocate(100, Alignment) == 0);
+		CHECK(ring.allocate(100, Alignment) == 512);
+		CHECK(ring.used() == 612);
+		CHECK(ring.hasPending());
+		uint64_t fence = queue.submit(&ring);
+		CHECK(!ring.hasPending());
+
+		ring.reclaim(fence - 1);
+		CHECK(ring.used() == 612);
+		ring.reclaim(fence);
+		CHECK(ring.used() == 0);
+
+		//A drained ring starts over at the beginning, so a full size allocation fits without any wrap padding
+		CHECK(ring.allocate(4096, Alignment) == 0);
+		CHECK(ring.used() == 4096);
+		CHECK(ring.allocate(1, Alignment) == UploadRing::INVALID_OFFSET);
+	}
+
+	{
+		//Allocations that don't fit before the end wrap around and are charged the skipped remainder
+		UploadRing ring;
+		ring.init(4096);
+		StandInQueue queue;
+		CHECK(ring.allocate(2000, Alignment) == 0);
+		uint64_t first = queue.submit(&ring);
+		CHECK(ring.allocate(1024, Alignment) == 2048);
+		uint64_t second = queue.submit(&ring);
+		CHECK(ring.used() == 3072);
+
+		//Only 1024 bytes are left at the end, and the front is still in flight
+		CHECK(ring.allocate(1536, Alignment) == UploadRing::INVALID_OFFSET);
+		queue.completeUpTo(first);
+		ring.reclaim(queue.CompletedValue);
+		CHECK(ring.used() == 1072);
+		//The first 2000 bytes are free again, the second allocation still holds the rest
+		CHECK(ring.allocate(2048, Alignment) == UploadRing::INVALID_OFFSET);
+		CHECK(ring.allocate(1536, Alignment) == 0);
+		CHECK(ring.used() == 1072 + 1024 + 1536);
+		uint64_t third = queue.submit(&ring);
+
+		queue.completeUpTo(second);
+		ring.reclaim(queue.CompletedValue);
+		CHECK(ring.used() == 1024 + 1536);
+		queue.completeUpTo(third);
+		ring.reclaim(queue.CompletedValue);
+		CHECK(ring.used() == 0);
+	}
+
+	{
+		//Uploads bigger than the ring go through in ring sized chunks, also after earlier uploads moved the head
+		UploadRing ring;
+		ring.init(4096);
+		StandInQueue queue;
+		CHECK(upload(&ring, &queue, 700) == 1);
+		CHECK(upload(&ring, &queue, 4096 * 3 + 10) == 4);
+		CHECK(upload(&ring, &queue, 4096) == 1);
+		queue.completeUpTo(queue.submit(&ring));
+		ring.reclaim(queue.CompletedValue);
+		CHECK(ring.used() == 0);
+	}
+
+	return failedChecks;
+}